@@ -0,0 +1,83 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Merges the outputs of the shards of a sharded parse_sdm run, see
+// --cpu_instructions_shard_count, and runs the transforms on the result. The
+// outputs are the same as those of a single parse_sdm run over all the pages.
+
+#include <vector>
+#include "strings/string.h"
+
+#include "gflags/gflags.h"
+
+#include "cpu_instructions/base/transform_factory.h"
+#include "cpu_instructions/proto/instructions.pb.h"
+#include "cpu_instructions/util/proto_util.h"
+#include "cpu_instructions/util/telemetry.h"
+#include "cpu_instructions/x86/pdf/parse_sdm.h"
+#include "glog/logging.h"
+#include "strings/str_cat.h"
+#include "strings/str_split.h"
+#include "util/task/status.h"
+
+DEFINE_string(cpu_instructions_shard_output_bases, "",
+              "The comma-separated output bases of the parse_sdm shards, in "
+              "shard order.");
+DEFINE_string(cpu_instructions_output_file_base, "",
+              "Where to dump the merged instructions");
+
+namespace cpu_instructions {
+namespace {
+
+void Main() {
+  const std::vector<string> shard_output_bases =
+      strings::Split(FLAGS_cpu_instructions_shard_output_bases, ",",  // NOLINT
+                     strings::SkipEmpty());
+  CHECK(!shard_output_bases.empty())
+      << "missing --cpu_instructions_shard_output_bases";
+  CHECK(!FLAGS_cpu_instructions_output_file_base.empty())
+      << "missing --cpu_instructions_output_file_base";
+
+  Telemetry::Get();  // Starts measuring the wall time.
+  InstructionSetProto instruction_set;
+  {
+    ScopedStageTimer timer("merge_sdm_shards");
+    instruction_set = x86::pdf::MergeSdmShardsOrDie(
+        shard_output_bases, FLAGS_cpu_instructions_output_file_base);
+  }
+
+  // Optionally apply transforms in --cpu_instructions_transforms.
+  {
+    ScopedStageTimer timer("transforms");
+    CHECK_OK(RunTransformPipeline(GetTransformsFromCommandLineFlags(),
+                                  &instruction_set));
+  }
+
+  // Write transformed intruction set.
+  const string instructions_filename =
+      StrCat(FLAGS_cpu_instructions_output_file_base, "_transformed.pbtxt");
+  LOG(INFO) << "Saving instruction database as: " << instructions_filename;
+  WriteTextProtoOrDie(instructions_filename, instruction_set);
+
+  Telemetry::Get()->LogReport();
+}
+
+}  // namespace
+}  // namespace cpu_instructions
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cpu_instructions::Main();
+  return 0;
+}
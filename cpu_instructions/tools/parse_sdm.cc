@@ -14,11 +14,15 @@
 
 #include "strings/string.h"
 
+#include <chrono>
+#include <memory>
+
 #include "gflags/gflags.h"
 
 #include "cpu_instructions/base/transform_factory.h"
 #include "cpu_instructions/proto/instructions.pb.h"
 #include "cpu_instructions/util/proto_util.h"
+#include "cpu_instructions/util/telemetry.h"
 #include "cpu_instructions/x86/pdf/parse_sdm.h"
 #include "glog/logging.h"
 #include "strings/str_cat.h"
@@ -36,6 +40,10 @@ DEFINE_string(cpu_instructions_output_file_base, "",
 DEFINE_string(cpu_instructions_patch_sets_file,
               "cpu_instructions/x86/pdf/sdm_patches.pbtxt",
               "A set of patches to original documents");
+DEFINE_int32(cpu_instructions_telemetry_period_seconds, 60,
+             "How often the throughput of the stages of the parser is logged, "
+             "0 disables it. A summary is always written to "
+             "<output_file_base>_telemetry.pbtxt at the end of the run.");
 
 namespace cpu_instructions {
 namespace {
@@ -46,19 +54,47 @@ void Main() {
   CHECK(!FLAGS_cpu_instructions_output_file_base.empty())
       << "missing --cpu_instructions_output_file_base";
 
-  InstructionSetProto instruction_set = x86::pdf::ParseSdmOrDie(
-      FLAGS_cpu_instructions_input_spec, FLAGS_cpu_instructions_patch_sets_file,
-      FLAGS_cpu_instructions_output_file_base);
+  Telemetry::Get();  // Starts measuring the wall time.
+  std::unique_ptr<PeriodicTelemetryLogger> telemetry_logger;
+  if (FLAGS_cpu_instructions_telemetry_period_seconds > 0) {
+    telemetry_logger.reset(new PeriodicTelemetryLogger(std::chrono::seconds(
+        FLAGS_cpu_instructions_telemetry_period_seconds)));
+  }
+
+  InstructionSetProto instruction_set;
+  {
+    ScopedStageTimer timer("parse_sdm");
+    instruction_set = x86::pdf::ParseSdmOrDie(
+        FLAGS_cpu_instructions_input_spec,
+        FLAGS_cpu_instructions_patch_sets_file,
+        FLAGS_cpu_instructions_output_file_base);
+  }
+
+  if (FLAGS_cpu_instructions_shard_count > 1) {
+    // The instruction set is partial, the transforms are run by
+    // merge_sdm_shards.
+    LOG(INFO) << "Skipping the transforms of the shard";
+  } else {
+    // Optionally apply transforms in --cpu_instructions_transforms.
+    {
+      ScopedStageTimer timer("transforms");
+      CHECK_OK(RunTransformPipeline(GetTransformsFromCommandLineFlags(),
+                                    &instruction_set));
+    }
 
-  // Optionally apply transforms in --cpu_instructions_transforms.
-  CHECK_OK(RunTransformPipeline(GetTransformsFromCommandLineFlags(),
-                                &instruction_set));
+    // Write transformed intruction set.
+    const string instructions_filename =
+        StrCat(FLAGS_cpu_instructions_output_file_base, "_transformed.pbtxt");
+    LOG(INFO) << "Saving instruction database as: " << instructions_filename;
+    WriteTextProtoOrDie(instructions_filename, instruction_set);
+  }
 
-  // Write transformed intruction set.
-  const string instructions_filename =
-      StrCat(FLAGS_cpu_instructions_output_file_base, "_transformed.pbtxt");
-  LOG(INFO) << "Saving instruction database as: " << instructions_filename;
-  WriteTextProtoOrDie(instructions_filename, instruction_set);
+  telemetry_logger.reset();
+  Telemetry::Get()->LogReport();
+  const string telemetry_filename =
+      StrCat(FLAGS_cpu_instructions_output_file_base, "_telemetry.pbtxt");
+  LOG(INFO) << "Saving telemetry as: " << telemetry_filename;
+  WriteTextProtoOrDie(telemetry_filename, Telemetry::Get()->GetReport());
 }
 
 }  // namespace
@@ -0,0 +1,72 @@
+#!/bin/bash
+# Copyright 2017 Google Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Runs the shards of a sharded parse_sdm as local subprocesses, then merges
+# them with merge_sdm_shards. The outputs are the same as those of a single
+# parse_sdm run; this is also the reference for running the shards on separate
+# machines.
+#
+# Usage:
+#   parse_sdm_sharded.sh <shard_count> <output_file_base> [parse_sdm flags...]
+#
+# The shards write their partial outputs to <output_file_base>.shard-<index>.
+# The transforms given in $CPU_INSTRUCTIONS_TRANSFORMS are run by the merge
+# step. Paths must be absolute when the script is started with 'bazel run'.
+
+set -o errexit
+set -o nounset
+set -o pipefail
+
+if [[ $# -lt 2 ]]; then
+  echo "Usage: $0 <shard_count> <output_file_base> [parse_sdm flags...]" >&2
+  exit 1
+fi
+readonly SHARD_COUNT="$1"
+readonly OUTPUT_FILE_BASE="$2"
+shift 2
+
+readonly TOOLS_DIR="${0}.runfiles/__main__/cpu_instructions/tools"
+readonly PARSE_SDM="${PARSE_SDM:-${TOOLS_DIR}/parse_sdm}"
+readonly MERGE_SDM_SHARDS="${MERGE_SDM_SHARDS:-${TOOLS_DIR}/merge_sdm_shards}"
+
+pids=()
+shard_output_bases=()
+for ((shard_index = 0; shard_index < SHARD_COUNT; ++shard_index)); do
+  shard_output_base="${OUTPUT_FILE_BASE}.shard-${shard_index}"
+  shard_output_bases+=("${shard_output_base}")
+  "${PARSE_SDM}" "$@" \
+    --cpu_instructions_output_file_base="${shard_output_base}" \
+    --cpu_instructions_shard_index="${shard_index}" \
+    --cpu_instructions_shard_count="${SHARD_COUNT}" \
+    > "${shard_output_base}.log" 2>&1 &
+  pids+=($!)
+done
+
+failed=0
+for ((shard_index = 0; shard_index < SHARD_COUNT; ++shard_index)); do
+  if ! wait "${pids[${shard_index}]}"; then
+    echo "Shard ${shard_index} failed, see" \
+      "${shard_output_bases[${shard_index}]}.log" >&2
+    failed=1
+  fi
+done
+if [[ "${failed}" -ne 0 ]]; then
+  exit 1
+fi
+
+"${MERGE_SDM_SHARDS}" \
+  --cpu_instructions_shard_output_bases="$(IFS=,; echo "${shard_output_bases[*]}")" \
+  --cpu_instructions_output_file_base="${OUTPUT_FILE_BASE}" \
+  --cpu_instructions_transforms="${CPU_INSTRUCTIONS_TRANSFORMS:-}"
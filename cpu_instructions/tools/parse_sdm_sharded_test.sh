@@ -0,0 +1,54 @@
+#!/bin/bash
+# Copyright 2017 Google Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Checks that parse_sdm_sharded.sh produces the same transformed instruction
+# set as a single parse_sdm run, on the SDM pages of
+# cpu_instructions/x86/pdf/testdata and for several shard counts.
+
+set -o errexit
+set -o nounset
+set -o pipefail
+
+readonly RUNFILES_DIR="${TEST_SRCDIR}/__main__"
+readonly TOOLS_DIR="${RUNFILES_DIR}/cpu_instructions/tools"
+readonly TESTDATA_DIR="${RUNFILES_DIR}/cpu_instructions/x86/pdf/testdata"
+readonly INPUT_PDF="${TESTDATA_DIR}/253666_p170_p171.pdf"
+readonly OUTPUT_DIR="${TEST_TMPDIR}"
+readonly PARSE_SDM_FLAGS=(
+  --cpu_instructions_input_spec="${INPUT_PDF}"
+  --cpu_instructions_telemetry_period_seconds=0
+)
+
+"${TOOLS_DIR}/parse_sdm" "${PARSE_SDM_FLAGS[@]}" \
+  --cpu_instructions_output_file_base="${OUTPUT_DIR}/unsharded"
+readonly EXPECTED="${OUTPUT_DIR}/unsharded_transformed.pbtxt"
+if ! grep -q "^instructions" "${EXPECTED}"; then
+  echo "No instructions were extracted from ${INPUT_PDF}" >&2
+  exit 1
+fi
+
+for shard_count in 2 3; do
+  output_base="${OUTPUT_DIR}/sharded_${shard_count}"
+  PARSE_SDM="${TOOLS_DIR}/parse_sdm" \
+    MERGE_SDM_SHARDS="${TOOLS_DIR}/merge_sdm_shards" \
+    "${TOOLS_DIR}/parse_sdm_sharded.sh" "${shard_count}" "${output_base}" \
+    "${PARSE_SDM_FLAGS[@]}"
+  if ! diff "${EXPECTED}" "${output_base}_transformed.pbtxt"; then
+    echo "The outputs differ with ${shard_count} shards" >&2
+    exit 1
+  fi
+done
+
+echo "PASS"
@@ -0,0 +1,82 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "cpu_instructions/util/background_proto_writer.h"
+
+#include <utility>
+
+#include "cpu_instructions/util/proto_util.h"
+#include "glog/logging.h"
+
+namespace cpu_instructions {
+
+BackgroundProtoWriter::BackgroundProtoWriter()
+    : thread_(&BackgroundProtoWriter::Run, this) {}
+
+BackgroundProtoWriter::~BackgroundProtoWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_ = true;
+  }
+  condition_.notify_all();
+  thread_.join();
+}
+
+void BackgroundProtoWriter::WriteBinaryProto(
+    const string& filename,
+    std::shared_ptr<const google::protobuf::Message> message,
+    const bool compress) {
+  CHECK(message != nullptr);
+  Schedule([filename, message, compress]() {
+    LOG(INFO) << "Writing " << filename;
+    if (compress) {
+      WriteGzipBinaryProtoOrDie(filename, *message);
+    } else {
+      WriteBinaryProtoOrDie(filename, *message);
+    }
+  });
+}
+
+void BackgroundProtoWriter::Schedule(std::function<void()> write) {
+  CHECK(write != nullptr);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(write));
+  }
+  condition_.notify_all();
+}
+
+void BackgroundProtoWriter::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  condition_.wait(lock, [this]() { return tasks_.empty() && !busy_; });
+}
+
+void BackgroundProtoWriter::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    condition_.wait(lock, [this]() { return done_ || !tasks_.empty(); });
+    if (tasks_.empty()) return;  // done_ is set and all tasks are done.
+    const std::function<void()> task = std::move(tasks_.front());
+    tasks_.pop_front();
+    busy_ = true;
+    lock.unlock();
+    task();
+    lock.lock();
+    busy_ = false;
+    condition_.notify_all();
+  }
+}
+
+}  // namespace cpu_instructions
@@ -0,0 +1,70 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Writes protos to files on a background thread, so that producers of large
+// debug protos never block on disk.
+
+#ifndef CPU_INSTRUCTIONS_UTIL_BACKGROUND_PROTO_WRITER_H_
+#define CPU_INSTRUCTIONS_UTIL_BACKGROUND_PROTO_WRITER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "strings/string.h"
+
+#include "src/google/protobuf/message.h"
+
+namespace cpu_instructions {
+
+// Writes are done in the order they were scheduled. Dies if a write fails.
+// Thread safe.
+class BackgroundProtoWriter {
+ public:
+  BackgroundProtoWriter();
+  BackgroundProtoWriter(const BackgroundProtoWriter&) = delete;
+
+  // Waits for all the scheduled writes to finish.
+  ~BackgroundProtoWriter();
+
+  // Schedules writing message in binary format to filename. The message is
+  // shared so that the caller can keep using it while it is written. When
+  // compress is true, the file is gzip compressed.
+  void WriteBinaryProto(const string& filename,
+                        std::shared_ptr<const google::protobuf::Message> message,
+                        bool compress);
+
+  // Schedules a custom write, for files that are not a single proto.
+  void Schedule(std::function<void()> write);
+
+  // Waits until all the writes scheduled so far are done.
+  void Flush();
+
+ private:
+  void Run();
+
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::deque<std::function<void()>> tasks_;  // Guarded by mutex_.
+  bool busy_ = false;                         // Guarded by mutex_.
+  bool done_ = false;                         // Guarded by mutex_.
+  std::thread thread_;
+};
+
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_UTIL_BACKGROUND_PROTO_WRITER_H_
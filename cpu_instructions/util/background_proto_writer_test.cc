@@ -0,0 +1,86 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "cpu_instructions/util/background_proto_writer.h"
+
+#include <zlib.h>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include "strings/string.h"
+
+#include "cpu_instructions/proto/instructions.pb.h"
+#include "cpu_instructions/testing/test_util.h"
+#include "cpu_instructions/util/proto_util.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "strings/str_cat.h"
+
+namespace cpu_instructions {
+namespace {
+
+using ::cpu_instructions::testing::EqualsProto;
+using ::testing::ElementsAre;
+
+// Reads a whole file, uncompressing it if it is gzip compressed.
+string ReadFile(const string& filename) {
+  const gzFile file = gzopen(filename.c_str(), "rb");
+  CHECK(file != nullptr) << "Could not open '" << filename << "'";
+  string data;
+  char buffer[1024];
+  int num_bytes = 0;
+  while ((num_bytes = gzread(file, buffer, sizeof(buffer))) > 0) {
+    data.append(buffer, num_bytes);
+  }
+  gzclose(file);
+  return data;
+}
+
+TEST(BackgroundProtoWriterTest, WriteBinaryProto) {
+  const string base = StrCat(getenv("TEST_TMPDIR"), "/background_writer");
+  const auto add = std::make_shared<const InstructionProto>(
+      ParseProtoFromStringOrDie<InstructionProto>("llvm_mnemonic: 'ADD32mr'"));
+  const auto sub = std::make_shared<const InstructionProto>(
+      ParseProtoFromStringOrDie<InstructionProto>("llvm_mnemonic: 'SUB32mr'"));
+  {
+    BackgroundProtoWriter writer;
+    writer.WriteBinaryProto(StrCat(base, "_add.pb"), add, false);
+    writer.Flush();
+    InstructionProto read_proto;
+    ASSERT_TRUE(read_proto.ParseFromString(ReadFile(StrCat(base, "_add.pb"))));
+    EXPECT_THAT(read_proto, EqualsProto("llvm_mnemonic: 'ADD32mr'"));
+
+    // Not flushed, the destructor waits for the write.
+    writer.WriteBinaryProto(StrCat(base, "_sub.pb.gz"), sub, true);
+  }
+  InstructionProto read_proto;
+  ASSERT_TRUE(
+      read_proto.ParseFromString(ReadFile(StrCat(base, "_sub.pb.gz"))));
+  EXPECT_THAT(read_proto, EqualsProto("llvm_mnemonic: 'SUB32mr'"));
+}
+
+TEST(BackgroundProtoWriterTest, ScheduleRunsInOrder) {
+  std::vector<int> order;
+  {
+    BackgroundProtoWriter writer;
+    for (int i = 0; i < 10; ++i) {
+      writer.Schedule([&order, i]() { order.push_back(i); });
+    }
+  }
+  EXPECT_THAT(order, ElementsAre(0, 1, 2, 3, 4, 5, 6, 7, 8, 9));
+}
+
+}  // namespace
+}  // namespace cpu_instructions
@@ -0,0 +1,55 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// A 64-bit FNV-1a hash. Unlike std::hash, it is stable across compilers and
+// runs, which is required for anything stored on disk.
+
+#ifndef CPU_INSTRUCTIONS_UTIL_FINGERPRINT_H_
+#define CPU_INSTRUCTIONS_UTIL_FINGERPRINT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include "strings/string.h"
+#include "strings/string_view.h"
+
+namespace cpu_instructions {
+
+class Fingerprint {
+ public:
+  // Adds a string. Its size is added too, so that the sequences of strings
+  // {"ab", "c"} and {"a", "bc"} have different fingerprints.
+  void Add(StringPiece data) {
+    AddUint64(data.size());
+    for (size_t i = 0; i < data.size(); ++i) AddByte(data[i]);
+  }
+
+  void AddUint64(uint64_t value) {
+    for (int i = 0; i < 8; ++i) AddByte(value >> (8 * i));
+  }
+
+  uint64_t value() const { return value_; }
+
+ private:
+  void AddByte(uint8_t byte) {
+    value_ ^= byte;
+    value_ *= 0x100000001b3ULL;
+  }
+
+  uint64_t value_ = 0xcbf29ce484222325ULL;
+};
+
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_UTIL_FINGERPRINT_H_
@@ -0,0 +1,50 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "cpu_instructions/util/fingerprint.h"
+
+#include "gtest/gtest.h"
+
+namespace cpu_instructions {
+namespace {
+
+uint64_t GetFingerprint(const string& first, const string& second) {
+  Fingerprint fingerprint;
+  fingerprint.Add(first);
+  fingerprint.Add(second);
+  return fingerprint.value();
+}
+
+TEST(FingerprintTest, IsStable) {
+  // The value must not change, fingerprints are stored on disk.
+  EXPECT_EQ(Fingerprint().value(), 0xcbf29ce484222325ULL);
+  EXPECT_EQ(GetFingerprint("ab", "c"), GetFingerprint("ab", "c"));
+}
+
+TEST(FingerprintTest, SeparatesStrings) {
+  EXPECT_NE(GetFingerprint("ab", "c"), GetFingerprint("a", "bc"));
+  EXPECT_NE(GetFingerprint("", "a"), GetFingerprint("a", ""));
+}
+
+TEST(FingerprintTest, AddUint64) {
+  Fingerprint first;
+  first.AddUint64(1);
+  Fingerprint second;
+  second.AddUint64(2);
+  EXPECT_NE(first.value(), second.value());
+}
+
+}  // namespace
+}  // namespace cpu_instructions
@@ -0,0 +1,134 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A queue of values processed on a thread pool and handed over in the order
+// they were added.
+
+#ifndef CPU_INSTRUCTIONS_UTIL_ORDERED_WORK_QUEUE_H_
+#define CPU_INSTRUCTIONS_UTIL_ORDERED_WORK_QUEUE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "cpu_instructions/util/thread_pool.h"
+#include "glog/logging.h"
+
+namespace cpu_instructions {
+
+// Each value is added with an optional task, which runs on the pool. Values
+// are consumed by Flush in the order they were added, once their task is done,
+// whatever the order in which the tasks finish. Add blocks while too many
+// tasks are not done, which bounds the memory used when values are added
+// faster than they are processed.
+// Add and Flush may be called from different threads.
+template <typename T>
+class OrderedWorkQueue {
+ public:
+  typedef std::function<void(T*)> Task;
+
+  // Does not acquire ownership of pool. max_unfinished_tasks must be positive.
+  OrderedWorkQueue(ThreadPool* pool, int max_unfinished_tasks)
+      : pool_(CHECK_NOTNULL(pool)),
+        max_unfinished_tasks_(max_unfinished_tasks) {
+    CHECK_GT(max_unfinished_tasks_, 0);
+  }
+  OrderedWorkQueue(const OrderedWorkQueue&) = delete;
+
+  // Waits for the tasks that are still running. Values that were not flushed
+  // are dropped.
+  ~OrderedWorkQueue() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this]() { return num_unfinished_tasks_ == 0; });
+  }
+
+  // Queues value, and schedules task on it if it is set. Values without a task
+  // are done right away. When task is set, first blocks until fewer than
+  // max_unfinished_tasks tasks are not done.
+  void Add(std::unique_ptr<T> value, Task task);
+
+  // Calls consume on the values that are done at the front of the queue, in
+  // the order they were added, and removes them. If wait is true, waits until
+  // all the values are done and consumes them all. consume runs with the queue
+  // locked, and must not call it.
+  void Flush(bool wait, const std::function<void(T*)>& consume);
+
+  // The number of tasks that are scheduled or running.
+  int num_unfinished_tasks() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return num_unfinished_tasks_;
+  }
+
+ private:
+  struct Entry {
+    std::unique_ptr<T> value;
+    bool done = false;  // Guarded by mutex_.
+  };
+
+  ThreadPool* const pool_;
+  const int max_unfinished_tasks_;
+  mutable std::mutex mutex_;
+  std::condition_variable condition_;
+  // The values, in the order they were added. Guarded by mutex_.
+  std::deque<std::unique_ptr<Entry>> entries_;
+  int num_unfinished_tasks_ = 0;  // Guarded by mutex_.
+};
+
+template <typename T>
+void OrderedWorkQueue<T>::Add(std::unique_ptr<T> value, Task task) {
+  std::unique_ptr<Entry> entry(new Entry());
+  entry->value = std::move(value);
+  Entry* const entry_ptr = entry.get();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (task) {
+      condition_.wait(lock, [this]() {
+        return num_unfinished_tasks_ < max_unfinished_tasks_;
+      });
+      ++num_unfinished_tasks_;
+    }
+    entry->done = !task;
+    entries_.push_back(std::move(entry));
+  }
+  if (!task) return;
+  // Entries are owned by entries_, and are only removed once they are done.
+  pool_->Schedule([this, entry_ptr, task]() {
+    task(entry_ptr->value.get());
+    // Notifies with the lock held: once the last task is done, the destructor
+    // may run as soon as the lock is released.
+    std::lock_guard<std::mutex> lock(mutex_);
+    entry_ptr->done = true;
+    --num_unfinished_tasks_;
+    condition_.notify_all();
+  });
+}
+
+template <typename T>
+void OrderedWorkQueue<T>::Flush(bool wait,
+                                const std::function<void(T*)>& consume) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!entries_.empty()) {
+    if (!wait && !entries_.front()->done) return;
+    condition_.wait(lock, [this]() { return entries_.front()->done; });
+    consume(entries_.front()->value.get());
+    entries_.pop_front();
+  }
+}
+
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_UTIL_ORDERED_WORK_QUEUE_H_
@@ -0,0 +1,152 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/ordered_work_queue.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace cpu_instructions {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+// Blocks the tasks that wait on it until it is opened.
+class Gate {
+ public:
+  void Open() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      open_ = true;
+    }
+    condition_.notify_all();
+  }
+
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this]() { return open_; });
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  bool open_ = false;
+};
+
+std::unique_ptr<int> MakeValue(int value) {
+  return std::unique_ptr<int>(new int(value));
+}
+
+TEST(OrderedWorkQueueTest, ValuesAreConsumedInOrder) {
+  constexpr int kNumValues = 200;
+  constexpr int kMaxUnfinishedTasks = 8;
+  ThreadPool pool(4);
+  OrderedWorkQueue<int> queue(&pool, kMaxUnfinishedTasks);
+  std::vector<int> consumed;
+  const auto consume = [&consumed](int* value) { consumed.push_back(*value); };
+  for (int i = 0; i < kNumValues; ++i) {
+    // Every third value has no task, like the pages read from a cache. The
+    // tasks take different times, so they finish out of order.
+    OrderedWorkQueue<int>::Task task;
+    if (i % 3 != 0) {
+      task = [i](int* value) {
+        std::this_thread::sleep_for(std::chrono::microseconds(37 * (i % 7)));
+        *value *= 2;
+      };
+    }
+    queue.Add(MakeValue(i), task);
+    EXPECT_LE(queue.num_unfinished_tasks(), kMaxUnfinishedTasks);
+    queue.Flush(/* wait= */ false, consume);
+  }
+  queue.Flush(/* wait= */ true, consume);
+  EXPECT_EQ(queue.num_unfinished_tasks(), 0);
+  std::vector<int> expected;
+  for (int i = 0; i < kNumValues; ++i) expected.push_back(i % 3 ? 2 * i : i);
+  EXPECT_EQ(consumed, expected);
+}
+
+TEST(OrderedWorkQueueTest, FlushStopsAtTheFirstValueThatIsNotDone) {
+  ThreadPool pool(2);
+  OrderedWorkQueue<int> queue(&pool, 4);
+  Gate gate;
+  std::vector<int> consumed;
+  const auto consume = [&consumed](int* value) { consumed.push_back(*value); };
+  queue.Add(MakeValue(1), OrderedWorkQueue<int>::Task());
+  queue.Add(MakeValue(2), [&gate](int*) { gate.Wait(); });
+  queue.Add(MakeValue(3), OrderedWorkQueue<int>::Task());
+  queue.Add(MakeValue(4), [](int*) {});
+  queue.Flush(/* wait= */ false, consume);
+  EXPECT_THAT(consumed, ElementsAre(1));
+  gate.Open();
+  queue.Flush(/* wait= */ true, consume);
+  EXPECT_THAT(consumed, ElementsAre(1, 2, 3, 4));
+}
+
+TEST(OrderedWorkQueueTest, AddBlocksWhileTooManyTasksAreNotDone) {
+  constexpr int kMaxUnfinishedTasks = 2;
+  ThreadPool pool(kMaxUnfinishedTasks);
+  OrderedWorkQueue<int> queue(&pool, kMaxUnfinishedTasks);
+  Gate gate;
+  const auto blocked_task = [&gate](int*) { gate.Wait(); };
+  for (int i = 0; i < kMaxUnfinishedTasks; ++i) {
+    queue.Add(MakeValue(i), blocked_task);
+  }
+  EXPECT_EQ(queue.num_unfinished_tasks(), kMaxUnfinishedTasks);
+  // Values without a task are never blocked.
+  queue.Add(MakeValue(kMaxUnfinishedTasks), OrderedWorkQueue<int>::Task());
+  std::atomic<bool> added(false);
+  std::thread adder([&queue, &added]() {
+    queue.Add(MakeValue(kMaxUnfinishedTasks + 1), [](int*) {});
+    added = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(added);
+  gate.Open();
+  adder.join();
+  EXPECT_TRUE(added);
+  std::vector<int> consumed;
+  queue.Flush(/* wait= */ true,
+              [&consumed](int* value) { consumed.push_back(*value); });
+  EXPECT_THAT(consumed, ElementsAre(0, 1, 2, 3));
+  queue.Flush(/* wait= */ true,
+              [&consumed](int* value) { consumed.push_back(*value); });
+  EXPECT_THAT(consumed, ElementsAre(0, 1, 2, 3));
+}
+
+TEST(OrderedWorkQueueTest, DestructorWaitsForRunningTasks) {
+  ThreadPool pool(2);
+  std::atomic<int> num_done(0);
+  {
+    OrderedWorkQueue<int> queue(&pool, 4);
+    for (int i = 0; i < 4; ++i) {
+      queue.Add(MakeValue(i), [&num_done](int*) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        ++num_done;
+      });
+    }
+  }
+  EXPECT_EQ(num_done, 4);
+}
+
+}  // namespace
+}  // namespace cpu_instructions
@@ -0,0 +1,85 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/parallel_for.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "glog/logging.h"
+
+namespace cpu_instructions {
+
+int GetNumParallelForWorkers(size_t num_items, int num_threads) {
+  if (num_items == 0) return 0;
+  return static_cast<int>(
+      std::min<size_t>(num_items, std::max(num_threads, 1)));
+}
+
+void ParallelFor(size_t num_items, int num_threads,
+                 const std::function<void(int, size_t)>& function) {
+  const int num_workers = GetNumParallelForWorkers(num_items, num_threads);
+  if (num_workers <= 1) {
+    for (size_t i = 0; i < num_items; ++i) function(0, i);
+    return;
+  }
+  std::atomic<size_t> next_item(0);
+  const auto worker = [&next_item, num_items, &function](int worker_index) {
+    for (size_t i = next_item++; i < num_items; i = next_item++) {
+      function(worker_index, i);
+    }
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(num_workers - 1);
+  for (int i = 1; i < num_workers; ++i) threads.emplace_back(worker, i);
+  worker(0);
+  for (auto& thread : threads) thread.join();
+}
+
+void OrderedParallelFor(size_t num_items, int num_threads,
+                        size_t max_pending_items,
+                        const std::function<void(int, size_t)>& function,
+                        const std::function<void(size_t)>& merge) {
+  CHECK_GT(max_pending_items, 0);
+  std::mutex mutex;
+  std::condition_variable merged;
+  std::vector<bool> done(num_items, false);  // Guarded by mutex.
+  size_t num_merged_items = 0;               // Guarded by mutex.
+  // ParallelFor hands out the items in increasing order, so the first item that
+  // is not merged is always started, and waiting can not deadlock.
+  ParallelFor(num_items, num_threads, [&](int worker, size_t item) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      merged.wait(lock, [&]() {
+        return item < num_merged_items + max_pending_items;
+      });
+    }
+    function(worker, item);
+    std::lock_guard<std::mutex> lock(mutex);
+    done[item] = true;
+    const size_t num_previously_merged_items = num_merged_items;
+    for (; num_merged_items < num_items && done[num_merged_items];
+         ++num_merged_items) {
+      merge(num_merged_items);
+    }
+    if (num_merged_items > num_previously_merged_items) merged.notify_all();
+  });
+  CHECK_EQ(num_merged_items, num_items);
+}
+
+}  // namespace cpu_instructions
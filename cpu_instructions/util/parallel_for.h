@@ -0,0 +1,50 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A minimal helper to spread independent work items over several threads.
+
+#ifndef CPU_INSTRUCTIONS_UTIL_PARALLEL_FOR_H_
+#define CPU_INSTRUCTIONS_UTIL_PARALLEL_FOR_H_
+
+#include <cstddef>
+#include <functional>
+
+namespace cpu_instructions {
+
+// Calls 'function(worker_index, item_index)' for every item_index in
+// [0, num_items). Items are handed out dynamically to at most 'num_threads'
+// workers, each worker processes its items in increasing order. worker_index
+// is in [0, num_workers) and can be used to index per-worker state. When
+// num_threads <= 1, everything runs on the calling thread with worker_index 0.
+// Returns when all items have been processed.
+void ParallelFor(size_t num_items, int num_threads,
+                 const std::function<void(int, size_t)>& function);
+
+// Same as ParallelFor, and calls 'merge(item_index)' for every item in
+// increasing order, as soon as the item and all the items before it are
+// processed. The calls to merge are serialized. An item is only started when it
+// is less than max_pending_items after the first item that is not merged yet:
+// when an item is slow, this bounds the number of processed items waiting to be
+// merged, and the memory they hold. max_pending_items must be positive.
+void OrderedParallelFor(size_t num_items, int num_threads,
+                        size_t max_pending_items,
+                        const std::function<void(int, size_t)>& function,
+                        const std::function<void(size_t)>& merge);
+
+// Returns the number of workers ParallelFor uses for the given arguments.
+int GetNumParallelForWorkers(size_t num_items, int num_threads);
+
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_UTIL_PARALLEL_FOR_H_
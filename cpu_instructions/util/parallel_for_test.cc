@@ -0,0 +1,126 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/parallel_for.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace cpu_instructions {
+namespace {
+
+using ::testing::Each;
+using ::testing::Eq;
+
+TEST(ParallelForTest, NoItems) {
+  int num_calls = 0;
+  ParallelFor(0, 4, [&num_calls](int, size_t) { ++num_calls; });
+  EXPECT_EQ(num_calls, 0);
+}
+
+TEST(ParallelForTest, SingleThreadRunsInOrder) {
+  std::vector<size_t> items;
+  ParallelFor(5, 1, [&items](int worker, size_t item) {
+    EXPECT_EQ(worker, 0);
+    items.push_back(item);
+  });
+  EXPECT_THAT(items, ::testing::ElementsAre(0, 1, 2, 3, 4));
+}
+
+TEST(ParallelForTest, EachItemIsProcessedOnce) {
+  const size_t num_items = 1000;
+  const int num_threads = 8;
+  std::vector<std::atomic<int>> counts(num_items);
+  std::atomic<bool> valid_workers(true);
+  ParallelFor(num_items, num_threads,
+              [&counts, &valid_workers, num_threads](int worker, size_t item) {
+                if (worker < 0 || worker >= num_threads) valid_workers = false;
+                ++counts[item];
+              });
+  EXPECT_TRUE(valid_workers);
+  std::vector<int> plain_counts;
+  for (const auto& count : counts) plain_counts.push_back(count);
+  EXPECT_THAT(plain_counts, Each(Eq(1)));
+}
+
+TEST(OrderedParallelForTest, MergesInOrder) {
+  const size_t num_items = 200;
+  std::vector<int> processed(num_items, 0);
+  std::vector<size_t> merged;
+  OrderedParallelFor(num_items, 8, 16,
+                     [&processed](int, size_t item) {
+                       // Makes the items finish out of order.
+                       std::this_thread::sleep_for(
+                           std::chrono::microseconds(31 * (item % 5)));
+                       processed[item] = 1;
+                     },
+                     [&processed, &merged](size_t item) {
+                       EXPECT_EQ(processed[item], 1);
+                       merged.push_back(item);
+                     });
+  ASSERT_EQ(merged.size(), num_items);
+  for (size_t i = 0; i < num_items; ++i) EXPECT_EQ(merged[i], i);
+}
+
+TEST(OrderedParallelForTest, BoundsThePendingItems) {
+  const size_t num_items = 100;
+  const size_t max_pending_items = 6;
+  std::mutex mutex;
+  size_t num_merged_items = 0;        // Guarded by mutex.
+  size_t max_started_item = 0;        // Guarded by mutex.
+  size_t max_started_while_slow = 0;  // Guarded by mutex.
+  bool bound_respected = true;        // Guarded by mutex.
+  OrderedParallelFor(
+      num_items, 4, max_pending_items,
+      [&](int, size_t item) {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (item >= num_merged_items + max_pending_items) {
+            bound_respected = false;
+          }
+          max_started_item = std::max(max_started_item, item);
+        }
+        if (item != 0) return;
+        // While the first item is slow, the other workers only process the
+        // items up to the bound, then wait.
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::lock_guard<std::mutex> lock(mutex);
+        max_started_while_slow = max_started_item;
+      },
+      [&](size_t item) {
+        std::lock_guard<std::mutex> lock(mutex);
+        EXPECT_EQ(item, num_merged_items);
+        ++num_merged_items;
+      });
+  EXPECT_TRUE(bound_respected);
+  EXPECT_EQ(max_started_while_slow, max_pending_items - 1);
+  EXPECT_EQ(num_merged_items, num_items);
+}
+
+TEST(ParallelForTest, GetNumParallelForWorkers) {
+  EXPECT_EQ(GetNumParallelForWorkers(0, 4), 0);
+  EXPECT_EQ(GetNumParallelForWorkers(2, 4), 2);
+  EXPECT_EQ(GetNumParallelForWorkers(10, 4), 4);
+  EXPECT_EQ(GetNumParallelForWorkers(10, 0), 1);
+}
+
+}  // namespace
+}  // namespace cpu_instructions
@@ -14,12 +14,34 @@
 
 #include "cpu_instructions/util/proto_util.h"
 
+#include <zlib.h>
+
 #include "glog/logging.h"
 #include "src/google/protobuf/io/zero_copy_stream_impl.h"
+#include "src/google/protobuf/io/zero_copy_stream_impl_lite.h"
 #include "src/google/protobuf/text_format.h"
 
 namespace cpu_instructions {
 
+namespace {
+
+// Writes to a gzip compressed file. The protobuf library is built without
+// zlib, so google::protobuf::io::GzipOutputStream is not available.
+class GzipFileOutputStream
+    : public google::protobuf::io::CopyingOutputStream {
+ public:
+  explicit GzipFileOutputStream(gzFile file) : file_(file) {}
+
+  bool Write(const void* buffer, int size) override {
+    return gzwrite(file_, buffer, size) == size;
+  }
+
+ private:
+  const gzFile file_;
+};
+
+}  // namespace
+
 void ReadTextProtoOrDie(const string& filename,
                         google::protobuf::Message* message) {
   CHECK(!filename.empty());
@@ -39,6 +61,24 @@ void ParseProtoFromStringOrDie(const string& text,
   CHECK(google::protobuf::TextFormat::ParseFromString(text, message));
 }
 
+void ReadBinaryProtoOrDie(const string& filename,
+                          google::protobuf::Message* message) {
+  CHECK(!filename.empty());
+  // gzread reads files that are not compressed as they are.
+  const gzFile input_file = gzopen(filename.c_str(), "rb");
+  CHECK(input_file) << "Could not open '" << filename << "'";
+  string data;
+  char buffer[64 * 1024];
+  int num_bytes = 0;
+  while ((num_bytes = gzread(input_file, buffer, sizeof(buffer))) > 0) {
+    data.append(buffer, num_bytes);
+  }
+  CHECK_EQ(num_bytes, 0) << "Could not read '" << filename << "'";
+  gzclose(input_file);
+  CHECK(message->ParseFromString(data))
+      << "Could not parse binary protobuf from file '" << filename << "'";
+}
+
 void WriteTextProtoOrDie(const string& filename,
                          const google::protobuf::Message& message) {
   CHECK(!filename.empty());
@@ -60,4 +100,20 @@ void WriteBinaryProtoOrDie(const string& filename,
   fclose(output_file);
 }
 
+void WriteGzipBinaryProtoOrDie(const string& filename,
+                               const google::protobuf::Message& message) {
+  CHECK(!filename.empty());
+  const gzFile output_file = gzopen(filename.c_str(), "wb");
+  CHECK(output_file) << "Could not open '" << filename << "'";
+  {
+    GzipFileOutputStream gzip_stream(output_file);
+    google::protobuf::io::CopyingOutputStreamAdaptor output_stream(
+        &gzip_stream);
+    CHECK(message.SerializeToZeroCopyStream(&output_stream));
+    CHECK(output_stream.Flush()) << "Could not write '" << filename << "'";
+  }
+  CHECK_EQ(gzclose(output_file), Z_OK) << "Could not write '" << filename
+                                       << "'";
+}
+
 }  // namespace cpu_instructions
@@ -45,6 +45,19 @@ Proto ParseProtoFromStringOrDie(const string& text) {
   return proto;
 }
 
+// Reads a proto in binary format from a file. The file may be gzip compressed,
+// e.g. by WriteGzipBinaryProtoOrDie.
+void ReadBinaryProtoOrDie(const string& filename,
+                          google::protobuf::Message* message);
+
+// Typed version of the above.
+template <typename Proto>
+Proto ReadBinaryProtoOrDie(const string& filename) {
+  Proto proto;
+  ReadBinaryProtoOrDie(filename, &proto);
+  return proto;
+}
+
 // Writes a proto in text format to a file.
 void WriteTextProtoOrDie(const string& filename,
                          const google::protobuf::Message& message);
@@ -53,6 +66,10 @@ void WriteTextProtoOrDie(const string& filename,
 void WriteBinaryProtoOrDie(const string& filename,
                            const google::protobuf::Message& message);
 
+// Writes a proto in binary format to a gzip compressed file.
+void WriteGzipBinaryProtoOrDie(const string& filename,
+                               const google::protobuf::Message& message);
+
 }  // namespace cpu_instructions
 
 #endif  // CPU_INSTRUCTIONS_UTIL_PROTO_UTIL_H_
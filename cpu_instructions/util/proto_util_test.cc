@@ -14,6 +14,7 @@
 
 #include "cpu_instructions/util/proto_util.h"
 
+#include <zlib.h>
 #include <cstdio>
 #include "strings/string.h"
 
@@ -42,6 +43,38 @@ TEST(ProtoUtilTest, ReadWriteTextProtoOrDie) {
   EXPECT_THAT(read_proto, EqualsProto(kExpected));
 }
 
+TEST(ProtoUtilTest, WriteGzipBinaryProtoOrDie) {
+  const InstructionProto proto =
+      ParseProtoFromStringOrDie<InstructionProto>("llvm_mnemonic: 'ADD32mr'");
+  const string filename = StrCat(getenv("TEST_TMPDIR"), "/test.pb.gz");
+  WriteGzipBinaryProtoOrDie(filename, proto);
+  const gzFile input_file = gzopen(filename.c_str(), "rb");
+  ASSERT_TRUE(input_file != nullptr);
+  string data;
+  char buffer[1024];
+  int num_bytes = 0;
+  while ((num_bytes = gzread(input_file, buffer, sizeof(buffer))) > 0) {
+    data.append(buffer, num_bytes);
+  }
+  gzclose(input_file);
+  InstructionProto read_proto;
+  ASSERT_TRUE(read_proto.ParseFromString(data));
+  EXPECT_THAT(read_proto, EqualsProto("llvm_mnemonic: 'ADD32mr'"));
+}
+
+TEST(ProtoUtilTest, ReadBinaryProtoOrDie) {
+  const InstructionProto proto =
+      ParseProtoFromStringOrDie<InstructionProto>("llvm_mnemonic: 'ADD32mr'");
+  const string filename = StrCat(getenv("TEST_TMPDIR"), "/read_test.pb");
+  WriteBinaryProtoOrDie(filename, proto);
+  EXPECT_THAT(ReadBinaryProtoOrDie<InstructionProto>(filename),
+              EqualsProto("llvm_mnemonic: 'ADD32mr'"));
+  const string gzip_filename = StrCat(filename, ".gz");
+  WriteGzipBinaryProtoOrDie(gzip_filename, proto);
+  EXPECT_THAT(ReadBinaryProtoOrDie<InstructionProto>(gzip_filename),
+              EqualsProto("llvm_mnemonic: 'ADD32mr'"));
+}
+
 TEST(ProtoUtilTest, ParseProtoFromStringOrDie) {
   EXPECT_THAT(
       ParseProtoFromStringOrDie<InstructionProto>("llvm_mnemonic: 'ADD32mr'"),
@@ -0,0 +1,201 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "cpu_instructions/util/telemetry.h"
+
+#include <sys/resource.h>
+#include <algorithm>
+#include <unordered_map>
+
+#include "glog/logging.h"
+
+namespace cpu_instructions {
+
+namespace {
+
+double GetRate(double amount, double seconds) {
+  return seconds > 0.0 ? amount / seconds : 0.0;
+}
+
+}  // namespace
+
+void Telemetry::ActiveTime::Add(std::chrono::steady_clock::time_point start,
+                                std::chrono::steady_clock::time_point end) {
+  if (empty) {
+    first_start = start;
+    last_end = end;
+    empty = false;
+    return;
+  }
+  first_start = std::min(first_start, start);
+  last_end = std::max(last_end, end);
+}
+
+double Telemetry::ActiveTime::GetSeconds() const {
+  if (empty) return 0.0;
+  return std::chrono::duration<double>(last_end - first_start).count();
+}
+
+Telemetry::Telemetry() : start_time_(std::chrono::steady_clock::now()) {}
+
+Telemetry* Telemetry::Get() {
+  static Telemetry* const telemetry = new Telemetry();
+  return telemetry;
+}
+
+void Telemetry::RecordStage(const string& stage, const double seconds) {
+  const auto end = std::chrono::steady_clock::now();
+  const auto start =
+      end - std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(seconds));
+  std::lock_guard<std::mutex> lock(mutex_);
+  StageMetrics& metrics = stages_[stage];
+  ++metrics.count;
+  metrics.total_seconds += seconds;
+  metrics.max_seconds = std::max(metrics.max_seconds, seconds);
+  metrics.active_time.Add(start, end);
+}
+
+void Telemetry::AddToCounter(
+    const string& name, const int64_t value,
+    const std::chrono::steady_clock::time_point start_time) {
+  const auto end = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(mutex_);
+  CounterMetrics& metrics = counters_[name];
+  metrics.value += value;
+  metrics.active_time.Add(start_time, end);
+}
+
+TelemetryReport Telemetry::GetReport() const {
+  TelemetryReport report;
+  report.set_wall_time_seconds(GetSecondsSince(start_time_));
+  report.set_peak_rss_kilobytes(GetPeakRssKilobytes());
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& name_and_metrics : stages_) {
+    const StageMetrics& metrics = name_and_metrics.second;
+    TelemetryReport::Stage* const stage = report.add_stages();
+    stage->set_name(name_and_metrics.first);
+    stage->set_count(metrics.count);
+    stage->set_total_seconds(metrics.total_seconds);
+    stage->set_max_seconds(metrics.max_seconds);
+    stage->set_active_seconds(metrics.active_time.GetSeconds());
+    stage->set_count_per_second(
+        GetRate(metrics.count, stage->active_seconds()));
+  }
+  for (const auto& name_and_metrics : counters_) {
+    const CounterMetrics& metrics = name_and_metrics.second;
+    TelemetryReport::Counter* const counter = report.add_counters();
+    counter->set_name(name_and_metrics.first);
+    counter->set_value(metrics.value);
+    counter->set_active_seconds(metrics.active_time.GetSeconds());
+    counter->set_value_per_second(
+        GetRate(metrics.value, counter->active_seconds()));
+  }
+  return report;
+}
+
+void Telemetry::LogReport() const {
+  const TelemetryReport report = GetReport();
+  LOG(INFO) << "Telemetry: " << report.wall_time_seconds() << " s, peak RSS "
+            << report.peak_rss_kilobytes() / 1024 << " MB";
+  for (const TelemetryReport::Stage& stage : report.stages()) {
+    const double average_milliseconds =
+        stage.count() > 0 ? stage.total_seconds() * 1000.0 / stage.count()
+                          : 0.0;
+    LOG(INFO) << "  " << stage.name() << ": " << stage.count() << " in "
+              << stage.total_seconds() << " s (" << stage.count_per_second()
+              << "/s, " << average_milliseconds << " ms each, max "
+              << stage.max_seconds() * 1000.0 << " ms)";
+  }
+  for (const TelemetryReport::Counter& counter : report.counters()) {
+    LOG(INFO) << "  " << counter.name() << ": " << counter.value() << " ("
+              << counter.value_per_second() << "/s)";
+  }
+}
+
+TelemetryReport Telemetry::LogReportSince(
+    const TelemetryReport& previous) const {
+  TelemetryReport report = GetReport();
+  const double period_seconds =
+      report.wall_time_seconds() - previous.wall_time_seconds();
+  std::unordered_map<string, int64_t> previous_counts;
+  for (const TelemetryReport::Stage& stage : previous.stages()) {
+    previous_counts[stage.name()] = stage.count();
+  }
+  std::unordered_map<string, int64_t> previous_values;
+  for (const TelemetryReport::Counter& counter : previous.counters()) {
+    previous_values[counter.name()] = counter.value();
+  }
+  LOG(INFO) << "Telemetry: " << report.wall_time_seconds()
+            << " s, last " << period_seconds << " s, peak RSS "
+            << report.peak_rss_kilobytes() / 1024 << " MB";
+  for (const TelemetryReport::Stage& stage : report.stages()) {
+    const int64_t count = stage.count() - previous_counts[stage.name()];
+    if (count == 0) continue;
+    LOG(INFO) << "  " << stage.name() << ": " << count << " ("
+              << GetRate(count, period_seconds) << "/s), " << stage.count()
+              << " in total";
+  }
+  for (const TelemetryReport::Counter& counter : report.counters()) {
+    const int64_t value = counter.value() - previous_values[counter.name()];
+    if (value == 0) continue;
+    LOG(INFO) << "  " << counter.name() << ": " << value << " ("
+              << GetRate(value, period_seconds) << "/s), " << counter.value()
+              << " in total";
+  }
+  return report;
+}
+
+ScopedStageTimer::ScopedStageTimer(const char* stage)
+    : stage_(stage), start_time_(std::chrono::steady_clock::now()) {}
+
+ScopedStageTimer::~ScopedStageTimer() {
+  Telemetry::Get()->RecordStage(stage_, GetSecondsSince(start_time_));
+}
+
+PeriodicTelemetryLogger::PeriodicTelemetryLogger(std::chrono::seconds period)
+    : period_(period), thread_(&PeriodicTelemetryLogger::Run, this) {}
+
+PeriodicTelemetryLogger::~PeriodicTelemetryLogger() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_ = true;
+  }
+  condition_.notify_all();
+  thread_.join();
+}
+
+void PeriodicTelemetryLogger::Run() {
+  Telemetry* const telemetry = Telemetry::Get();
+  TelemetryReport previous = telemetry->GetReport();
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!condition_.wait_for(lock, period_, [this]() { return done_; })) {
+    previous = telemetry->LogReportSince(previous);
+  }
+}
+
+double GetSecondsSince(std::chrono::steady_clock::time_point start_time) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start_time)
+      .count();
+}
+
+int64_t GetPeakRssKilobytes() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+  return usage.ru_maxrss;  // In kilobytes on Linux.
+}
+
+}  // namespace cpu_instructions
@@ -0,0 +1,139 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Process-wide metrics of the stages of a run: how many items each stage
+// processed, how long it took, and the amount of data processed. They can be
+// logged periodically while the run progresses and summarized in a
+// TelemetryReport at the end. Rates are computed over the time each stage or
+// counter was active, not over the whole run, so that e.g. the pages per
+// second of the parsing are not diluted by the setup and the transforms.
+
+#ifndef CPU_INSTRUCTIONS_UTIL_TELEMETRY_H_
+#define CPU_INSTRUCTIONS_UTIL_TELEMETRY_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+#include "strings/string.h"
+
+#include "cpu_instructions/proto/telemetry.pb.h"
+
+namespace cpu_instructions {
+
+// This class is thread-safe.
+class Telemetry {
+ public:
+  Telemetry();
+  Telemetry(const Telemetry&) = delete;
+
+  // Returns the process-wide instance.
+  static Telemetry* Get();
+
+  // Records one execution of 'stage' that took 'seconds' and just ended.
+  void RecordStage(const string& stage, double seconds);
+
+  // Adds 'value' to the counter 'name'. The value was produced by work that
+  // started at 'start_time', and ended now.
+  void AddToCounter(const string& name, int64_t value,
+                    std::chrono::steady_clock::time_point start_time);
+  void AddToCounter(const string& name, int64_t value) {
+    AddToCounter(name, value, std::chrono::steady_clock::now());
+  }
+
+  // Returns the metrics recorded since the construction of this object.
+  TelemetryReport GetReport() const;
+
+  // Logs a summary of the report, one line per stage and counter.
+  void LogReport() const;
+
+  // Logs the work done since 'previous', a report returned by GetReport or by
+  // this function, with the rates over the time between the two reports.
+  // Returns the current report.
+  TelemetryReport LogReportSince(const TelemetryReport& previous) const;
+
+ private:
+  // The time range during which a stage or counter was active.
+  struct ActiveTime {
+    void Add(std::chrono::steady_clock::time_point start,
+             std::chrono::steady_clock::time_point end);
+    double GetSeconds() const;
+
+    bool empty = true;
+    std::chrono::steady_clock::time_point first_start;
+    std::chrono::steady_clock::time_point last_end;
+  };
+
+  struct StageMetrics {
+    int64_t count = 0;
+    double total_seconds = 0.0;
+    double max_seconds = 0.0;
+    ActiveTime active_time;
+  };
+
+  struct CounterMetrics {
+    int64_t value = 0;
+    ActiveTime active_time;
+  };
+
+  const std::chrono::steady_clock::time_point start_time_;
+  mutable std::mutex mutex_;
+  std::map<string, StageMetrics> stages_;      // Guarded by mutex_.
+  std::map<string, CounterMetrics> counters_;  // Guarded by mutex_.
+};
+
+// Records the time between its construction and its destruction as one
+// execution of 'stage' in the process-wide Telemetry.
+class ScopedStageTimer {
+ public:
+  explicit ScopedStageTimer(const char* stage);
+  ScopedStageTimer(const ScopedStageTimer&) = delete;
+  ~ScopedStageTimer();
+
+ private:
+  const char* const stage_;
+  const std::chrono::steady_clock::time_point start_time_;
+};
+
+// Logs the work done by the process-wide Telemetry during each 'period', with
+// the rates over that period, on a background thread, for as long as it is
+// alive.
+class PeriodicTelemetryLogger {
+ public:
+  explicit PeriodicTelemetryLogger(std::chrono::seconds period);
+  PeriodicTelemetryLogger(const PeriodicTelemetryLogger&) = delete;
+  ~PeriodicTelemetryLogger();
+
+ private:
+  void Run();
+
+  const std::chrono::seconds period_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  bool done_ = false;  // Guarded by mutex_.
+  std::thread thread_;
+};
+
+// Returns the time elapsed since start_time, in seconds.
+double GetSecondsSince(std::chrono::steady_clock::time_point start_time);
+
+// Returns the peak resident set size of the process, in kilobytes.
+int64_t GetPeakRssKilobytes();
+
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_UTIL_TELEMETRY_H_
@@ -0,0 +1,97 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "cpu_instructions/util/telemetry.h"
+
+#include <chrono>
+
+#include "gtest/gtest.h"
+
+namespace cpu_instructions {
+namespace {
+
+TEST(TelemetryTest, GetReport) {
+  Telemetry telemetry;
+  telemetry.RecordStage("parse_page", 2.0);
+  telemetry.RecordStage("parse_page", 1.0);
+  telemetry.RecordStage("cluster_page", 0.5);
+  telemetry.AddToCounter("characters", 100);
+  telemetry.AddToCounter("characters", 20);
+
+  const TelemetryReport report = telemetry.GetReport();
+  EXPECT_GT(report.wall_time_seconds(), 0.0);
+  EXPECT_GT(report.peak_rss_kilobytes(), 0);
+  ASSERT_EQ(report.stages_size(), 2);
+  EXPECT_EQ(report.stages(0).name(), "cluster_page");
+  EXPECT_EQ(report.stages(0).count(), 1);
+  EXPECT_EQ(report.stages(1).name(), "parse_page");
+  EXPECT_EQ(report.stages(1).count(), 2);
+  EXPECT_DOUBLE_EQ(report.stages(1).total_seconds(), 3.0);
+  EXPECT_DOUBLE_EQ(report.stages(1).max_seconds(), 2.0);
+  // The first execution started two seconds before the last one ended.
+  EXPECT_NEAR(report.stages(1).active_seconds(), 2.0, 0.5);
+  EXPECT_NEAR(report.stages(1).count_per_second(), 1.0, 0.25);
+  ASSERT_EQ(report.counters_size(), 1);
+  EXPECT_EQ(report.counters(0).name(), "characters");
+  EXPECT_EQ(report.counters(0).value(), 120);
+}
+
+TEST(TelemetryTest, CounterRateIsOverItsActiveTime) {
+  Telemetry telemetry;
+  const auto start_time =
+      std::chrono::steady_clock::now() - std::chrono::seconds(4);
+  telemetry.AddToCounter("characters", 300, start_time);
+  telemetry.AddToCounter("characters", 100, start_time);
+  const TelemetryReport report = telemetry.GetReport();
+  ASSERT_EQ(report.counters_size(), 1);
+  EXPECT_EQ(report.counters(0).value(), 400);
+  EXPECT_NEAR(report.counters(0).active_seconds(), 4.0, 0.5);
+  EXPECT_NEAR(report.counters(0).value_per_second(), 100.0, 15.0);
+  // Not diluted by the wall time.
+  EXPECT_LT(report.wall_time_seconds(), 1.0);
+}
+
+TEST(TelemetryTest, LogReportSince) {
+  Telemetry telemetry;
+  telemetry.RecordStage("parse_page", 1.0);
+  const TelemetryReport previous = telemetry.GetReport();
+  telemetry.RecordStage("parse_page", 1.0);
+  const TelemetryReport report = telemetry.LogReportSince(previous);
+  ASSERT_EQ(report.stages_size(), 1);
+  EXPECT_EQ(report.stages(0).count(), 2);
+  EXPECT_GE(report.wall_time_seconds(), previous.wall_time_seconds());
+}
+
+TEST(TelemetryTest, ScopedStageTimer) {
+  { ScopedStageTimer timer("telemetry_test_stage"); }
+  const TelemetryReport report = Telemetry::Get()->GetReport();
+  bool found = false;
+  for (const TelemetryReport::Stage& stage : report.stages()) {
+    if (stage.name() == "telemetry_test_stage") {
+      found = true;
+      EXPECT_EQ(stage.count(), 1);
+      EXPECT_GE(stage.total_seconds(), 0.0);
+    }
+  }
+  EXPECT_TRUE(found);
+}
+
+TEST(TelemetryTest, PeriodicTelemetryLogger) {
+  // Only checks that the logger stops promptly.
+  PeriodicTelemetryLogger logger(std::chrono::seconds(3600));
+}
+
+}  // namespace
+}  // namespace cpu_instructions
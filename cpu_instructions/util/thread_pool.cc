@@ -0,0 +1,72 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/thread_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "glog/logging.h"
+
+namespace cpu_instructions {
+
+ThreadPool::ThreadPool(int num_threads) {
+  const int num_threads_to_start = std::max(num_threads, 1);
+  threads_.reserve(num_threads_to_start);
+  for (int i = 0; i < num_threads_to_start; ++i) {
+    threads_.emplace_back(&ThreadPool::Run, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_ = true;
+  }
+  condition_.notify_all();
+  for (auto& thread : threads_) thread.join();
+}
+
+void ThreadPool::Schedule(std::function<void()> task) {
+  CHECK(task != nullptr);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+  }
+  condition_.notify_all();
+}
+
+void ThreadPool::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  condition_.wait(lock,
+                  [this]() { return tasks_.empty() && num_busy_threads_ == 0; });
+}
+
+void ThreadPool::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    condition_.wait(lock, [this]() { return done_ || !tasks_.empty(); });
+    if (tasks_.empty()) return;  // done_ is set and all tasks are done.
+    const std::function<void()> task = std::move(tasks_.front());
+    tasks_.pop_front();
+    ++num_busy_threads_;
+    lock.unlock();
+    task();
+    lock.lock();
+    --num_busy_threads_;
+    condition_.notify_all();
+  }
+}
+
+}  // namespace cpu_instructions
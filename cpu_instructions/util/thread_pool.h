@@ -0,0 +1,62 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A fixed set of threads running tasks from a shared queue.
+
+#ifndef CPU_INSTRUCTIONS_UTIL_THREAD_POOL_H_
+#define CPU_INSTRUCTIONS_UTIL_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cpu_instructions {
+
+// Tasks are started in the order they were scheduled, by whichever thread is
+// idle first, so that long and short tasks balance over the threads. Thread
+// safe: tasks may be scheduled from several threads, and from tasks.
+class ThreadPool {
+ public:
+  // Starts num_threads threads, at least one.
+  explicit ThreadPool(int num_threads);
+  ThreadPool(const ThreadPool&) = delete;
+
+  // Waits for all the scheduled tasks to finish.
+  ~ThreadPool();
+
+  int num_threads() const { return threads_.size(); }
+
+  // Schedules task to run on one of the threads.
+  void Schedule(std::function<void()> task);
+
+  // Waits until all the tasks scheduled so far are done.
+  void Flush();
+
+ private:
+  void Run();
+
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::deque<std::function<void()>> tasks_;  // Guarded by mutex_.
+  int num_busy_threads_ = 0;                  // Guarded by mutex_.
+  bool done_ = false;                         // Guarded by mutex_.
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_UTIL_THREAD_POOL_H_
@@ -0,0 +1,62 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/thread_pool.h"
+
+#include <atomic>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace cpu_instructions {
+namespace {
+
+using ::testing::Each;
+using ::testing::Eq;
+
+TEST(ThreadPoolTest, NumThreads) {
+  EXPECT_EQ(ThreadPool(0).num_threads(), 1);
+  EXPECT_EQ(ThreadPool(3).num_threads(), 3);
+}
+
+TEST(ThreadPoolTest, EachTaskRunsOnce) {
+  const int num_tasks = 1000;
+  std::vector<std::atomic<int>> counts(num_tasks);
+  {
+    ThreadPool pool(8);
+    for (int i = 0; i < num_tasks; ++i) {
+      pool.Schedule([&counts, i]() { ++counts[i]; });
+    }
+  }
+  std::vector<int> plain_counts;
+  for (const auto& count : counts) plain_counts.push_back(count);
+  EXPECT_THAT(plain_counts, Each(Eq(1)));
+}
+
+TEST(ThreadPoolTest, FlushWaitsForTasksScheduledByTasks) {
+  ThreadPool pool(4);
+  std::atomic<int> num_done(0);
+  for (int i = 0; i < 10; ++i) {
+    pool.Schedule([&pool, &num_done]() {
+      pool.Schedule([&num_done]() { ++num_done; });
+      ++num_done;
+    });
+  }
+  pool.Flush();
+  EXPECT_EQ(num_done, 20);
+}
+
+}  // namespace
+}  // namespace cpu_instructions
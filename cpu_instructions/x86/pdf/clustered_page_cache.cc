@@ -0,0 +1,90 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/x86/pdf/clustered_page_cache.h"
+
+#include "cpu_instructions/x86/pdf/pdf_document_parser.h"
+#include "cpu_instructions/x86/pdf/pdf_document_utils.h"
+#include "glog/logging.h"
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+
+namespace {
+
+// Returns a string that is equal for the same segment bindings.
+string SerializeSegmentBindings(const PdfPageChanges& page_changes) {
+  PdfPageChanges segment_bindings;
+  *segment_bindings.mutable_prevent_segment_bindings() =
+      page_changes.prevent_segment_bindings();
+  return segment_bindings.SerializeAsString();
+}
+
+}  // namespace
+
+ClusteredPageCache::ClusteredPageCache(size_t capacity) : capacity_(capacity) {
+  CHECK_GT(capacity_, 0);
+}
+
+PdfPage ClusteredPageCache::GetPage(int page_number,
+                                    const PdfPageChanges& page_changes,
+                                    const PageRenderer& render_page) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = entries_by_page_number_.find(page_number);
+  if (it != entries_by_page_number_.end()) {
+    entries_.splice(entries_.begin(), entries_, it->second);
+  } else {
+    if (entries_.size() == capacity_) {
+      entries_by_page_number_.erase(entries_.back().page_number);
+      entries_.pop_back();
+    }
+    entries_.emplace_front();
+    entries_by_page_number_[page_number] = entries_.begin();
+    Entry& entry = entries_.front();
+    entry.page_number = page_number;
+    entry.rendered_page = render_page(page_number);
+    ++num_renders_;
+  }
+
+  Entry& entry = entries_.front();
+  string segment_bindings = SerializeSegmentBindings(page_changes);
+  if (!entry.is_clustered || entry.segment_bindings != segment_bindings) {
+    entry.clustered_page = entry.rendered_page;
+    Cluster(&entry.clustered_page, page_changes.prevent_segment_bindings());
+    entry.segment_bindings = std::move(segment_bindings);
+    entry.is_clustered = true;
+    ++num_clusterings_;
+  }
+
+  PdfPage page = entry.clustered_page;
+  for (const auto& patch : page_changes.patches()) {
+    ApplyPatchOrDie(patch, &page);
+  }
+  return page;
+}
+
+int64_t ClusteredPageCache::num_renders() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_renders_;
+}
+
+int64_t ClusteredPageCache::num_clusterings() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_clusterings_;
+}
+
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
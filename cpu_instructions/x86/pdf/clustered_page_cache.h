@@ -0,0 +1,85 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// An in-memory LRU cache of rendered and clustered PdfPages, for tools that
+// parse pages one at a time and change their patches between calls.
+
+#ifndef CPU_INSTRUCTIONS_X86_PDF_CLUSTERED_PAGE_CACHE_H_
+#define CPU_INSTRUCTIONS_X86_PDF_CLUSTERED_PAGE_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include "strings/string.h"
+
+#include "cpu_instructions/x86/pdf/pdf_document.pb.h"
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+
+// Keeps, for the 'capacity' most recently used pages, their rendered characters
+// and the page clustered with the segment bindings of the last call. Getting a
+// page again only clusters it again if its prevent_segment_bindings changed,
+// and never renders it again while it is in the cache; patches are cheap and
+// are always applied to a copy of the clustered page.
+// This class is thread-safe, but renders and clusters pages under a lock.
+class ClusteredPageCache {
+ public:
+  // Returns a page with its characters only, as rendered by xpdf.
+  typedef std::function<PdfPage(int page_number)> PageRenderer;
+
+  explicit ClusteredPageCache(size_t capacity);
+
+  ClusteredPageCache(const ClusteredPageCache&) = delete;
+  ClusteredPageCache& operator=(const ClusteredPageCache&) = delete;
+
+  // Returns page 'page_number' clustered and patched according to
+  // page_changes, the same as XPDFDoc::Parse would. render_page is called if
+  // the page is not in the cache.
+  PdfPage GetPage(int page_number, const PdfPageChanges& page_changes,
+                  const PageRenderer& render_page);
+
+  int64_t num_renders() const;
+  int64_t num_clusterings() const;
+
+ private:
+  struct Entry {
+    int page_number = 0;
+    PdfPage rendered_page;
+    // The serialized prevent_segment_bindings clustered_page was clustered
+    // with. Only valid when is_clustered is true.
+    string segment_bindings;
+    bool is_clustered = false;
+    PdfPage clustered_page;
+  };
+
+  const size_t capacity_;
+  mutable std::mutex mutex_;
+  // The most recently used entry first. Guarded by mutex_.
+  std::list<Entry> entries_;
+  // Guarded by mutex_.
+  std::unordered_map<int, std::list<Entry>::iterator> entries_by_page_number_;
+  int64_t num_renders_ = 0;      // Guarded by mutex_.
+  int64_t num_clusterings_ = 0;  // Guarded by mutex_.
+};
+
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_X86_PDF_CLUSTERED_PAGE_CACHE_H_
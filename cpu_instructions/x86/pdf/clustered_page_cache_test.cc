@@ -0,0 +1,112 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/x86/pdf/clustered_page_cache.h"
+
+#include <vector>
+#include "strings/string.h"
+
+#include "cpu_instructions/util/proto_util.h"
+#include "cpu_instructions/x86/pdf/pdf_document_parser.h"
+#include "cpu_instructions/x86/pdf/pdf_document_utils.h"
+#include "gtest/gtest.h"
+#include "strings/str_cat.h"
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+namespace {
+
+class ClusteredPageCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    document_ = ReadTextProtoOrDie<PdfDocument>(
+        StrCat(getenv("TEST_SRCDIR"),
+               "/__main__/cpu_instructions/x86/pdf/testdata/"
+               "253666_p170_p171_pdfdoc.pbtxt"));
+    render_page_ = [this](int page_number) {
+      rendered_page_numbers_.push_back(page_number);
+      for (const PdfPage& page : document_.pages()) {
+        if (page.number() == page_number) return page;
+      }
+      return PdfPage();
+    };
+  }
+
+  // Returns the page as parsed by XPDFDoc::Parse.
+  PdfPage GetExpectedPage(int page_number,
+                          const PdfPageChanges& page_changes) {
+    PdfPage page = render_page_(page_number);
+    rendered_page_numbers_.pop_back();
+    Cluster(&page, page_changes.prevent_segment_bindings());
+    for (const auto& patch : page_changes.patches()) {
+      ApplyPatchOrDie(patch, &page);
+    }
+    return page;
+  }
+
+  PdfDocument document_;
+  ClusteredPageCache::PageRenderer render_page_;
+  std::vector<int> rendered_page_numbers_;
+};
+
+TEST_F(ClusteredPageCacheTest, ReappliesPatchesWithoutRendering) {
+  ClusteredPageCache cache(2);
+  const PdfPageChanges no_changes;
+  const PdfPage clustered_page = cache.GetPage(170, no_changes, render_page_);
+  EXPECT_EQ(clustered_page.SerializeAsString(),
+            GetExpectedPage(170, no_changes).SerializeAsString());
+
+  PdfPageChanges page_changes;
+  PdfPagePatch* const patch = page_changes.add_patches();
+  patch->set_row(1);
+  patch->set_col(0);
+  patch->set_expected(GetCellTextOrEmpty(clustered_page, 1, 0));
+  patch->set_replacement("patched");
+  const PdfPage patched_page = cache.GetPage(170, page_changes, render_page_);
+  EXPECT_EQ(GetCellTextOrEmpty(patched_page, 1, 0), "patched");
+  EXPECT_EQ(patched_page.SerializeAsString(),
+            GetExpectedPage(170, page_changes).SerializeAsString());
+  EXPECT_EQ(cache.num_renders(), 1);
+  EXPECT_EQ(cache.num_clusterings(), 1);
+
+  // Changing the segment bindings clusters the page again.
+  PdfPagePreventSegmentBinding* const binding =
+      page_changes.add_prevent_segment_bindings();
+  binding->set_first("first");
+  binding->set_second("second");
+  EXPECT_EQ(cache.GetPage(170, page_changes, render_page_).SerializeAsString(),
+            GetExpectedPage(170, page_changes).SerializeAsString());
+  EXPECT_EQ(cache.num_renders(), 1);
+  EXPECT_EQ(cache.num_clusterings(), 2);
+  EXPECT_EQ(rendered_page_numbers_, std::vector<int>({170}));
+}
+
+TEST_F(ClusteredPageCacheTest, EvictsLeastRecentlyUsedPage) {
+  ClusteredPageCache cache(1);
+  const PdfPageChanges no_changes;
+  cache.GetPage(170, no_changes, render_page_);
+  cache.GetPage(170, no_changes, render_page_);
+  cache.GetPage(171, no_changes, render_page_);
+  EXPECT_EQ(cache.GetPage(170, no_changes, render_page_).SerializeAsString(),
+            GetExpectedPage(170, no_changes).SerializeAsString());
+  EXPECT_EQ(rendered_page_numbers_, std::vector<int>({170, 171, 170}));
+  EXPECT_EQ(cache.num_renders(), 3);
+  EXPECT_EQ(cache.num_clusterings(), 3);
+}
+
+}  // namespace
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
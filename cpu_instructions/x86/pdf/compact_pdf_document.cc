@@ -0,0 +1,416 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "cpu_instructions/x86/pdf/compact_pdf_document.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+#include "src/google/protobuf/repeated_field.h"
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+
+namespace {
+
+using ::google::protobuf::RepeatedField;
+
+// Coordinates are stored in 1/kCoordinateScale of a display unit.
+constexpr const float kCoordinateScale = 32.0f;
+
+// The footer of a file is the size of the index as a little-endian 64-bit
+// integer followed by kMagic.
+constexpr const char kMagic[] = "CPDFDOC1";
+constexpr const size_t kMagicSize = sizeof(kMagic) - 1;
+constexpr const size_t kFooterSize = 8 + kMagicSize;
+
+int32_t Quantize(float coordinate) {
+  return static_cast<int32_t>(std::lround(coordinate * kCoordinateScale));
+}
+
+float Dequantize(int32_t coordinate) { return coordinate / kCoordinateScale; }
+
+// Delta-encodes a sequence of bounding boxes, see CompactPdfPage.
+class BoxEncoder {
+ public:
+  explicit BoxEncoder(RepeatedField<int32_t>* output) : output_(output) {}
+
+  void Add(const BoundingBox& box) {
+    const int32_t left = Quantize(box.left());
+    const int32_t top = Quantize(box.top());
+    output_->Add(left - previous_left_);
+    output_->Add(top - previous_top_);
+    output_->Add(Quantize(box.right()) - left);
+    output_->Add(Quantize(box.bottom()) - top);
+    previous_left_ = left;
+    previous_top_ = top;
+  }
+
+ private:
+  RepeatedField<int32_t>* const output_;
+  int32_t previous_left_ = 0;
+  int32_t previous_top_ = 0;
+};
+
+// Decodes the output of BoxEncoder.
+class BoxDecoder {
+ public:
+  explicit BoxDecoder(const RepeatedField<int32_t>& input) : input_(input) {}
+
+  BoundingBox Next() {
+    CHECK_LE(position_ + 4, input_.size()) << "Missing bounding boxes";
+    const int32_t left = previous_left_ + input_.Get(position_);
+    const int32_t top = previous_top_ + input_.Get(position_ + 1);
+    BoundingBox box;
+    box.set_left(Dequantize(left));
+    box.set_top(Dequantize(top));
+    box.set_right(Dequantize(left + input_.Get(position_ + 2)));
+    box.set_bottom(Dequantize(top + input_.Get(position_ + 3)));
+    position_ += 4;
+    previous_left_ = left;
+    previous_top_ = top;
+    return box;
+  }
+
+ private:
+  const RepeatedField<int32_t>& input_;
+  int position_ = 0;
+  int32_t previous_left_ = 0;
+  int32_t previous_top_ = 0;
+};
+
+// Assigns consecutive indices to distinct strings and styles.
+class Dictionaries {
+ public:
+  explicit Dictionaries(CompactPdfPage* page) : page_(page) {}
+
+  uint32_t GetStringIndex(const string& value) {
+    const auto inserted = strings_.emplace(value, strings_.size());
+    if (inserted.second) page_->add_strings(value);
+    return inserted.first->second;
+  }
+
+  uint32_t GetStyleIndex(float font_size, Orientation orientation,
+                         uint32_t fill_color_hash) {
+    const auto inserted = styles_.emplace(
+        std::make_tuple(font_size, orientation, fill_color_hash),
+        styles_.size());
+    if (inserted.second) {
+      CompactPdfPage::Style* const style = page_->add_styles();
+      style->set_font_size(font_size);
+      style->set_orientation(orientation);
+      style->set_fill_color_hash(fill_color_hash);
+    }
+    return inserted.first->second;
+  }
+
+ private:
+  CompactPdfPage* const page_;
+  std::unordered_map<string, uint32_t> strings_;
+  std::map<std::tuple<float, Orientation, uint32_t>, uint32_t> styles_;
+};
+
+const string& GetString(const CompactPdfPage& page, uint32_t index) {
+  CHECK_LT(index, page.strings_size()) << "Invalid string index";
+  return page.strings(index);
+}
+
+const CompactPdfPage::Style& GetStyle(const CompactPdfPage& page,
+                                      uint32_t index) {
+  CHECK_LT(index, page.styles_size()) << "Invalid style index";
+  return page.styles(index);
+}
+
+void EncodeBlock(const PdfTextBlock& block, Dictionaries* dictionaries,
+                 BoxEncoder* boxes, CompactPdfPage* compact_page) {
+  compact_page->add_block_strings(dictionaries->GetStringIndex(block.text()));
+  compact_page->add_block_styles(
+      dictionaries->GetStyleIndex(block.font_size(), block.orientation(), 0));
+  boxes->Add(block.bounding_box());
+}
+
+void DecodeBlock(const CompactPdfPage& compact_page, int index,
+                 BoxDecoder* boxes, PdfTextBlock* block) {
+  const CompactPdfPage::Style& style =
+      GetStyle(compact_page, compact_page.block_styles(index));
+  *block->mutable_bounding_box() = boxes->Next();
+  block->set_orientation(style.orientation());
+  block->set_font_size(style.font_size());
+  block->set_text(GetString(compact_page, compact_page.block_strings(index)));
+}
+
+// Writes all of data to fd, dies on errors.
+void WriteOrDie(int fd, const string& data, const string& filename) {
+  size_t written = 0;
+  while (written < data.size()) {
+    const ssize_t result =
+        write(fd, data.data() + written, data.size() - written);
+    PCHECK(result > 0) << "Could not write '" << filename << "'";
+    written += result;
+  }
+}
+
+// Reads 'size' bytes at 'offset' in fd, dies on errors.
+string ReadOrDie(int fd, uint64_t offset, uint64_t size,
+                 const string& filename) {
+  string data(size, '\0');
+  size_t num_read = 0;
+  while (num_read < size) {
+    const ssize_t result =
+        pread(fd, &data[num_read], size - num_read, offset + num_read);
+    PCHECK(result > 0) << "Could not read '" << filename << "'";
+    num_read += result;
+  }
+  return data;
+}
+
+}  // namespace
+
+CompactPdfPage EncodeCompactPdfPage(const PdfPage& page) {
+  CompactPdfPage compact_page;
+  compact_page.set_number(page.number());
+  compact_page.set_width(page.width());
+  compact_page.set_height(page.height());
+  compact_page.set_num_overprinted_characters(
+      page.num_overprinted_characters());
+  Dictionaries dictionaries(&compact_page);
+
+  BoxEncoder character_boxes(compact_page.mutable_character_boxes());
+  for (const PdfCharacter& character : page.characters()) {
+    compact_page.add_character_codepoints(character.codepoint());
+    compact_page.add_character_strings(
+        dictionaries.GetStringIndex(character.utf8()));
+    compact_page.add_character_styles(dictionaries.GetStyleIndex(
+        character.font_size(), character.orientation(),
+        character.fill_color_hash()));
+    character_boxes.Add(character.bounding_box());
+  }
+
+  BoxEncoder segment_boxes(compact_page.mutable_segment_boxes());
+  int64_t previous_character_index = 0;
+  for (const PdfTextSegment& segment : page.segments()) {
+    compact_page.add_segment_strings(
+        dictionaries.GetStringIndex(segment.text()));
+    compact_page.add_segment_styles(dictionaries.GetStyleIndex(
+        segment.font_size(), segment.orientation(),
+        segment.fill_color_hash()));
+    segment_boxes.Add(segment.bounding_box());
+    compact_page.add_segment_num_characters(
+        segment.character_indices_size());
+    for (const uint32_t character_index : segment.character_indices()) {
+      compact_page.add_segment_character_indices(character_index -
+                                                 previous_character_index);
+      previous_character_index = character_index;
+    }
+  }
+
+  BoxEncoder block_boxes(compact_page.mutable_block_boxes());
+  for (const PdfTextBlock& block : page.blocks()) {
+    EncodeBlock(block, &dictionaries, &block_boxes, &compact_page);
+  }
+  BoxEncoder row_boxes(compact_page.mutable_row_boxes());
+  for (const PdfTextTableRow& row : page.rows()) {
+    row_boxes.Add(row.bounding_box());
+    compact_page.add_row_num_blocks(row.blocks_size());
+    for (const PdfTextBlock& block : row.blocks()) {
+      EncodeBlock(block, &dictionaries, &block_boxes, &compact_page);
+    }
+  }
+  return compact_page;
+}
+
+PdfPage DecodeCompactPdfPageOrDie(const CompactPdfPage& compact_page) {
+  PdfPage page;
+  page.set_number(compact_page.number());
+  page.set_width(compact_page.width());
+  page.set_height(compact_page.height());
+  page.set_num_overprinted_characters(
+      compact_page.num_overprinted_characters());
+
+  const int num_characters = compact_page.character_codepoints_size();
+  CHECK_EQ(compact_page.character_strings_size(), num_characters);
+  CHECK_EQ(compact_page.character_styles_size(), num_characters);
+  BoxDecoder character_boxes(compact_page.character_boxes());
+  for (int i = 0; i < num_characters; ++i) {
+    const CompactPdfPage::Style& style =
+        GetStyle(compact_page, compact_page.character_styles(i));
+    PdfCharacter* const character = page.add_characters();
+    character->set_codepoint(compact_page.character_codepoints(i));
+    character->set_utf8(
+        GetString(compact_page, compact_page.character_strings(i)));
+    character->set_font_size(style.font_size());
+    character->set_orientation(style.orientation());
+    *character->mutable_bounding_box() = character_boxes.Next();
+    character->set_fill_color_hash(style.fill_color_hash());
+  }
+
+  const int num_segments = compact_page.segment_strings_size();
+  CHECK_EQ(compact_page.segment_styles_size(), num_segments);
+  CHECK_EQ(compact_page.segment_num_characters_size(), num_segments);
+  BoxDecoder segment_boxes(compact_page.segment_boxes());
+  int character_index_position = 0;
+  int64_t character_index = 0;
+  for (int i = 0; i < num_segments; ++i) {
+    const CompactPdfPage::Style& style =
+        GetStyle(compact_page, compact_page.segment_styles(i));
+    PdfTextSegment* const segment = page.add_segments();
+    *segment->mutable_bounding_box() = segment_boxes.Next();
+    segment->set_orientation(style.orientation());
+    segment->set_font_size(style.font_size());
+    segment->set_fill_color_hash(style.fill_color_hash());
+    segment->set_text(
+        GetString(compact_page, compact_page.segment_strings(i)));
+    const int num_segment_characters = compact_page.segment_num_characters(i);
+    CHECK_LE(character_index_position + num_segment_characters,
+             compact_page.segment_character_indices_size());
+    for (int j = 0; j < num_segment_characters; ++j) {
+      character_index +=
+          compact_page.segment_character_indices(character_index_position++);
+      segment->add_character_indices(character_index);
+    }
+  }
+
+  const int num_blocks = compact_page.block_strings_size();
+  CHECK_EQ(compact_page.block_styles_size(), num_blocks);
+  int num_row_blocks = 0;
+  for (const uint32_t row_num_blocks : compact_page.row_num_blocks()) {
+    num_row_blocks += row_num_blocks;
+  }
+  CHECK_LE(num_row_blocks, num_blocks);
+  BoxDecoder block_boxes(compact_page.block_boxes());
+  int block_index = 0;
+  for (; block_index < num_blocks - num_row_blocks; ++block_index) {
+    DecodeBlock(compact_page, block_index, &block_boxes, page.add_blocks());
+  }
+  CHECK_EQ(compact_page.row_num_blocks_size(),
+           compact_page.row_boxes_size() / 4);
+  BoxDecoder row_boxes(compact_page.row_boxes());
+  for (const uint32_t row_num_blocks : compact_page.row_num_blocks()) {
+    PdfTextTableRow* const row = page.add_rows();
+    *row->mutable_bounding_box() = row_boxes.Next();
+    for (uint32_t i = 0; i < row_num_blocks; ++i) {
+      DecodeBlock(compact_page, block_index++, &block_boxes,
+                  row->add_blocks());
+    }
+  }
+  return page;
+}
+
+void WriteCompactPdfDocumentOrDie(const string& filename,
+                                  const PdfDocument& document) {
+  const int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  PCHECK(fd >= 0) << "Could not open '" << filename << "'";
+  CompactPdfDocumentIndex index;
+  if (document.has_document_id()) {
+    *index.mutable_document_id() = document.document_id();
+  }
+  uint64_t offset = 0;
+  for (const PdfPage& page : document.pages()) {
+    const string data = EncodeCompactPdfPage(page).SerializeAsString();
+    WriteOrDie(fd, data, filename);
+    index.add_page_offsets(offset);
+    index.add_page_sizes(data.size());
+    index.add_page_numbers(page.number());
+    offset += data.size();
+  }
+  string footer = index.SerializeAsString();
+  const uint64_t index_size = footer.size();
+  for (int i = 0; i < 8; ++i) {
+    footer.push_back(static_cast<char>((index_size >> (8 * i)) & 0xFF));
+  }
+  footer.append(kMagic, kMagicSize);
+  WriteOrDie(fd, footer, filename);
+  PCHECK(close(fd) == 0) << "Could not write '" << filename << "'";
+}
+
+PdfDocument ReadCompactPdfDocumentOrDie(const string& filename) {
+  const auto reader = CompactPdfDocumentReader::OpenOrDie(filename);
+  PdfDocument document;
+  if (reader->index().has_document_id()) {
+    *document.mutable_document_id() = reader->document_id();
+  }
+  for (int i = 0; i < reader->num_pages(); ++i) {
+    reader->ReadPageOrDie(i).Swap(document.add_pages());
+  }
+  return document;
+}
+
+std::unique_ptr<const CompactPdfDocumentReader>
+CompactPdfDocumentReader::OpenOrDie(const string& filename) {
+  const int fd = open(filename.c_str(), O_RDONLY);
+  PCHECK(fd >= 0) << "Could not open '" << filename << "'";
+  struct stat file_stat;
+  PCHECK(fstat(fd, &file_stat) == 0) << filename;
+  const uint64_t file_size = file_stat.st_size;
+  CHECK_GE(file_size, kFooterSize) << "Not a compact PdfDocument: '"
+                                   << filename << "'";
+  const string footer =
+      ReadOrDie(fd, file_size - kFooterSize, kFooterSize, filename);
+  CHECK_EQ(footer.substr(8), kMagic) << "Not a compact PdfDocument: '"
+                                     << filename << "'";
+  uint64_t index_size = 0;
+  for (int i = 0; i < 8; ++i) {
+    index_size |= static_cast<uint64_t>(static_cast<unsigned char>(footer[i]))
+                  << (8 * i);
+  }
+  CHECK_LE(index_size, file_size - kFooterSize) << "Corrupted index in '"
+                                                << filename << "'";
+  CompactPdfDocumentIndex index;
+  CHECK(index.ParseFromString(ReadOrDie(
+      fd, file_size - kFooterSize - index_size, index_size, filename)))
+      << "Corrupted index in '" << filename << "'";
+  CHECK_EQ(index.page_sizes_size(), index.page_offsets_size());
+  CHECK_EQ(index.page_numbers_size(), index.page_offsets_size());
+  return std::unique_ptr<const CompactPdfDocumentReader>(
+      new CompactPdfDocumentReader(filename, fd, std::move(index)));
+}
+
+CompactPdfDocumentReader::CompactPdfDocumentReader(
+    const string& filename, int fd, CompactPdfDocumentIndex index)
+    : filename_(filename), fd_(fd), index_(std::move(index)) {}
+
+CompactPdfDocumentReader::~CompactPdfDocumentReader() { close(fd_); }
+
+int CompactPdfDocumentReader::GetPageNumber(int page_index) const {
+  CHECK_GE(page_index, 0);
+  CHECK_LT(page_index, num_pages());
+  return index_.page_numbers(page_index);
+}
+
+PdfPage CompactPdfDocumentReader::ReadPageOrDie(int page_index) const {
+  CHECK_GE(page_index, 0);
+  CHECK_LT(page_index, num_pages());
+  CompactPdfPage compact_page;
+  CHECK(compact_page.ParseFromString(
+      ReadOrDie(fd_, index_.page_offsets(page_index),
+                index_.page_sizes(page_index), filename_)))
+      << "Corrupted page " << page_index << " in '" << filename_ << "'";
+  return DecodeCompactPdfPageOrDie(compact_page);
+}
+
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
@@ -0,0 +1,91 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// A compact storage format for PdfDocuments. Bounding boxes, which make up
+// most of the size of a binary PdfDocument, are quantized to 1/32 of a display
+// unit and delta-encoded in stream order; strings and character styles are
+// dictionary-encoded. The quantized coordinates of a page fit in 16 bits and
+// most deltas in a single byte.
+//
+// The conversion is lossless except for the coordinates, which are off by at
+// most 1/64 of a display unit, and all decoded objects have a bounding box.
+// Converting a decoded page again gives the same compact page.
+//
+// A file holds the compact pages one after the other, followed by a
+// CompactPdfDocumentIndex and a fixed-size footer, so that a single page can be
+// read without reading the whole file.
+
+#ifndef CPU_INSTRUCTIONS_X86_PDF_COMPACT_PDF_DOCUMENT_H_
+#define CPU_INSTRUCTIONS_X86_PDF_COMPACT_PDF_DOCUMENT_H_
+
+#include <memory>
+#include "strings/string.h"
+
+#include "cpu_instructions/x86/pdf/compact_pdf_document.pb.h"
+#include "cpu_instructions/x86/pdf/pdf_document.pb.h"
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+
+// Converts a page to its compact encoding.
+CompactPdfPage EncodeCompactPdfPage(const PdfPage& page);
+
+// Converts a compact page back to a PdfPage. Dies if compact_page is not
+// consistent.
+PdfPage DecodeCompactPdfPageOrDie(const CompactPdfPage& compact_page);
+
+// Writes a document to a file in the compact format.
+void WriteCompactPdfDocumentOrDie(const string& filename,
+                                  const PdfDocument& document);
+
+// Reads a whole document written by WriteCompactPdfDocumentOrDie.
+PdfDocument ReadCompactPdfDocumentOrDie(const string& filename);
+
+// Reads individual pages of a file written by WriteCompactPdfDocumentOrDie.
+// This class is thread-safe.
+class CompactPdfDocumentReader {
+ public:
+  // Reads the index of the file.
+  static std::unique_ptr<const CompactPdfDocumentReader> OpenOrDie(
+      const string& filename);
+
+  CompactPdfDocumentReader(const CompactPdfDocumentReader&) = delete;
+  ~CompactPdfDocumentReader();
+
+  const CompactPdfDocumentIndex& index() const { return index_; }
+  const PdfDocumentId& document_id() const { return index_.document_id(); }
+  int num_pages() const { return index_.page_offsets_size(); }
+
+  // Returns the number of the page at 'page_index', without reading it.
+  int GetPageNumber(int page_index) const;
+
+  // Reads and decodes the page at 'page_index', in [0, num_pages()).
+  PdfPage ReadPageOrDie(int page_index) const;
+
+ private:
+  CompactPdfDocumentReader(const string& filename, int fd,
+                           CompactPdfDocumentIndex index);
+
+  const string filename_;
+  const int fd_;
+  const CompactPdfDocumentIndex index_;
+};
+
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_X86_PDF_COMPACT_PDF_DOCUMENT_H_
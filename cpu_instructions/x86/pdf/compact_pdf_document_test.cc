@@ -0,0 +1,167 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "cpu_instructions/x86/pdf/compact_pdf_document.h"
+
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "cpu_instructions/testing/test_util.h"
+#include "cpu_instructions/util/proto_util.h"
+#include "glog/logging.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "src/google/protobuf/util/field_comparator.h"
+#include "src/google/protobuf/util/message_differencer.h"
+#include "strings/str_cat.h"
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+namespace {
+
+using ::cpu_instructions::testing::EqualsProto;
+using ::google::protobuf::util::DefaultFieldComparator;
+using ::google::protobuf::util::MessageDifferencer;
+
+const char kTestDataPath[] = "/__main__/cpu_instructions/x86/pdf/testdata/";
+
+PdfDocument GetTestDocument() {
+  return ReadTextProtoOrDie<PdfDocument>(StrCat(
+      getenv("TEST_SRCDIR"), kTestDataPath, "253666_p170_p171_pdfdoc.pbtxt"));
+}
+
+int64_t GetFileSize(const string& filename) {
+  struct stat file_stat;
+  CHECK_EQ(stat(filename.c_str(), &file_stat), 0) << filename;
+  return file_stat.st_size;
+}
+
+// Returns true if 'actual' is equal to 'expected' up to the quantization of
+// the coordinates.
+bool EqualsUpToQuantization(const PdfPage& expected, const PdfPage& actual,
+                            string* differences) {
+  DefaultFieldComparator comparator;
+  comparator.set_float_comparison(DefaultFieldComparator::APPROXIMATE);
+  comparator.SetDefaultFractionAndMargin(0.0, 1.0 / 64 + 1e-4);
+  MessageDifferencer differencer;
+  differencer.set_field_comparator(&comparator);
+  differencer.ReportDifferencesToString(differences);
+  return differencer.Compare(expected, actual);
+}
+
+TEST(CompactPdfDocumentTest, EncodeDecode) {
+  constexpr char kPage[] = R"(
+    number: 3 width: 612 height: 792 num_overprinted_characters: 2
+    characters {
+      codepoint: 0x41 utf8: "A" font_size: 9.5 fill_color_hash: 123
+      bounding_box { left: 10.5 top: 20.25 right: 15.5 bottom: 30 }
+    }
+    characters {
+      codepoint: 0x42 utf8: "B" font_size: 9.5 fill_color_hash: 123
+      bounding_box { left: 15.5 top: 20.25 right: 20 bottom: 30 }
+    }
+    characters {
+      codepoint: 0x41 utf8: "A" font_size: 12 orientation: SOUTH
+      bounding_box { left: 5 top: 2 right: 8 bottom: 4 }
+    }
+    segments {
+      bounding_box { left: 10.5 top: 20.25 right: 20 bottom: 30 }
+      font_size: 9.5 fill_color_hash: 123 text: "AB"
+      character_indices: 0 character_indices: 1
+    }
+    segments {
+      bounding_box { left: 5 top: 2 right: 8 bottom: 4 }
+      orientation: SOUTH font_size: 12 text: "A"
+      character_indices: 2
+    }
+    blocks {
+      bounding_box { left: 5 top: 2 right: 8 bottom: 4 }
+      orientation: SOUTH font_size: 12 text: "A"
+    }
+    rows {
+      bounding_box { left: 10.5 top: 20.25 right: 20 bottom: 30 }
+      blocks {
+        bounding_box { left: 10.5 top: 20.25 right: 20 bottom: 30 }
+        font_size: 9.5 text: "AB"
+      }
+    }
+    rows { bounding_box { left: 0 top: 40 right: 612 bottom: 50 } })";
+  const PdfPage page = ParseProtoFromStringOrDie<PdfPage>(kPage);
+  const CompactPdfPage compact_page = EncodeCompactPdfPage(page);
+  EXPECT_EQ(compact_page.strings_size(), 3);
+  EXPECT_EQ(compact_page.styles_size(), 3);
+  // All coordinates in kPage are multiples of 1/32, the conversion is exact.
+  EXPECT_THAT(DecodeCompactPdfPageOrDie(compact_page), EqualsProto(kPage));
+}
+
+TEST(CompactPdfDocumentTest, RoundTrip) {
+  const PdfDocument document = GetTestDocument();
+  ASSERT_GT(document.pages_size(), 0);
+  for (const PdfPage& page : document.pages()) {
+    const CompactPdfPage compact_page = EncodeCompactPdfPage(page);
+    const PdfPage decoded_page = DecodeCompactPdfPageOrDie(compact_page);
+    string differences;
+    EXPECT_TRUE(EqualsUpToQuantization(page, decoded_page, &differences))
+        << differences;
+    // The quantized page is a fixed point of the conversion.
+    EXPECT_EQ(EncodeCompactPdfPage(decoded_page).SerializeAsString(),
+              compact_page.SerializeAsString());
+  }
+}
+
+TEST(CompactPdfDocumentTest, WriteAndRead) {
+  const PdfDocument document = GetTestDocument();
+  const string filename = StrCat(getenv("TEST_TMPDIR"), "/document.cpb");
+  WriteCompactPdfDocumentOrDie(filename, document);
+
+  const PdfDocument read_document = ReadCompactPdfDocumentOrDie(filename);
+  EXPECT_THAT(read_document.document_id(),
+              EqualsProto(document.document_id()));
+  ASSERT_EQ(read_document.pages_size(), document.pages_size());
+  for (int i = 0; i < document.pages_size(); ++i) {
+    string differences;
+    EXPECT_TRUE(EqualsUpToQuantization(document.pages(i),
+                                       read_document.pages(i), &differences))
+        << differences;
+  }
+  EXPECT_LT(GetFileSize(filename), document.ByteSize() / 2);
+}
+
+TEST(CompactPdfDocumentTest, RandomAccess) {
+  const PdfDocument document = GetTestDocument();
+  const string filename = StrCat(getenv("TEST_TMPDIR"), "/random_access.cpb");
+  WriteCompactPdfDocumentOrDie(filename, document);
+
+  const auto reader = CompactPdfDocumentReader::OpenOrDie(filename);
+  ASSERT_EQ(reader->num_pages(), document.pages_size());
+  for (int i = reader->num_pages() - 1; i >= 0; --i) {
+    EXPECT_EQ(reader->GetPageNumber(i), document.pages(i).number());
+    const PdfPage page = reader->ReadPageOrDie(i);
+    EXPECT_THAT(EncodeCompactPdfPage(page),
+                EqualsProto(EncodeCompactPdfPage(document.pages(i))));
+  }
+}
+
+TEST(CompactPdfDocumentTest, EmptyDocument) {
+  const string filename = StrCat(getenv("TEST_TMPDIR"), "/empty.cpb");
+  WriteCompactPdfDocumentOrDie(filename, PdfDocument());
+  EXPECT_THAT(ReadCompactPdfDocumentOrDie(filename), EqualsProto(""));
+}
+
+}  // namespace
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
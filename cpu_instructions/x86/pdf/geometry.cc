@@ -14,7 +14,10 @@
 
 #include "cpu_instructions/x86/pdf/geometry.h"
 
+#include <algorithm>
 #include <cfloat>
+#include <cmath>
+#include <numeric>
 
 #include "glog/logging.h"
 
@@ -44,10 +47,7 @@ float GetWidth(const BoundingBox& bbox) { return bbox.right() - bbox.left(); }
 
 float GetHeight(const BoundingBox& bbox) { return bbox.bottom() - bbox.top(); }
 
-Point GetCenter(const BoundingBox& bbox) {
-  return {(bbox.left() + bbox.right()) / 2.0f,
-          (bbox.top() + bbox.bottom()) / 2.0f};
-}
+Point GetCenter(const BoundingBox& bbox) { return GetCenter(ToBox(bbox)); }
 
 bool Contains(const BoundingBox& bounding_box, const Point& point) {
   return point.x >= bounding_box.left() && point.x <= bounding_box.right() &&
@@ -68,6 +68,14 @@ BoundingBox Union(const BoundingBox& a, const BoundingBox& b) {
                    std::max(a.bottom(), b.bottom()));
 }
 
+float GetIntersectionArea(const BoundingBox& a, const BoundingBox& b) {
+  const float width =
+      std::min(a.right(), b.right()) - std::max(a.left(), b.left());
+  const float height =
+      std::min(a.bottom(), b.bottom()) - std::max(a.top(), b.top());
+  return width > 0.0f && height > 0.0f ? width * height : 0.0f;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 bool QuadTree::Insert(size_t index, const Point& position) {
@@ -120,6 +128,114 @@ void QuadTree::Subdivide() {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+Box ToBox(const BoundingBox& bounding_box) {
+  Box box;
+  box.left = bounding_box.left();
+  box.top = bounding_box.top();
+  box.right = bounding_box.right();
+  box.bottom = bounding_box.bottom();
+  return box;
+}
+
+void ToBoundingBox(const Box& box, BoundingBox* bounding_box) {
+  bounding_box->set_left(box.left);
+  bounding_box->set_top(box.top);
+  bounding_box->set_right(box.right);
+  bounding_box->set_bottom(box.bottom);
+}
+
+Point GetCenter(const Box& box) {
+  return {(box.left + box.right) / 2.0f, (box.top + box.bottom) / 2.0f};
+}
+
+Box Union(const Box& a, const Box& b) {
+  Box box;
+  box.left = std::min(a.left, b.left);
+  box.top = std::min(a.top, b.top);
+  box.right = std::max(a.right, b.right);
+  box.bottom = std::max(a.bottom, b.bottom);
+  return box;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// The maximal number of cells of a PointGrid per point.
+constexpr const int kMaxGridCellsPerPoint = 4;
+
+// Returns the index of the cell containing 'offset' along an axis of a grid,
+// clamped to [0, num_cells). Clamping is done on floats, offset may be far out
+// of the range of int.
+int GetCellIndex(float offset, float cell_size, int num_cells) {
+  const float index = std::floor(offset / cell_size);
+  if (index <= 0.0f) return 0;
+  if (index >= num_cells - 1) return num_cells - 1;
+  return static_cast<int>(index);
+}
+
+}  // namespace
+
+PointGrid::PointGrid(const BoundingBox& bounding_box, float cell_size,
+                     const std::vector<Point>& points)
+    : bounding_box_(bounding_box), cell_size_(cell_size) {
+  CHECK_GT(cell_size_, 0.0f);
+  const double max_num_cells =
+      kMaxGridCellsPerPoint * static_cast<double>(points.size()) + 1;
+  while (true) {
+    const double num_columns =
+        std::max(std::ceil(GetWidth(bounding_box_) / cell_size_), 1.0f);
+    const double num_rows =
+        std::max(std::ceil(GetHeight(bounding_box_) / cell_size_), 1.0f);
+    if (num_columns * num_rows <= max_num_cells) {
+      num_columns_ = static_cast<int>(num_columns);
+      num_rows_ = static_cast<int>(num_rows);
+      break;
+    }
+    cell_size_ *= 2.0f;
+  }
+
+  // Counts the points of each cell, then computes the offsets of the cells and
+  // places the points. The first pass stores the cell of each point.
+  std::vector<int> point_cells(points.size(), -1);
+  cell_offsets_.assign(num_columns_ * num_rows_ + 1, 0);
+  for (size_t i = 0; i < points.size(); ++i) {
+    if (!Contains(bounding_box_, points[i])) continue;
+    const int cell = GetRow(points[i].y) * num_columns_ + GetColumn(points[i].x);
+    point_cells[i] = cell;
+    ++cell_offsets_[cell + 1];
+  }
+  for (size_t cell = 1; cell < cell_offsets_.size(); ++cell) {
+    cell_offsets_[cell] += cell_offsets_[cell - 1];
+  }
+  point_indices_.resize(cell_offsets_.back());
+  point_positions_.resize(cell_offsets_.back(), Point(0.0f, 0.0f));
+  std::vector<uint32_t> next_positions(cell_offsets_.begin(),
+                                       cell_offsets_.end() - 1);
+  for (size_t i = 0; i < points.size(); ++i) {
+    if (point_cells[i] < 0) continue;
+    const uint32_t position = next_positions[point_cells[i]]++;
+    point_indices_[position] = i;
+    point_positions_[position] = points[i];
+  }
+}
+
+void PointGrid::QueryRange(const BoundingBox& range, Indices* output) const {
+  ForEachPointInRange(range, [output](size_t index) {
+    output->push_back(index);
+  });
+}
+
+int PointGrid::GetColumn(float x) const {
+  return GetCellIndex(x - bounding_box_.left(), cell_size_, num_columns_);
+}
+
+int PointGrid::GetRow(float y) const {
+  return GetCellIndex(y - bounding_box_.top(), cell_size_, num_rows_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 Span::Span(float min, float max) : min(min), max(max) { CHECK_LE(min, max); }
 
 bool Span::Contains(const Span& other) const {
@@ -131,13 +247,17 @@ bool Span::Intersects(const Span& other) const {
 }
 
 Span GetSpan(const BoundingBox& box, const Orientation orientation) {
+  return GetSpan(ToBox(box), orientation);
+}
+
+Span GetSpan(const Box& box, const Orientation orientation) {
   const Vec2F direction = GetDirectionVector(orientation);
   CHECK_EQ(direction.norm_square(), 1);
   float max = -FLT_MAX;
   float min = FLT_MAX;
   for (const Vec2F& corner :
-       {Vec2F(box.left(), box.top()), Vec2F(box.right(), box.top()),
-        Vec2F(box.left(), box.bottom()), Vec2F(box.right(), box.bottom())}) {
+       {Vec2F(box.left, box.top), Vec2F(box.right, box.top),
+        Vec2F(box.left, box.bottom), Vec2F(box.right, box.bottom)}) {
     const float distance = corner.dot_product(direction);
     if (distance < min) min = distance;
     if (distance > max) max = distance;
@@ -145,6 +265,35 @@ Span GetSpan(const BoundingBox& box, const Orientation orientation) {
   return Span(min, max);
 }
 
+std::vector<Indices> GetIntersectingSpanClusters(
+    const std::vector<Span>& spans) {
+  Indices by_min(spans.size());
+  std::iota(by_min.begin(), by_min.end(), 0);
+  std::sort(by_min.begin(), by_min.end(), [&spans](size_t a, size_t b) {
+    return spans[a].min < spans[b].min;
+  });
+  // When the spans are sorted by min, a span intersects one of the previous
+  // spans iff its min is not greater than the max of all the previous spans,
+  // so the clusters are consecutive runs of by_min.
+  std::vector<Indices> output;
+  float max = 0.0f;
+  for (const size_t index : by_min) {
+    const Span& span = spans[index];
+    if (output.empty() || span.min > max) {
+      output.emplace_back();
+      max = span.max;
+    }
+    output.back().push_back(index);
+    max = std::max(max, span.max);
+  }
+  for (auto& cluster : output) std::sort(cluster.begin(), cluster.end());
+  std::sort(output.begin(), output.end(),
+            [](const Indices& a, const Indices& b) {
+              return a.front() < b.front();
+            });
+  return output;
+}
+
 Vec2F GetDirectionVector(Orientation orientation) {
   switch (orientation) {
     case NORTH:
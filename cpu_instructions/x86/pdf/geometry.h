@@ -16,6 +16,8 @@
 #ifndef CPU_INSTRUCTIONS_X86_PDF_GEOMETRY_H_
 #define CPU_INSTRUCTIONS_X86_PDF_GEOMETRY_H_
 
+#include <algorithm>
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -27,6 +29,8 @@ namespace pdf {
 
 typedef std::vector<size_t> Indices;
 
+struct Span;
+
 ////////////////////////////////////////////////////////////////////////////////
 // A simple 2D vector with float coordinates.
 struct Vec2F {
@@ -77,6 +81,31 @@ bool Intersects(const BoundingBox& a, const BoundingBox& b);
 // Return the Union of two BoundingBoxes.
 BoundingBox Union(const BoundingBox& a, const BoundingBox& b);
 
+// Returns the area of the intersection of two BoundingBoxes, 0 if they do not
+// intersect.
+float GetIntersectionArea(const BoundingBox& a, const BoundingBox& b);
+
+////////////////////////////////////////////////////////////////////////////////
+// A BoundingBox as a plain struct, for the inner loops of the clustering where
+// the proto accessors dominate. The functions below compute the same values as
+// their BoundingBox counterparts.
+struct Box {
+  float left = 0.0f;
+  float top = 0.0f;
+  float right = 0.0f;
+  float bottom = 0.0f;
+};
+
+// Conversions from and to BoundingBox.
+Box ToBox(const BoundingBox& bounding_box);
+void ToBoundingBox(const Box& box, BoundingBox* bounding_box);
+
+// Get the center point of a Box.
+Point GetCenter(const Box& box);
+
+// Return the Union of two Boxes.
+Box Union(const Box& a, const Box& b);
+
 ////////////////////////////////////////////////////////////////////////////////
 // A QuadTree to accelerate nearest neighbors search.
 class QuadTree {
@@ -115,6 +144,84 @@ class QuadTree {
   std::vector<PointData> points_;          // points stored in this node.
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// A uniform grid of square cells to find the points within a range. When the
+// range is about the size of a cell, e.g. when the points are the centers of
+// characters of similar font sizes, a query only visits a handful of cells.
+// The points are bucketed by cell in a single array (compressed sparse row
+// layout): the grid is built in two passes without per-cell allocations, and
+// the points of a cell are contiguous in memory. Within a cell, points are in
+// increasing index order.
+class PointGrid {
+ public:
+  // Builds the grid for 'points' over 'bounding_box'; the index of a point is
+  // its position in 'points'. Points outside bounding_box are ignored, like in
+  // QuadTree::Insert. cell_size must be positive, it may be increased to bound
+  // the number of cells by a small multiple of the number of points.
+  PointGrid(const BoundingBox& bounding_box, float cell_size,
+            const std::vector<Point>& points);
+
+  // Calls callback(point_index) for each point in range, bounds included. The
+  // points are enumerated cell by cell.
+  template <typename Callback>
+  void ForEachPointInRange(const BoundingBox& range, Callback callback) const;
+
+  // Gathers points in the range bounding box into output.
+  void QueryRange(const BoundingBox& range, Indices* output) const;
+
+  // Returns the index of the nearest point in direction from origin, or -1 if
+  // there is none. The distance of a point p is
+  // (p - origin).dot_product(GetDirectionVector(direction)), only the points at
+  // a distance in (0, max_distance], whose coordinate along
+  // RotateClockwise90(direction) is in lateral_span and for which
+  // predicate(point_index) is true are considered. Ties are broken by the
+  // smallest index.
+  // The lines of cells across direction are visited from origin outwards, and
+  // the search stops at the first line holding a match: the points of the next
+  // lines are further away. predicate is only called for the points that are
+  // closer than the best match so far.
+  template <typename Predicate>
+  int FindNearestInDirection(const Point& origin, Orientation direction,
+                             const Span& lateral_span, float max_distance,
+                             Predicate predicate) const;
+
+  int num_columns() const { return num_columns_; }
+  int num_rows() const { return num_rows_; }
+
+ private:
+  // Returns the column (resp. row) of the cell containing x (resp. y), clamped
+  // to the grid.
+  int GetColumn(float x) const;
+  int GetRow(float y) const;
+
+  const BoundingBox bounding_box_;
+  float cell_size_ = 0.0f;
+  int num_columns_ = 0;
+  int num_rows_ = 0;
+  // The points of cell c (in row-major order) are in
+  // [cell_offsets_[c], cell_offsets_[c + 1]) in point_indices_ and
+  // point_positions_.
+  std::vector<uint32_t> cell_offsets_;
+  std::vector<uint32_t> point_indices_;
+  std::vector<Point> point_positions_;
+};
+
+template <typename Callback>
+void PointGrid::ForEachPointInRange(const BoundingBox& range,
+                                    Callback callback) const {
+  if (point_indices_.empty() || !Intersects(bounding_box_, range)) return;
+  const int first_column = GetColumn(range.left());
+  const int last_column = GetColumn(range.right());
+  const int last_row = GetRow(range.bottom());
+  for (int row = GetRow(range.top()); row <= last_row; ++row) {
+    const int row_offset = row * num_columns_;
+    const uint32_t end = cell_offsets_[row_offset + last_column + 1];
+    for (uint32_t i = cell_offsets_[row_offset + first_column]; i < end; ++i) {
+      if (Contains(range, point_positions_[i])) callback(point_indices_[i]);
+    }
+  }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // An interval between min and max (inclusive) and associated set logic.
 //
@@ -143,6 +250,14 @@ struct Span {
 // v  |     |  |
 //    +-----+  +
 Span GetSpan(const BoundingBox& box, const Orientation orientation);
+Span GetSpan(const Box& box, const Orientation orientation);
+
+// Returns the connected components of the graph whose nodes are the indices of
+// spans and whose edges are the pairs of intersecting spans. This sorts and
+// sweeps the spans in O(N log N) instead of testing all pairs. The indices in a
+// component are sorted, and the components are sorted by their first index, so
+// that the output is the same as with DenseConnectedComponentsFinder.
+std::vector<Indices> GetIntersectingSpanClusters(const std::vector<Span>& spans);
 
 // Returns the direction vector for a particular orientation.
 Vec2F GetDirectionVector(Orientation orientation);
@@ -150,6 +265,73 @@ Vec2F GetDirectionVector(Orientation orientation);
 // Returns orientation rotated by 90 degrees clockwise.
 Orientation RotateClockwise90(Orientation orientation);
 
+template <typename Predicate>
+int PointGrid::FindNearestInDirection(const Point& origin,
+                                      Orientation direction,
+                                      const Span& lateral_span,
+                                      float max_distance,
+                                      Predicate predicate) const {
+  if (point_indices_.empty() || !(max_distance > 0.0f)) return -1;
+  const Vec2F forward = GetDirectionVector(direction);
+  const Vec2F sideways = GetDirectionVector(RotateClockwise90(direction));
+  const Point end(origin.x + forward.x * max_distance,
+                  origin.y + forward.y * max_distance);
+  const Vec2F lateral_min = sideways * lateral_span.min;
+  const Vec2F lateral_max = sideways * lateral_span.max;
+  // The lines of cells are columns when direction is horizontal, rows
+  // otherwise. The cells of a line are [first_cell, first_cell + num_cells *
+  // cell_stride) with a stride of cell_stride.
+  const bool horizontal = forward.y == 0.0f;
+  int line = 0;
+  int last_line = 0;
+  int first_cell = 0;
+  int num_cells = 0;
+  int cell_stride = 0;
+  if (horizontal) {
+    line = GetColumn(origin.x);
+    last_line = GetColumn(end.x);
+    const int first_row = GetRow(std::min(lateral_min.y, lateral_max.y));
+    const int last_row = GetRow(std::max(lateral_min.y, lateral_max.y));
+    first_cell = first_row * num_columns_;
+    num_cells = last_row - first_row + 1;
+    cell_stride = num_columns_;
+  } else {
+    line = GetRow(origin.y);
+    last_line = GetRow(end.y);
+    const int first_column = GetColumn(std::min(lateral_min.x, lateral_max.x));
+    const int last_column = GetColumn(std::max(lateral_min.x, lateral_max.x));
+    first_cell = first_column;
+    num_cells = last_column - first_column + 1;
+    cell_stride = 1;
+  }
+  const int line_step = line <= last_line ? 1 : -1;
+  const int line_stride = horizontal ? 1 : num_columns_;
+  int best_index = -1;
+  float best_distance = 0.0f;
+  for (;; line += line_step) {
+    for (int i = 0; i < num_cells; ++i) {
+      const int cell = first_cell + line * line_stride + i * cell_stride;
+      for (uint32_t j = cell_offsets_[cell]; j < cell_offsets_[cell + 1]; ++j) {
+        const Point& point = point_positions_[j];
+        const float distance = (point - origin).dot_product(forward);
+        if (distance <= 0.0f || distance > max_distance) continue;
+        const float lateral = Vec2F(point.x, point.y).dot_product(sideways);
+        if (lateral < lateral_span.min || lateral > lateral_span.max) continue;
+        const int index = point_indices_[j];
+        if (best_index >= 0 &&
+            (distance > best_distance ||
+             (distance == best_distance && index > best_index))) {
+          continue;
+        }
+        if (!predicate(index)) continue;
+        best_index = index;
+        best_distance = distance;
+      }
+    }
+    if (best_index >= 0 || line == last_line) return best_index;
+  }
+}
+
 }  // namespace pdf
 }  // namespace x86
 }  // namespace cpu_instructions
@@ -0,0 +1,221 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks of the spatial algorithms used by the clustering:
+// - compares the QuadTree and PointGrid spatial indices on the character
+//   centers of real pages, using the queries made by ClusterCharacters,
+// - compares GetIntersectingSpanClusters with testing all pairs of spans, as
+//   ClusterRows and ClusterColumns used to do, on synthetic table rows of
+//   increasing sizes.
+// Run it in optimized mode:
+//   bazel run -c opt //cpu_instructions/x86/pdf:geometry_benchmark --
+//       --cpu_instructions_pdf_document=/path/to/pdf_document.pbtxt
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_instructions/util/proto_util.h"
+#include "cpu_instructions/x86/pdf/geometry.h"
+#include "cpu_instructions/x86/pdf/pdf_document.pb.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "strings/string.h"
+#include "util/graph/connected_components.h"
+
+DEFINE_string(
+    cpu_instructions_pdf_document,
+    "cpu_instructions/x86/pdf/testdata/253666_p170_p171_pdfdoc.pbtxt",
+    "The PdfDocument in text format whose pages are indexed.");
+DEFINE_int32(cpu_instructions_num_iterations, 100,
+             "The number of times each page is indexed and queried.");
+DEFINE_int32(cpu_instructions_max_num_spans, 50000,
+             "The largest number of spans clustered by the scaling benchmark.");
+DEFINE_int32(cpu_instructions_max_num_spans_all_pairs, 20000,
+             "The largest number of spans clustered by testing all pairs.");
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// The points and query ranges of a page, as in ClusterCharacters.
+struct PageQueries {
+  BoundingBox page;
+  float median_font_size = 1.0f;
+  std::vector<Point> centers;
+  std::vector<BoundingBox> ranges;
+};
+
+PageQueries GetPageQueries(const PdfPage& page) {
+  PageQueries result;
+  result.page = CreateBox(0, 0, page.width(), page.height());
+  std::vector<float> font_sizes;
+  for (const auto& character : page.characters()) {
+    const Point center = GetCenter(character.bounding_box());
+    const float size = character.font_size() * 2.0f;
+    result.centers.push_back(center);
+    result.ranges.push_back(CreateBox(center, size, size));
+    if (character.font_size() > 0.0f) {
+      font_sizes.push_back(character.font_size());
+    }
+  }
+  if (!font_sizes.empty()) {
+    const auto median = font_sizes.begin() + font_sizes.size() / 2;
+    std::nth_element(font_sizes.begin(), median, font_sizes.end());
+    result.median_font_size = *median;
+  }
+  return result;
+}
+
+// Accumulates the build and query times of an index over all pages.
+struct Timings {
+  double build_seconds = 0.0;
+  double query_seconds = 0.0;
+  int64_t num_results = 0;
+};
+
+void RunQuadTree(const PageQueries& queries, Timings* timings) {
+  const auto start = Clock::now();
+  QuadTree tree(queries.page);
+  for (size_t i = 0; i < queries.centers.size(); ++i) {
+    tree.Insert(i, queries.centers[i]);
+  }
+  const auto built = Clock::now();
+  Indices indices;
+  for (const auto& range : queries.ranges) {
+    indices.clear();
+    tree.QueryRange(range, &indices);
+    timings->num_results += indices.size();
+  }
+  const auto end = Clock::now();
+  timings->build_seconds += std::chrono::duration<double>(built - start).count();
+  timings->query_seconds += std::chrono::duration<double>(end - built).count();
+}
+
+void RunPointGrid(const PageQueries& queries, Timings* timings) {
+  const auto start = Clock::now();
+  const PointGrid grid(queries.page, 2.0f * queries.median_font_size,
+                       queries.centers);
+  const auto built = Clock::now();
+  int64_t num_results = 0;
+  for (const auto& range : queries.ranges) {
+    grid.ForEachPointInRange(range, [&num_results](size_t) { ++num_results; });
+  }
+  const auto end = Clock::now();
+  timings->num_results += num_results;
+  timings->build_seconds += std::chrono::duration<double>(built - start).count();
+  timings->query_seconds += std::chrono::duration<double>(end - built).count();
+}
+
+void Report(const string& name, const Timings& timings, int64_t num_queries) {
+  LOG(INFO) << name << ": build " << 1e9 * timings.build_seconds / num_queries
+            << " ns/point, query "
+            << 1e9 * timings.query_seconds / num_queries << " ns/query, "
+            << timings.num_results << " results";
+}
+
+// Returns the vertical spans of the blocks of a synthetic table with
+// num_blocks blocks: rows of 5 cells of random heights, where some cells span
+// two rows.
+std::vector<Span> GetTableRowSpans(int num_blocks) {
+  std::vector<Span> spans;
+  uint32_t state = 1;
+  const auto next_random = [&state](int modulo) {
+    state = state * 1103515245 + 12345;
+    return static_cast<int>((state >> 8) % modulo);
+  };
+  constexpr const float kRowHeight = 12.0f;
+  for (int i = 0; i < num_blocks; ++i) {
+    const float top = kRowHeight * (i / 5);
+    const float height =
+        next_random(8) + (next_random(10) == 0 ? kRowHeight : 1.0f);
+    spans.emplace_back(top, top + height);
+  }
+  // The blocks are not in reading order in the page.
+  for (int i = num_blocks - 1; i > 0; --i) {
+    std::swap(spans[i], spans[next_random(i + 1)]);
+  }
+  return spans;
+}
+
+// The implementation of ClusterRows before the sweep.
+int GetAllPairsNumClusters(const std::vector<Span>& spans) {
+  DenseConnectedComponentsFinder finder;
+  finder.SetNumberOfNodes(spans.size());
+  for (size_t i = 0; i < spans.size(); ++i) {
+    for (size_t j = i + 1; j < spans.size(); ++j) {
+      if (spans[i].Intersects(spans[j])) finder.AddEdge(i, j);
+    }
+  }
+  return finder.GetNumberOfComponents();
+}
+
+void RunSpanClusteringScaling() {
+  for (const int num_spans : {1000, 2000, 5000, 10000, 20000, 50000}) {
+    if (num_spans > FLAGS_cpu_instructions_max_num_spans) break;
+    const std::vector<Span> spans = GetTableRowSpans(num_spans);
+    const auto start = Clock::now();
+    const int num_clusters = GetIntersectingSpanClusters(spans).size();
+    const std::chrono::duration<double> sweep = Clock::now() - start;
+    LOG(INFO) << num_spans << " spans, " << num_clusters
+              << " clusters: sweep " << 1e3 * sweep.count() << " ms";
+    if (num_spans > FLAGS_cpu_instructions_max_num_spans_all_pairs) continue;
+    const auto all_pairs_start = Clock::now();
+    CHECK_EQ(num_clusters, GetAllPairsNumClusters(spans));
+    const std::chrono::duration<double> all_pairs =
+        Clock::now() - all_pairs_start;
+    LOG(INFO) << num_spans << " spans: all pairs "
+              << 1e3 * all_pairs.count() << " ms";
+  }
+}
+
+void Main() {
+  const auto document =
+      ReadTextProtoOrDie<PdfDocument>(FLAGS_cpu_instructions_pdf_document);
+  std::vector<PageQueries> pages;
+  int64_t num_queries = 0;
+  for (const auto& page : document.pages()) {
+    pages.push_back(GetPageQueries(page));
+    num_queries += pages.back().ranges.size();
+  }
+  num_queries *= FLAGS_cpu_instructions_num_iterations;
+  Timings quad_tree;
+  Timings point_grid;
+  for (int i = 0; i < FLAGS_cpu_instructions_num_iterations; ++i) {
+    for (const auto& page : pages) {
+      RunQuadTree(page, &quad_tree);
+      RunPointGrid(page, &point_grid);
+    }
+  }
+  CHECK_EQ(quad_tree.num_results, point_grid.num_results);
+  Report("QuadTree", quad_tree, std::max<int64_t>(num_queries, 1));
+  Report("PointGrid", point_grid, std::max<int64_t>(num_queries, 1));
+
+  RunSpanClusteringScaling();
+}
+
+}  // namespace
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cpu_instructions::x86::pdf::Main();
+  return 0;
+}
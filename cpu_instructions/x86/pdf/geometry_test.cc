@@ -14,7 +14,11 @@
 
 #include "cpu_instructions/x86/pdf/geometry.h"
 
+#include <algorithm>
+#include <cstdint>
+
 #include "gtest/gtest.h"
+#include "util/graph/connected_components.h"
 
 namespace cpu_instructions {
 namespace x86 {
@@ -88,6 +92,23 @@ TEST(GeometryTest, BoundingBoxIntersects) {
                           CreateBox(3.0f, 3.0f, 4.0f, 4.0f)));
 }
 
+TEST(GeometryTest, BoundingBoxIntersectionArea) {
+  EXPECT_FLOAT_EQ(GetIntersectionArea(CreateBox(1.0f, 1.0f, 3.0f, 3.0f),
+                                      CreateBox(1.0f, 1.0f, 3.0f, 3.0f)),
+                  4.0f);
+  EXPECT_FLOAT_EQ(GetIntersectionArea(CreateBox(1.0f, 1.0f, 3.0f, 3.0f),
+                                      CreateBox(2.0f, 0.0f, 4.0f, 2.5f)),
+                  1.5f);
+  // Boxes share an edge.
+  EXPECT_FLOAT_EQ(GetIntersectionArea(CreateBox(1.0f, 1.0f, 2.0f, 2.0f),
+                                      CreateBox(2.0f, 1.0f, 3.0f, 2.0f)),
+                  0.0f);
+  // Boxes are disjoint.
+  EXPECT_FLOAT_EQ(GetIntersectionArea(CreateBox(1.0f, 1.0f, 2.0f, 2.0f),
+                                      CreateBox(3.0f, 3.0f, 4.0f, 4.0f)),
+                  0.0f);
+}
+
 TEST(GeometryTest, BoundingBoxCenter) {
   const Point center = GetCenter(CreateBox(1.0f, 1.0f, 2.0f, 3.0f));
   EXPECT_EQ(center.x, 1.5f);
@@ -205,6 +226,168 @@ TEST(GeometryTest, QuadTreeQuadrant) {
   }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// PointGrid
+
+Indices GetSortedRange(const PointGrid& grid, const BoundingBox& range) {
+  Indices indices;
+  grid.QueryRange(range, &indices);
+  std::sort(indices.begin(), indices.end());
+  return indices;
+}
+
+TEST(GeometryTest, PointGrid) {
+  const BoundingBox area = CreateBox(1.0f, 1.0f, 10.0f, 10.0f);
+  // Empty grid.
+  EXPECT_TRUE(GetSortedRange(PointGrid(area, 1.0f, {}), area).empty());
+  // Points outside of area are ignored.
+  const PointGrid grid(area, 1.0f, {Point(11.0f, 11.0f), Point(5.0f, 5.0f),
+                                    Point(0.0f, 5.0f), Point(10.0f, 10.0f)});
+  EXPECT_EQ(GetSortedRange(grid, area), Indices({1, 3}));
+  EXPECT_EQ(GetSortedRange(grid, CreateBox(-100.0f, -100.0f, 100.0f, 100.0f)),
+            Indices({1, 3}));
+  // Querying an area with no points.
+  EXPECT_TRUE(GetSortedRange(grid, CreateBox(1.0f, 1.0f, 2.0f, 2.0f)).empty());
+  EXPECT_TRUE(
+      GetSortedRange(grid, CreateBox(20.0f, 20.0f, 30.0f, 30.0f)).empty());
+  // Bounds are included.
+  EXPECT_EQ(GetSortedRange(grid, CreateBox(5.0f, 5.0f, 5.0f, 5.0f)),
+            Indices({1}));
+  EXPECT_EQ(GetSortedRange(grid, CreateBox(10.0f, 10.0f, 10.0f, 10.0f)),
+            Indices({3}));
+}
+
+TEST(GeometryTest, PointGridBoundsNumberOfCells) {
+  const BoundingBox area = CreateBox(0.0f, 0.0f, 1000.0f, 1000.0f);
+  const PointGrid grid(area, 0.001f, {Point(1.0f, 1.0f), Point(999.0f, 1.0f)});
+  EXPECT_LE(grid.num_columns() * grid.num_rows(), 9);
+  EXPECT_EQ(GetSortedRange(grid, CreateBox(0.0f, 0.0f, 2.0f, 2.0f)),
+            Indices({0}));
+  EXPECT_EQ(GetSortedRange(grid, CreateBox(998.0f, 0.0f, 1000.0f, 2.0f)),
+            Indices({1}));
+}
+
+TEST(GeometryTest, PointGridMatchesQuadTree) {
+  const BoundingBox area = CreateBox(0.0f, 0.0f, 100.0f, 50.0f);
+  QuadTree tree(area);
+  std::vector<Point> points;
+  // A deterministic pseudo-random set of points, with duplicates and points on
+  // the cell boundaries.
+  uint32_t state = 1;
+  for (size_t i = 0; i < 1000; ++i) {
+    state = state * 1103515245 + 12345;
+    const float x = (state >> 8) % 1001 / 10.0f;
+    state = state * 1103515245 + 12345;
+    const float y = (state >> 8) % 501 / 10.0f;
+    points.emplace_back(x, y);
+    tree.Insert(i, points.back());
+  }
+  const PointGrid grid(area, 4.0f, points);
+  for (float left = -5.0f; left < 100.0f; left += 7.5f) {
+    for (float top = -5.0f; top < 50.0f; top += 4.5f) {
+      for (float size : {0.5f, 4.0f, 12.0f}) {
+        const BoundingBox range = CreateBox(left, top, left + size, top + size);
+        Indices expected;
+        tree.QueryRange(range, &expected);
+        std::sort(expected.begin(), expected.end());
+        EXPECT_EQ(GetSortedRange(grid, range), expected)
+            << range.ShortDebugString();
+      }
+    }
+  }
+}
+
+TEST(GeometryTest, PointGridFindNearestInDirection) {
+  const BoundingBox area = CreateBox(0.0f, 0.0f, 10.0f, 10.0f);
+  const PointGrid grid(area, 1.0f, {Point(5.0f, 5.0f), Point(7.0f, 5.0f),
+                                    Point(6.0f, 5.5f), Point(6.0f, 4.5f),
+                                    Point(5.0f, 8.0f)});
+  const auto any = [](size_t) { return true; };
+  // The lateral span is along the direction rotated clockwise. Ties are broken
+  // by the smallest index.
+  EXPECT_EQ(grid.FindNearestInDirection(Point(5.0f, 5.0f), EAST,
+                                        Span(4.5f, 5.5f), 5.0f, any),
+            2);
+  EXPECT_EQ(grid.FindNearestInDirection(Point(5.0f, 5.0f), EAST,
+                                        Span(4.5f, 5.0f), 5.0f, any),
+            3);
+  EXPECT_EQ(grid.FindNearestInDirection(Point(5.0f, 5.0f), EAST,
+                                        Span(4.9f, 5.1f), 5.0f, any),
+            1);
+  // The origin and the points behind it are not candidates.
+  EXPECT_EQ(grid.FindNearestInDirection(Point(7.0f, 5.0f), EAST,
+                                        Span(4.0f, 6.0f), 5.0f, any),
+            -1);
+  EXPECT_EQ(grid.FindNearestInDirection(Point(7.0f, 5.0f), WEST,
+                                        Span(-6.0f, -4.0f), 5.0f, any),
+            2);
+  // Points further than max_distance are not candidates.
+  EXPECT_EQ(grid.FindNearestInDirection(Point(5.0f, 5.0f), SOUTH,
+                                        Span(-5.5f, -4.5f),
+                                        2.0f, any),
+            -1);
+  EXPECT_EQ(grid.FindNearestInDirection(Point(5.0f, 5.0f), SOUTH,
+                                        Span(-5.5f, -4.5f),
+                                        3.0f, any),
+            4);
+  EXPECT_EQ(grid.FindNearestInDirection(Point(5.0f, 8.0f), NORTH,
+                                        Span(4.5f, 5.5f), 5.0f, any),
+            0);
+  // The predicate filters the candidates.
+  const auto not_2 = [](size_t index) { return index != 2; };
+  EXPECT_EQ(grid.FindNearestInDirection(Point(5.0f, 5.0f), EAST,
+                                        Span(4.0f, 6.0f), 5.0f, not_2),
+            3);
+}
+
+TEST(GeometryTest, PointGridFindNearestInDirectionMatchesBruteForce) {
+  const BoundingBox area = CreateBox(0.0f, 0.0f, 100.0f, 50.0f);
+  std::vector<Point> points;
+  // A deterministic pseudo-random set of points, with duplicates and points on
+  // the cell boundaries.
+  uint32_t state = 1;
+  for (size_t i = 0; i < 1000; ++i) {
+    state = state * 1103515245 + 12345;
+    const float x = (state >> 8) % 1001 / 10.0f;
+    state = state * 1103515245 + 12345;
+    const float y = (state >> 8) % 501 / 10.0f;
+    points.emplace_back(x, y);
+  }
+  const PointGrid grid(area, 4.0f, points);
+  // Skips one point out of three.
+  const auto predicate = [](size_t index) { return index % 3 != 0; };
+  for (const Orientation direction : {NORTH, EAST, SOUTH, WEST}) {
+    const Vec2F forward = GetDirectionVector(direction);
+    const Vec2F sideways = GetDirectionVector(RotateClockwise90(direction));
+    for (const Point& origin : points) {
+      for (const float size : {0.5f, 3.0f, 12.0f}) {
+        const float lateral = Vec2F(origin.x, origin.y).dot_product(sideways);
+        const Span lateral_span(lateral - size * 0.5f, lateral + size * 0.5f);
+        int expected = -1;
+        float min_distance = 0.0f;
+        for (size_t i = 0; i < points.size(); ++i) {
+          const float distance = (points[i] - origin).dot_product(forward);
+          const float point_lateral =
+              Vec2F(points[i].x, points[i].y).dot_product(sideways);
+          if (distance <= 0.0f || distance > size ||
+              point_lateral < lateral_span.min ||
+              point_lateral > lateral_span.max || !predicate(i)) {
+            continue;
+          }
+          if (expected < 0 || distance < min_distance) {
+            expected = i;
+            min_distance = distance;
+          }
+        }
+        EXPECT_EQ(grid.FindNearestInDirection(origin, direction, lateral_span,
+                                              size, predicate),
+                  expected)
+            << direction << " " << origin.x << " " << origin.y << " " << size;
+      }
+    }
+  }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Span
 
@@ -240,6 +423,43 @@ TEST(GeometryTest, GetSpan) {
   EXPECT_EQ(span_v.max, 4.0f);
 }
 
+TEST(GeometryTest, GetIntersectingSpanClusters) {
+  EXPECT_TRUE(GetIntersectingSpanClusters({}).empty());
+  // Bounds are included, and clusters are sorted by their first index.
+  EXPECT_EQ(GetIntersectingSpanClusters({Span(5.0f, 6.0f), Span(0.0f, 1.0f),
+                                         Span(6.0f, 7.0f), Span(1.5f, 2.0f)}),
+            std::vector<Indices>({{0, 2}, {1}, {3}}));
+  // A long span links spans that do not intersect each other.
+  EXPECT_EQ(GetIntersectingSpanClusters({Span(0.0f, 1.0f), Span(3.0f, 4.0f),
+                                         Span(10.0f, 11.0f), Span(0.5f, 3.5f)}),
+            std::vector<Indices>({{0, 1, 3}, {2}}));
+}
+
+TEST(GeometryTest, GetIntersectingSpanClustersMatchesAllPairs) {
+  std::vector<Span> spans;
+  uint32_t state = 1;
+  for (size_t i = 0; i < 500; ++i) {
+    state = state * 1103515245 + 12345;
+    const float min = (state >> 8) % 2000 / 2.0f;
+    state = state * 1103515245 + 12345;
+    const float length = (state >> 8) % 10 / 4.0f;
+    spans.emplace_back(min, min + length);
+  }
+  DenseConnectedComponentsFinder finder;
+  finder.SetNumberOfNodes(spans.size());
+  for (size_t i = 0; i < spans.size(); ++i) {
+    for (size_t j = i + 1; j < spans.size(); ++j) {
+      if (spans[i].Intersects(spans[j])) finder.AddEdge(i, j);
+    }
+  }
+  std::vector<Indices> expected(finder.GetNumberOfComponents());
+  const std::vector<int> component_ids = finder.GetComponentIds();
+  for (size_t i = 0; i < component_ids.size(); ++i) {
+    expected[component_ids[i]].push_back(i);
+  }
+  EXPECT_EQ(GetIntersectingSpanClusters(spans), expected);
+}
+
 }  // namespace
 
 }  // namespace pdf
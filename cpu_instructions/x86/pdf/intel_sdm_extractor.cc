@@ -15,6 +15,7 @@
 #include "cpu_instructions/x86/pdf/intel_sdm_extractor.h"
 
 #include <algorithm>
+#include <cstdint>
 #include <map>
 #include <set>
 #include <unordered_map>
@@ -22,6 +23,8 @@
 #include <utility>
 #include <vector>
 
+#include "cpu_instructions/util/fingerprint.h"
+#include "cpu_instructions/util/telemetry.h"
 #include "cpu_instructions/x86/pdf/pdf_document_utils.h"
 #include "cpu_instructions/x86/pdf/vendor_syntax.h"
 #include "glog/logging.h"
@@ -110,8 +113,7 @@ const string& GetFooterSectionName(const PdfPage& page) {
 // If 'page' is the first page of an instruction, returns a unique identifier
 // for this instruction. Otherwise return empty string.
 string GetInstructionGroupId(const PdfPage& page) {
-  if (!strings::StartsWith(GetCellTextOrEmpty(page, 0, 0), kInstructionSetRef))
-    return {};
+  if (!IsInstructionSetReferencePage(page)) return {};
   const string maybe_instruction = Normalize(GetCellTextOrEmpty(page, 1, 0));
   const string& footer_section_name = GetFooterSectionName(page);
   if (maybe_instruction == Normalize(footer_section_name)) {
@@ -616,6 +618,29 @@ std::vector<SubSection> ExtractSubSectionRows(const Pages& pages) {
   return output;
 }
 
+// Changed whenever the extraction produces different instruction groups from
+// the same rows, so that the groups extracted by older versions are not
+// reused.
+constexpr const uint64_t kExtractorVersion = 1;
+
+// Returns a fingerprint of the rows ExtractSubSectionRows reads from pages:
+// their text, and whether they are subsection titles, which also depends on
+// the font size. Page numbers and layout are not part of it, so that the
+// fingerprint does not change when the group moves in a new revision of the
+// SDM.
+uint64_t GetInstructionGroupFingerprint(const Pages& pages) {
+  Fingerprint fingerprint;
+  fingerprint.AddUint64(kExtractorVersion);
+  for (const auto* page : pages) {
+    for (const auto* row : GetPageBodyRows(*page, kPageMargin)) {
+      fingerprint.AddUint64(row->blocks_size());
+      fingerprint.AddUint64(!GetSubSectionTitle(*row).empty());
+      for (const auto& block : row->blocks()) fingerprint.Add(block.text());
+    }
+  }
+  return fingerprint.value();
+}
+
 // This function sets the proper encoding for each instruction by looking it up
 // in the Operand Encoding Table. Duplicated identifiers in the Operand Encoding
 // Table are discarded and encoding is set to ANY_ENCODING.
@@ -746,6 +771,15 @@ void ProcessSubSections(std::vector<SubSection> sub_sections,
 
 }  // namespace
 
+bool IsInstructionSetReferencePage(const PdfPage& page) {
+  return strings::StartsWith(GetCellTextOrEmpty(page, 0, 0),
+                             kInstructionSetRef);
+}
+
+string GetPageInstructionGroupName(const PdfPage& page) {
+  return Normalize(GetFooterSectionName(page));
+}
+
 OperandEncoding ParseOperandEncodingTableCell(const string& content) {
   OperandEncoding::OperandEncodingSpec spec = OperandEncoding::OE_NA;
   const RE2* const regexp =
@@ -800,6 +834,17 @@ OperandEncoding ParseOperandEncodingTableCell(const string& content) {
 }
 
 SdmDocument ConvertPdfDocumentToSdmDocument(const PdfDocument& pdf) {
+  return ConvertPdfDocumentToSdmDocument(pdf, SdmDocument(), nullptr);
+}
+
+SdmDocument ConvertPdfDocumentToSdmDocument(
+    const PdfDocument& pdf, const SdmDocument& previous_document,
+    std::vector<string>* extracted_group_ids) {
+  std::unordered_map<string, const InstructionSection*> previous_sections;
+  for (const auto& section : previous_document.instruction_sections()) {
+    previous_sections[section.id()] = &section;
+  }
+
   // Find all instruction pages.
   SdmDocument sdm_document;
   std::map<string, Pages> instruction_group_id_to_pages;
@@ -811,14 +856,28 @@ SdmDocument ConvertPdfDocumentToSdmDocument(const PdfDocument& pdf) {
   }
   // Now processing instruction pages
   for (const auto& id_pages_pair : instruction_group_id_to_pages) {
-    InstructionSection section;
     const auto& group_id = id_pages_pair.first;
     const auto& pages = id_pages_pair.second;
+    const uint64_t fingerprint = GetInstructionGroupFingerprint(pages);
+    const InstructionSection* const* const previous_section =
+        FindOrNull(previous_sections, group_id);
+    if (previous_section != nullptr &&
+        (*previous_section)->fingerprint() == fingerprint) {
+      *sdm_document.add_instruction_sections() = **previous_section;
+      Telemetry::Get()->AddToCounter("reused_instruction_groups", 1);
+      continue;
+    }
+    ScopedStageTimer timer("extract_instruction_group");
+    InstructionSection section;
     LOG(INFO) << "Processing section id " << group_id << " pages "
               << pages.front()->number() << "-" << pages.back()->number();
     section.set_id(group_id);
+    section.set_fingerprint(fingerprint);
     ProcessSubSections(ExtractSubSectionRows(pages), &section);
     section.Swap(sdm_document.add_instruction_sections());
+    if (extracted_group_ids != nullptr) {
+      extracted_group_ids->push_back(group_id);
+    }
   }
   return sdm_document;
 }
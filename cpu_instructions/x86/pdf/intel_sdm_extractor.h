@@ -15,6 +15,7 @@
 #ifndef CPU_INSTRUCTIONS_X86_PDF_INTEL_SDM_EXTRACTOR_H_
 #define CPU_INSTRUCTIONS_X86_PDF_INTEL_SDM_EXTRACTOR_H_
 
+#include <vector>
 #include "strings/string.h"
 
 #include "cpu_instructions/proto/instructions.pb.h"
@@ -27,6 +28,25 @@ namespace pdf {
 
 SdmDocument ConvertPdfDocumentToSdmDocument(const PdfDocument& document);
 
+// Same as above, but the sections of previous_document (typically extracted
+// from an earlier revision of the SDM) whose id and fingerprint are the same
+// as those of an instruction group of document are reused instead of being
+// extracted again. The ids of the groups that were extracted are appended to
+// extracted_group_ids, if not null.
+SdmDocument ConvertPdfDocumentToSdmDocument(
+    const PdfDocument& document, const SdmDocument& previous_document,
+    std::vector<string>* extracted_group_ids);
+
+// Returns whether the page belongs to the instruction set reference, based on
+// its header only. This works on pages where only the margins were parsed (see
+// XPDFDoc::ParseMargins) and is used to skip the other pages early.
+bool IsInstructionSetReferencePage(const PdfPage& page);
+
+// Returns the normalized name of the instruction group the page belongs to,
+// according to its footer. The consecutive pages of an instruction group have
+// the same name. This works on pages where only the margins were parsed.
+string GetPageInstructionGroupName(const PdfPage& page);
+
 InstructionSetProto ProcessIntelSdmDocument(const SdmDocument& sdm_document);
 
 // Parses the contents of an operand encoding cell.
@@ -14,8 +14,11 @@
 
 #include "cpu_instructions/x86/pdf/intel_sdm_extractor.h"
 
+#include <vector>
+
 #include "cpu_instructions/testing/test_util.h"
 #include "cpu_instructions/util/proto_util.h"
+#include "cpu_instructions/x86/pdf/pdf_document_utils.h"
 #include "cpu_instructions/x86/pdf/pdf_document_parser.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -27,6 +30,8 @@ namespace pdf {
 namespace {
 
 using ::cpu_instructions::testing::EqualsProto;
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
 
 const char kTestDataPath[] = "/__main__/cpu_instructions/x86/pdf/testdata/";
 
@@ -53,6 +58,86 @@ TEST(IntelSdmExtractorTest, BitSetPage) {
                                    "253666_p170_p171_instructionset")));
 }
 
+TEST(IntelSdmExtractorTest, ReuseUnchangedSections) {
+  PdfDocument pdf_document = GetProto<PdfDocument>("253666_p170_p171_pdfdoc");
+  for (auto& page : *pdf_document.mutable_pages()) {
+    Cluster(&page);
+  }
+  const SdmDocument expected = GetProto<SdmDocument>("253666_p170_p171_sdmdoc");
+  ASSERT_EQ(expected.instruction_sections_size(), 1);
+  const string& group_id = expected.instruction_sections(0).id();
+
+  std::vector<string> extracted_group_ids;
+  EXPECT_THAT(ConvertPdfDocumentToSdmDocument(pdf_document, SdmDocument(),
+                                              &extracted_group_ids),
+              EqualsProto(expected));
+  EXPECT_THAT(extracted_group_ids, ElementsAre(group_id));
+
+  // The section is taken from the previous document as is, even if it is not
+  // what the extraction would produce.
+  SdmDocument previous_document = expected;
+  previous_document.mutable_instruction_sections(0)->clear_sub_sections();
+  extracted_group_ids.clear();
+  EXPECT_THAT(ConvertPdfDocumentToSdmDocument(pdf_document, previous_document,
+                                              &extracted_group_ids),
+              EqualsProto(previous_document));
+  EXPECT_THAT(extracted_group_ids, IsEmpty());
+
+  // The section is extracted again when the text of the pages changes.
+  string* const text =
+      GetMutableCellTextOrNull(pdf_document.mutable_pages(1), 3, 0);
+  ASSERT_NE(text, nullptr);
+  text->append(" (changed)");
+  const SdmDocument sdm_document = ConvertPdfDocumentToSdmDocument(
+      pdf_document, previous_document, &extracted_group_ids);
+  EXPECT_THAT(extracted_group_ids, ElementsAre(group_id));
+  EXPECT_THAT(sdm_document,
+              EqualsProto(ConvertPdfDocumentToSdmDocument(pdf_document)));
+  EXPECT_NE(sdm_document.instruction_sections(0).fingerprint(),
+            expected.instruction_sections(0).fingerprint());
+}
+
+TEST(IntelSdmExtractorTest, ReuseDependsOnSubSectionTitles) {
+  PdfDocument pdf_document = GetProto<PdfDocument>("253666_p170_p171_pdfdoc");
+  for (auto& page : *pdf_document.mutable_pages()) {
+    Cluster(&page);
+  }
+  SdmDocument previous_document =
+      ConvertPdfDocumentToSdmDocument(pdf_document);
+  ASSERT_EQ(previous_document.instruction_sections_size(), 1);
+  const string group_id = previous_document.instruction_sections(0).id();
+  previous_document.mutable_instruction_sections(0)->clear_sub_sections();
+
+  // Makes the "Description" title too small to be a title. The text of the
+  // pages does not change, but the section does.
+  PdfTextBlock* title = nullptr;
+  for (auto& page : *pdf_document.mutable_pages()) {
+    for (auto& row : *page.mutable_rows()) {
+      if (row.blocks_size() == 1 && row.blocks(0).text() == "Description") {
+        title = row.mutable_blocks(0);
+      }
+    }
+  }
+  ASSERT_NE(title, nullptr);
+  title->set_font_size(8.0f);
+  std::vector<string> extracted_group_ids;
+  const SdmDocument sdm_document = ConvertPdfDocumentToSdmDocument(
+      pdf_document, previous_document, &extracted_group_ids);
+  EXPECT_THAT(extracted_group_ids, ElementsAre(group_id));
+  EXPECT_THAT(sdm_document,
+              EqualsProto(ConvertPdfDocumentToSdmDocument(pdf_document)));
+}
+
+TEST(IntelSdmExtractorTest, IsInstructionSetReferencePage) {
+  PdfDocument pdf_document = GetProto<PdfDocument>("253666_p170_p171_pdfdoc");
+  ASSERT_EQ(pdf_document.pages_size(), 2);
+  for (auto& page : *pdf_document.mutable_pages()) {
+    Cluster(&page);
+    EXPECT_TRUE(IsInstructionSetReferencePage(page));
+  }
+  EXPECT_FALSE(IsInstructionSetReferencePage(PdfPage()));
+}
+
 TEST(IntelSdmExtractorTest, ParseOperandEncodingTableCell) {
   EXPECT_THAT(ParseOperandEncodingTableCell("NA"), EqualsProto("spec: OE_NA"));
 
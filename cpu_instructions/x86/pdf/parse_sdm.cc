@@ -15,23 +15,98 @@
 #include "cpu_instructions/x86/pdf/parse_sdm.h"
 
 #include <stdio.h>
+#include <unistd.h>
 #include <algorithm>
 #include <fstream>
 #include <functional>
 #include <memory>
+#include <set>
+#include <vector>
 #include "strings/string.h"
 
+#include "gflags/gflags.h"
+
+#include "cpu_instructions/util/background_proto_writer.h"
+#include "cpu_instructions/util/parallel_for.h"
 #include "cpu_instructions/util/proto_util.h"
+#include "cpu_instructions/x86/pdf/compact_pdf_document.h"
 #include "cpu_instructions/x86/pdf/intel_sdm_extractor.h"
 #include "cpu_instructions/x86/pdf/pdf_document_utils.h"
+#include "cpu_instructions/x86/pdf/pdf_page_cache.h"
+#include "cpu_instructions/x86/pdf/pdf_page_stream.h"
+#include "cpu_instructions/x86/pdf/pdf_parse_checkpoint.h"
+#include "cpu_instructions/x86/pdf/sdm_shards.h"
 #include "cpu_instructions/x86/pdf/xpdf_util.h"
 #include "glog/logging.h"
 #include "re2/re2.h"
 #include "strings/str_cat.h"
+#include "strings/str_join.h"
 #include "strings/str_split.h"
 #include "util/gtl/map_util.h"
 #include "util/gtl/ptr_util.h"
 
+DEFINE_int32(cpu_instructions_parallelism, 1,
+             "The maximum number of threads used to parse the SDM. Input "
+             "specs are processed concurrently, remaining threads are used to "
+             "parse the pages of each spec in parallel.");
+DEFINE_int32(cpu_instructions_clustering_threads, 0,
+             "If positive, the pages of each spec are clustered on a pool of "
+             "that many threads while xpdf renders the next pages. The "
+             "output does not depend on it.");
+DEFINE_bool(cpu_instructions_skip_non_instruction_pages, false,
+            "Only parse the pages of the instruction set reference. They are "
+            "located using the PDF outline and a quick look at the page "
+            "headers. The other pages are not useful to extract instructions "
+            "and are not written to the debug .pdf.pb files. The selection is "
+            "a heuristic: check that the output is the same as without this "
+            "flag before relying on it for a new revision of the SDM.");
+DEFINE_string(cpu_instructions_page_cache_dir, "",
+              "If not empty, parsed pages are cached in this directory. "
+              "Pages whose content and patches did not change since a "
+              "previous run are read from the cache instead of being parsed "
+              "again.");
+DEFINE_bool(cpu_instructions_write_debug_protos, true,
+            "Write the parsed PDF and SDM documents of each input spec to "
+            "<output_base>_<spec_id>.{pdf,sdm}.pb. They are written on a "
+            "background thread.");
+DEFINE_bool(cpu_instructions_compress_debug_protos, false,
+            "Gzip the debug protos, a '.gz' suffix is added to their names.");
+DEFINE_bool(cpu_instructions_compact_pdf_debug_protos, false,
+            "Write the parsed PDF documents in the compact format of "
+            "compact_pdf_document.h to <output_base>_<spec_id>.pdf.cpb instead "
+            "of .pdf.pb. Coordinates are rounded to 1/32 of a unit.");
+DEFINE_bool(cpu_instructions_checkpoint, false,
+            "Commit each parsed page to <output_base>_<spec_id>.pdf.checkpoint. "
+            "When a run that was interrupted is restarted with the same "
+            "flags, the pages in the checkpoint are not parsed again. The "
+            "checkpoints are removed once the instruction database is "
+            "written.");
+DEFINE_string(cpu_instructions_previous_output_base, "",
+              "The output base of a run on a previous revision of the SDM, "
+              "with the same input spec. Instruction groups whose pages have "
+              "the same text and subsection titles as in "
+              "<previous_output_base>_<spec_id>.sdm.pb are taken from it "
+              "instead of being extracted again. The extracted groups are "
+              "logged. Groups extracted by a different version of the "
+              "extractor are never reused.");
+DEFINE_bool(cpu_instructions_streaming, false,
+            "Bounded-memory mode: only the rows of the pages are kept once "
+            "they are parsed. Instead of the debug .pdf.pb file, the complete "
+            "pages are written as they are parsed to "
+            "<output_base>_<spec_id>.pdf.pages, as length-delimited PdfPage "
+            "protos.");
+DEFINE_int32(cpu_instructions_shard_index, 0,
+             "The index of the shard processed by this run, in "
+             "[0, --cpu_instructions_shard_count).");
+DEFINE_int32(cpu_instructions_shard_count, 1,
+             "The number of shards the parsing is split into. Each shard "
+             "parses a deterministic subset of the pages of every input spec "
+             "and writes the partial instruction set to <output_base>.pbtxt "
+             "and the partial SDM documents to <output_base>_<spec_id>.sdm.pb. "
+             "All shards must be run with the same flags and different output "
+             "bases, then merged with MergeSdmShardsOrDie, see "
+             "tools/merge_sdm_shards.cc.");
+
 namespace cpu_instructions {
 namespace x86 {
 namespace pdf {
@@ -39,6 +114,15 @@ namespace {
 
 constexpr const char kSourceName[] = "IntelSDMParser V2";
 
+// The top/bottom page margin, in pixels. Headers and footers lie within this
+// margin, see intel_sdm_extractor.cc.
+constexpr const float kPageMargin = 50.0f;
+
+// Matches the titles of the outline entries for the instruction set reference
+// chapters, e.g. "Chapter 3 Instruction Set Reference, A-L".
+const LazyRE2 kInstructionSetReferenceTitle = {
+    R"((?i)instruction set reference)"};
+
 InstructionSetSourceInfo CreateInstructionSetSourceInfo(
     const XPDFDoc::Metadata& map) {
   InstructionSetSourceInfo source_info;
@@ -77,11 +161,232 @@ std::vector<InputSpec> ParseInputSpec(const string& input_spec) {
   return parsed_specs;
 }
 
+// Returns the pages in [first_page, last_page] that are covered by the outline
+// entries for the instruction set reference chapters. Returns all pages in the
+// range if the outline has no such entries.
+std::vector<int> GetPagesFromOutline(const XPDFDoc& doc, int first_page,
+                                     int last_page) {
+  const std::vector<PdfOutlineEntry> outline = doc.GetOutline();
+  std::set<int> pages;
+  bool found_chapter = false;
+  for (size_t i = 0; i < outline.size(); ++i) {
+    const PdfOutlineEntry& entry = outline[i];
+    if (entry.page_number <= 0 ||
+        !RE2::PartialMatch(entry.title, *kInstructionSetReferenceTitle)) {
+      continue;
+    }
+    found_chapter = true;
+    // The chapter ends where the next entry of the same or a higher level
+    // starts. This page is kept as it may still belong to the chapter.
+    int chapter_last_page = doc.GetNumPages();
+    for (size_t j = i + 1; j < outline.size(); ++j) {
+      if (outline[j].depth <= entry.depth && outline[j].page_number > 0) {
+        chapter_last_page = std::max(outline[j].page_number, entry.page_number);
+        break;
+      }
+    }
+    for (int page = std::max(entry.page_number, first_page);
+         page <= std::min(chapter_last_page, last_page); ++page) {
+      pages.insert(page);
+    }
+  }
+  if (!found_chapter) {
+    LOG(INFO) << "No instruction set reference chapter in the PDF outline";
+    for (int page = first_page; page <= last_page; ++page) pages.insert(page);
+  }
+  return std::vector<int>(pages.begin(), pages.end());
+}
+
+bool IsSharded() { return FLAGS_cpu_instructions_shard_count > 1; }
+
+// Returns the pages of the input spec to parse. With
+// --cpu_instructions_skip_non_instruction_pages, only the pages that belong to
+// the instruction set reference are returned: candidate pages are first
+// selected from the outline, then only their headers are parsed to keep the
+// instruction pages. When sharded, only the pages of the shard are returned.
+std::vector<int> GetPagesToParse(const XPDFDoc& doc,
+                                 const InputSpec& input_spec, int num_threads) {
+  const int last_page =
+      input_spec.last_page <= 0 ? doc.GetNumPages() : input_spec.last_page;
+  std::vector<int> pages;
+  if (FLAGS_cpu_instructions_skip_non_instruction_pages) {
+    pages = GetPagesFromOutline(doc, input_spec.first_page, last_page);
+  } else {
+    for (int page = input_spec.first_page; page <= last_page; ++page) {
+      pages.push_back(page);
+    }
+  }
+  if (!FLAGS_cpu_instructions_skip_non_instruction_pages && !IsSharded()) {
+    return pages;
+  }
+
+  PdfDocument margins = doc.ParseMargins(pages, kPageMargin, num_threads);
+  if (FLAGS_cpu_instructions_skip_non_instruction_pages) {
+    PdfDocument instruction_pages;
+    for (PdfPage& page : *margins.mutable_pages()) {
+      if (IsInstructionSetReferencePage(page)) {
+        instruction_pages.add_pages()->Swap(&page);
+      }
+    }
+    LOG(INFO) << "Found " << instruction_pages.pages_size()
+              << " instruction pages (" << pages.size()
+              << " candidates from the outline) in " << input_spec.filename;
+    margins.Swap(&instruction_pages);
+  }
+  if (IsSharded()) {
+    pages = GetShardPageNumbers(margins, FLAGS_cpu_instructions_shard_index,
+                                FLAGS_cpu_instructions_shard_count);
+    LOG(INFO) << "Shard " << FLAGS_cpu_instructions_shard_index << " of "
+              << FLAGS_cpu_instructions_shard_count << " parses "
+              << pages.size() << " of " << margins.pages_size()
+              << " pages of " << input_spec.filename;
+    return pages;
+  }
+  pages.clear();
+  for (const PdfPage& page : margins.pages()) pages.push_back(page.number());
+  return pages;
+}
+
+string GetCheckpointFilename(const string& output_base, int spec_id) {
+  return StrCat(output_base, "_", spec_id, ".pdf.checkpoint");
+}
+
+string GetSdmDocumentFilename(const string& output_base, int spec_id) {
+  return StrCat(output_base, "_", spec_id, ".sdm.pb");
+}
+
+// Returns the name of the SDM document written for the spec by a run with the
+// given output base, compressed or not, or an empty string if there is none.
+string FindSdmDocumentFilename(const string& output_base, int spec_id) {
+  const string filename = GetSdmDocumentFilename(output_base, spec_id);
+  for (const string& candidate : {filename, StrCat(filename, ".gz")}) {
+    if (access(candidate.c_str(), R_OK) == 0) return candidate;
+  }
+  return {};
+}
+
+// Returns the SDM document written by a previous run with the given output
+// base, or an empty document if there is none.
+SdmDocument ReadPreviousSdmDocument(const string& previous_output_base,
+                                    int spec_id) {
+  const string filename =
+      FindSdmDocumentFilename(previous_output_base, spec_id);
+  if (filename.empty()) {
+    LOG(WARNING) << "No previous SDM document "
+                 << GetSdmDocumentFilename(previous_output_base, spec_id)
+                 << ", extracting all the instruction groups";
+    return SdmDocument();
+  }
+  LOG(INFO) << "Reading previous SDM document : " << filename;
+  return ReadBinaryProtoOrDie<SdmDocument>(filename);
+}
+
+// Schedules writing a debug proto with debug_proto_writer, unless it is null.
+void WriteDebugProto(BackgroundProtoWriter* debug_proto_writer,
+                     string filename,
+                     std::shared_ptr<const google::protobuf::Message> message) {
+  if (debug_proto_writer == nullptr) return;
+  if (FLAGS_cpu_instructions_compress_debug_protos) filename += ".gz";
+  LOG(INFO) << "Saving debug proto file : " << filename;
+  debug_proto_writer->WriteBinaryProto(
+      filename, std::move(message),
+      FLAGS_cpu_instructions_compress_debug_protos);
+}
+
+// Parses a single input spec and returns the corresponding instructions. The
+// debug protos are written as <output_base>_<spec_id>.{pdf,sdm}.pb with
+// debug_proto_writer, if not null.
+InstructionSetProto ProcessInputSpecOrDie(
+    const InputSpec& input_spec, int spec_id,
+    const PdfDocumentsChanges& patch_sets, const string& output_base,
+    const PdfParseOptions& options, BackgroundProtoWriter* debug_proto_writer) {
+  // Open document.
+  LOG(INFO) << "Opening PDF file : " << input_spec.filename;
+  const auto doc = XPDFDoc::OpenMappedOrDie(input_spec.filename);
+  const auto& pdf_document_id = doc->GetDocumentId();
+  const auto* config = GetConfigOrNull(patch_sets, pdf_document_id);
+  CHECK(config) << "Unsupported version. Metadata:\n"
+                << pdf_document_id.DebugString();
+
+  PdfParseOptions spec_options = options;
+  std::unique_ptr<PdfParseCheckpoint> checkpoint;
+  if (FLAGS_cpu_instructions_checkpoint) {
+    checkpoint = PdfParseCheckpoint::OpenOrDie(
+        GetCheckpointFilename(output_base, spec_id), pdf_document_id, *config);
+    spec_options.checkpoint = checkpoint.get();
+  }
+  std::unique_ptr<PdfPageStreamWriter> page_stream_writer;
+  if (FLAGS_cpu_instructions_streaming) {
+    spec_options.rows_only = true;
+    if (debug_proto_writer != nullptr) {
+      const string pages_filename =
+          StrCat(output_base, "_", spec_id, ".pdf.pages");
+      LOG(INFO) << "Streaming pages to : " << pages_filename;
+      page_stream_writer.reset(new PdfPageStreamWriter(pages_filename));
+      spec_options.page_callback =
+          [&page_stream_writer](const PdfPage& page) {
+            page_stream_writer->WriteOrDie(page);
+          };
+    }
+  }
+
+  LOG(INFO) << "Reading PDF file : " << input_spec.filename;
+  const auto pdf_document = std::make_shared<const PdfDocument>(doc->Parse(
+      GetPagesToParse(*doc, input_spec, options.num_threads), *config,
+      spec_options));
+  page_stream_writer.reset();  // Flushes the pages.
+  if (FLAGS_cpu_instructions_streaming) {
+    // The pages were already written by page_stream_writer.
+  } else if (!FLAGS_cpu_instructions_compact_pdf_debug_protos) {
+    WriteDebugProto(debug_proto_writer,
+                    StrCat(output_base, "_", spec_id, ".pdf.pb"),
+                    pdf_document);
+  } else if (debug_proto_writer != nullptr) {
+    const string filename = StrCat(output_base, "_", spec_id, ".pdf.cpb");
+    LOG(INFO) << "Saving compact PDF document : " << filename;
+    debug_proto_writer->Schedule([filename, pdf_document]() {
+      WriteCompactPdfDocumentOrDie(filename, *pdf_document);
+    });
+  }
+
+  LOG(INFO) << "Extracting instruction set : " << input_spec.filename;
+  SdmDocument previous_sdm_document;
+  if (!FLAGS_cpu_instructions_previous_output_base.empty()) {
+    previous_sdm_document = ReadPreviousSdmDocument(
+        FLAGS_cpu_instructions_previous_output_base, spec_id);
+  }
+  std::vector<string> extracted_group_ids;
+  const auto sdm_document =
+      std::make_shared<const SdmDocument>(ConvertPdfDocumentToSdmDocument(
+          *pdf_document, previous_sdm_document, &extracted_group_ids));
+  LOG(INFO) << "Extracted " << extracted_group_ids.size() << " of "
+            << sdm_document->instruction_sections_size()
+            << " instruction groups of " << input_spec.filename << ": "
+            << strings::Join(extracted_group_ids, ", ");
+  if (IsSharded() && debug_proto_writer == nullptr) {
+    // The SDM documents of the shards are needed to merge them.
+    WriteBinaryProtoOrDie(GetSdmDocumentFilename(output_base, spec_id),
+                          *sdm_document);
+  } else {
+    WriteDebugProto(debug_proto_writer,
+                    GetSdmDocumentFilename(output_base, spec_id),
+                    sdm_document);
+  }
+  InstructionSetProto instruction_set = ProcessIntelSdmDocument(*sdm_document);
+  *instruction_set.add_source_infos() =
+      CreateInstructionSetSourceInfo(doc->GetMetadata());
+  return instruction_set;
+}
+
 }  // namespace
 
 InstructionSetProto ParseSdmOrDie(const string& input_spec,
                                   const string& patch_sets_file,
                                   const string& output_base) {
+  CHECK_GE(FLAGS_cpu_instructions_shard_index, 0);
+  CHECK_LT(FLAGS_cpu_instructions_shard_index,
+           FLAGS_cpu_instructions_shard_count);
+
   // Read the input files
   PdfDocumentsChanges patch_sets;
   if (!patch_sets_file.empty()) {
@@ -90,34 +395,40 @@ InstructionSetProto ParseSdmOrDie(const string& input_spec,
 
   const auto input_specs = ParseInputSpec(input_spec);
 
-  InstructionSetProto full_instruction_set;
+  // Specs are processed concurrently, the threads left are shared among specs
+  // to parse pages in parallel.
+  const int parallelism = std::max(FLAGS_cpu_instructions_parallelism, 1);
+  const int num_spec_workers =
+      GetNumParallelForWorkers(input_specs.size(), parallelism);
+  PdfParseOptions options;
+  options.num_threads =
+      std::max(parallelism / std::max(num_spec_workers, 1), 1);
+  options.num_clustering_threads = FLAGS_cpu_instructions_clustering_threads;
+  std::unique_ptr<PdfPageCache> page_cache;
+  if (!FLAGS_cpu_instructions_page_cache_dir.empty()) {
+    page_cache.reset(new PdfPageCache(FLAGS_cpu_instructions_page_cache_dir));
+    options.page_cache = page_cache.get();
+  }
+  // Waits for the pending writes when going out of scope.
+  std::unique_ptr<BackgroundProtoWriter> debug_proto_writer;
+  if (FLAGS_cpu_instructions_write_debug_protos) {
+    debug_proto_writer.reset(new BackgroundProtoWriter());
+  }
+  std::vector<InstructionSetProto> instruction_sets(input_specs.size());
+  ParallelFor(input_specs.size(), parallelism,
+              [&](int worker, size_t spec_id) {
+                instruction_sets[spec_id] = ProcessInputSpecOrDie(
+                    input_specs[spec_id], spec_id, patch_sets, output_base,
+                    options, debug_proto_writer.get());
+              });
+  if (page_cache) {
+    LOG(INFO) << "Page cache: " << page_cache->num_hits() << " hits, "
+              << page_cache->num_misses() << " misses";
+  }
 
-  for (int spec_id = 0; spec_id < input_specs.size(); ++spec_id) {
-    const InputSpec& input_spec = input_specs[spec_id];
-    // Open document. PDFDoc takes ownership of the name.
-    LOG(INFO) << "Opening PDF file : " << input_spec.filename;
-    const auto doc = XPDFDoc::OpenOrDie(input_spec.filename);
-    const auto& pdf_document_id = doc->GetDocumentId();
-    const auto* config = GetConfigOrNull(patch_sets, pdf_document_id);
-    CHECK(config) << "Unsupported version. Metadata:\n"
-                  << pdf_document_id.DebugString();
-
-    LOG(INFO) << "Reading PDF file";
-    const PdfDocument pdf_document =
-        doc->Parse(input_spec.first_page, input_spec.last_page, *config);
-    const string pb_filename = StrCat(output_base, "_", spec_id, ".pdf.pb");
-    LOG(INFO) << "Saving pdf as proto file : " << pb_filename;
-    WriteBinaryProtoOrDie(pb_filename, pdf_document);
-
-    LOG(INFO) << "Extracting instruction set";
-    const SdmDocument sdm_document =
-        ConvertPdfDocumentToSdmDocument(pdf_document);
-    const string sdm_pb_filename = StrCat(output_base, "_", spec_id, ".sdm.pb");
-    LOG(INFO) << "Saving pdf as proto file : " << sdm_pb_filename;
-    WriteBinaryProtoOrDie(sdm_pb_filename, sdm_document);
-    InstructionSetProto instruction_set = ProcessIntelSdmDocument(sdm_document);
-    *instruction_set.add_source_infos() =
-        CreateInstructionSetSourceInfo(doc->GetMetadata());
+  // Merging in spec order keeps the output deterministic.
+  InstructionSetProto full_instruction_set;
+  for (const InstructionSetProto& instruction_set : instruction_sets) {
     full_instruction_set.MergeFrom(instruction_set);
   }
 
@@ -126,6 +437,63 @@ InstructionSetProto ParseSdmOrDie(const string& input_spec,
   LOG(INFO) << "Saving instruction database as: " << instructions_filename;
   WriteTextProtoOrDie(instructions_filename, full_instruction_set);
 
+  // The next run must parse the pages again, the extraction code may have
+  // changed.
+  if (FLAGS_cpu_instructions_checkpoint) {
+    for (size_t spec_id = 0; spec_id < input_specs.size(); ++spec_id) {
+      const string filename = GetCheckpointFilename(output_base, spec_id);
+      PCHECK(remove(filename.c_str()) == 0) << "Could not remove " << filename;
+    }
+  }
+
+  return full_instruction_set;
+}
+
+InstructionSetProto MergeSdmShardsOrDie(
+    const std::vector<string>& shard_output_bases, const string& output_base) {
+  CHECK(!shard_output_bases.empty());
+  std::vector<InstructionSetProto> shard_instruction_sets;
+  for (const string& shard_output_base : shard_output_bases) {
+    shard_instruction_sets.push_back(ReadTextProtoOrDie<InstructionSetProto>(
+        StrCat(shard_output_base, ".pbtxt")));
+  }
+  // ProcessInputSpecOrDie adds one source info per input spec.
+  const int num_specs = shard_instruction_sets.front().source_infos_size();
+  for (size_t i = 0; i < shard_instruction_sets.size(); ++i) {
+    CHECK_EQ(shard_instruction_sets[i].source_infos_size(), num_specs)
+        << "The shards " << shard_output_bases.front() << " and "
+        << shard_output_bases[i] << " have different input specs";
+  }
+
+  std::unique_ptr<BackgroundProtoWriter> debug_proto_writer;
+  if (FLAGS_cpu_instructions_write_debug_protos) {
+    debug_proto_writer.reset(new BackgroundProtoWriter());
+  }
+  InstructionSetProto full_instruction_set;
+  for (int spec_id = 0; spec_id < num_specs; ++spec_id) {
+    std::vector<SdmDocument> shards;
+    for (const string& shard_output_base : shard_output_bases) {
+      const string filename =
+          FindSdmDocumentFilename(shard_output_base, spec_id);
+      CHECK(!filename.empty())
+          << "Missing " << GetSdmDocumentFilename(shard_output_base, spec_id);
+      shards.push_back(ReadBinaryProtoOrDie<SdmDocument>(filename));
+    }
+    const auto sdm_document =
+        std::make_shared<const SdmDocument>(MergeSdmDocumentShards(shards));
+    WriteDebugProto(debug_proto_writer.get(),
+                    GetSdmDocumentFilename(output_base, spec_id), sdm_document);
+    // Same as ProcessInputSpecOrDie followed by the merge in ParseSdmOrDie.
+    InstructionSetProto instruction_set =
+        ProcessIntelSdmDocument(*sdm_document);
+    *instruction_set.add_source_infos() =
+        shard_instruction_sets.front().source_infos(spec_id);
+    full_instruction_set.MergeFrom(instruction_set);
+  }
+
+  const string instructions_filename = StrCat(output_base, ".pbtxt");
+  LOG(INFO) << "Saving instruction database as: " << instructions_filename;
+  WriteTextProtoOrDie(instructions_filename, full_instruction_set);
   return full_instruction_set;
 }
 
@@ -15,9 +15,13 @@
 #ifndef CPU_INSTRUCTIONS_X86_PDF_PARSE_SDM_H_
 #define CPU_INSTRUCTIONS_X86_PDF_PARSE_SDM_H_
 
+#include <vector>
 #include "strings/string.h"
 
 #include "cpu_instructions/proto/instructions.pb.h"
+#include "gflags/gflags.h"
+
+DECLARE_int32(cpu_instructions_shard_count);
 
 namespace cpu_instructions {
 namespace x86 {
@@ -27,13 +31,25 @@ namespace pdf {
 //   - The parsed database of instructions, written to <output_base>.pbtxt
 //   - Two raw protos per input file for debug, with the contents
 //     of the PDF (raw parsed input) and SDM (interpreted input) respectively,
-//     as <output_base>_<input_id>.{pdf,sdm}.pb
+//     as <output_base>_<input_id>.{pdf,sdm}.pb, see
+//     --cpu_instructions_write_debug_protos.
 // The patches contained in patch_sets_file are applied before interpreting the
-// SDM.
+// SDM. Input files are processed concurrently according to
+// --cpu_instructions_parallelism, the output does not depend on it.
+// With --cpu_instructions_shard_count > 1, only the pages of the shard given by
+// --cpu_instructions_shard_index are parsed, and the returned instruction set
+// is partial.
 InstructionSetProto ParseSdmOrDie(const string& input_spec,
                                   const string& patch_sets_file,
                                   const string& output_base);
 
+// Merges the outputs of the shards of a sharded ParseSdmOrDie, given by their
+// output bases in shard order. The result, and the files written to
+// <output_base>.pbtxt and <output_base>_<spec_id>.sdm.pb, are the same as those
+// of a single ParseSdmOrDie run with all the pages.
+InstructionSetProto MergeSdmShardsOrDie(
+    const std::vector<string>& shard_output_bases, const string& output_base);
+
 }  // namespace pdf
 }  // namespace x86
 }  // namespace cpu_instructions
@@ -16,16 +16,18 @@
 
 #include <algorithm>
 #include <cfloat>
-#include <map>
+#include <cmath>
+#include <cstdint>
 #include <unordered_map>
 #include <vector>
 #include "strings/string.h"
 
+#include "cpu_instructions/util/fingerprint.h"
 #include "cpu_instructions/x86/pdf/geometry.h"
+#include "glog/logging.h"
 #include "strings/str_cat.h"
 #include "strings/str_join.h"
 #include "strings/string_view.h"
-#include "util/graph/connected_components.h"
 #include "util/gtl/map_util.h"
 
 namespace cpu_instructions {
@@ -34,7 +36,68 @@ namespace pdf {
 
 namespace {
 
-void Union(const BoundingBox& a, BoundingBox* b) { *b = Union(a, *b); }
+// The clustering works on plain structs holding the fields of the characters,
+// segments and blocks it reads in its inner loops, with the texts of each level
+// stored in a single string. The protos are written once, at the end of
+// Cluster().
+
+// A range of a string holding the texts of all the elements of a level.
+struct TextRange {
+  uint32_t begin = 0;
+  uint32_t end = 0;
+};
+
+StringPiece GetSubstring(const string& texts, const TextRange& range) {
+  return StringPiece(texts.data() + range.begin, range.end - range.begin);
+}
+
+// Appends text to texts and extends range, which must end at the end of texts.
+void AppendText(StringPiece text, string* texts, TextRange* range) {
+  DCHECK_EQ(range->end, texts->size());
+  texts->append(text.data(), text.size());
+  range->end = texts->size();
+}
+
+// The fields of a PdfCharacter used by the clustering.
+struct Character {
+  Box box;
+  Point center = Point(0.0f, 0.0f);
+  Orientation orientation = Orientation::NORTH;
+  float font_size = 0.0f;
+  uint32_t fill_color_hash = 0;
+  TextRange utf8;
+};
+
+// The fields of a PdfTextSegment. The indices of the characters of the segment,
+// in reading order, are [characters_begin, characters_end) in
+// Segments::character_indices.
+struct Segment {
+  Box box;
+  Point center = Point(0.0f, 0.0f);
+  Orientation orientation = Orientation::NORTH;
+  float font_size = 0.0f;
+  uint32_t fill_color_hash = 0;
+  TextRange text;
+  uint32_t characters_begin = 0;
+  uint32_t characters_end = 0;
+};
+
+// The fields of a PdfTextBlock.
+struct Block {
+  Box box;
+  Point center = Point(0.0f, 0.0f);
+  Orientation orientation = Orientation::NORTH;
+  float font_size = 0.0f;
+  TextRange text;
+};
+
+// The fields of a PdfTextTableRow. The blocks of the row are
+// [blocks_begin, blocks_end) in Rows::blocks.
+struct Row {
+  Box box;
+  uint32_t blocks_begin = 0;
+  uint32_t blocks_end = 0;
+};
 
 // Returns the direction vector corresponding to value's orientation.
 // +---+
@@ -44,182 +107,361 @@ void Union(const BoundingBox& a, BoundingBox* b) { *b = Union(a, *b); }
 // +---+
 template <typename T>
 Vec2F GetForwardDirection(const T& value) {
-  return GetDirectionVector(value.orientation());
-}
-
-// Returns the direction vector corresponding to value's orientation rotated by
-// 90 degrees.
-// +---+
-// |   |
-// | +------->  returns  +
-// |   |                 |
-// +---+                 v
-template <typename T>
-Vec2F GetSidewaysDirection(const T& value) {
-  return GetDirectionVector(RotateClockwise90(value.orientation()));
+  return GetDirectionVector(value.orientation);
 }
 
 // Computes the Vec2F going from a's center to b's center.
 template <typename T>
 Vec2F GetVector(const T& a, const T& b) {
-  return GetCenter(b.bounding_box()) - GetCenter(a.bounding_box());
+  return b.center - a.center;
+}
+
+// The size of the cells of the grid used to find candidate characters,
+// relative to the median font size of the page. Candidates are searched within
+// a font size of the center of a character, in the forward direction, so most
+// searches only visit 2 to 4 cells.
+constexpr const float kCandidateGridCellSize = 2.0f;
+
+// Returns the median font size of the characters, or 1 if there are none.
+float GetMedianFontSize(const std::vector<Character>& characters) {
+  std::vector<float> font_sizes;
+  font_sizes.reserve(characters.size());
+  for (const auto& character : characters) {
+    if (character.font_size > 0.0f) font_sizes.push_back(character.font_size);
+  }
+  if (font_sizes.empty()) return 1.0f;
+  const auto median = font_sizes.begin() + font_sizes.size() / 2;
+  std::nth_element(font_sizes.begin(), median, font_sizes.end());
+  return *median;
+}
+
+std::vector<Point> GetCenters(const std::vector<Character>& characters) {
+  std::vector<Point> centers;
+  centers.reserve(characters.size());
+  for (const auto& character : characters) centers.push_back(character.center);
+  return centers;
+}
+
+std::vector<Character> ReadCharacters(const PdfCharacters& pdf_characters,
+                                      string* utf8) {
+  size_t utf8_size = 0;
+  for (const auto& pdf_character : pdf_characters) {
+    utf8_size += pdf_character.utf8().size();
+  }
+  utf8->reserve(utf8_size);
+  std::vector<Character> characters(pdf_characters.size());
+  for (size_t i = 0; i < characters.size(); ++i) {
+    const PdfCharacter& pdf_character = pdf_characters.Get(i);
+    Character& character = characters[i];
+    character.box = ToBox(pdf_character.bounding_box());
+    character.center = GetCenter(character.box);
+    character.orientation = pdf_character.orientation();
+    character.font_size = pdf_character.font_size();
+    character.fill_color_hash = pdf_character.fill_color_hash();
+    character.utf8.begin = character.utf8.end = utf8->size();
+    AppendText(pdf_character.utf8(), utf8, &character.utf8);
+  }
+  return characters;
 }
 
 // Helper class providing indexed access to characters.
-// Indexed access is needed to use ConnectedComponent.
+// Indexed access is needed to link the characters by index.
 class Characters {
  public:
-  Characters(const PdfCharacters* characters, const BoundingBox& page)
-      : characters_(characters), tree_(page) {
-    centers_.reserve(characters_->size());
-    size_t i = 0;
-    for (const auto& character : *characters_) {
-      const auto& center = GetCenter(character.bounding_box());
-      centers_.push_back(center);
-      tree_.Insert(i++, center);
-    }
-  }
+  Characters(const PdfCharacters& characters, const BoundingBox& page)
+      : page_(page),
+        characters_(ReadCharacters(characters, &utf8_)),
+        grid_(page, kCandidateGridCellSize * GetMedianFontSize(characters_),
+              GetCenters(characters_)) {}
 
-  size_t size() const { return characters_->size(); }
+  size_t size() const { return characters_.size(); }
 
-  const PdfCharacter& Get(size_t index) const {
-    return characters_->Get(index);
+  const Character& Get(size_t index) const { return characters_[index]; }
+
+  StringPiece GetUtf8(size_t index) const {
+    return GetSubstring(utf8_, characters_[index].utf8);
+  }
+
+  // Returns whether the character can be found by FindNextCandidate, i.e. its
+  // center is on the page.
+  bool IsSearchable(size_t index) const {
+    return Contains(page_, characters_[index].center);
   }
 
-  // Gathers characters close to the one pointed to by 'index' to prune the
-  // O(N^2) search.
-  const Indices GetCandidates(size_t index) const {
-    const auto character = Get(index);
-    const auto center = GetCenter(character.bounding_box());
-    const float size = character.font_size() * 2.0f;
-    Indices indices;
-    tree_.QueryRange(CreateBox(center, size, size), &indices);
-    return indices;
+  // Returns the index of the closest character in the forward direction of the
+  // one pointed to by 'index', within a font size of its center, for which
+  // predicate(candidate_index) is true. Returns -1 if there is none. Ties are
+  // broken by the smallest index.
+  template <typename Predicate>
+  int FindNextCandidate(size_t index, Predicate predicate) const {
+    const auto& character = Get(index);
+    const float size = character.font_size;
+    const Vec2F sideways =
+        GetDirectionVector(RotateClockwise90(character.orientation));
+    const float lateral =
+        Vec2F(character.center.x, character.center.y).dot_product(sideways);
+    return grid_.FindNearestInDirection(character.center, character.orientation,
+                                        Span(lateral - size, lateral + size),
+                                        size, predicate);
   }
 
  private:
-  const PdfCharacters* const characters_;
-  std::vector<Point> centers_;
-  QuadTree tree_;
+  const BoundingBox page_;
+  string utf8_;
+  const std::vector<Character> characters_;
+  const PointGrid grid_;
 };
 
-std::vector<Indices> GetClusters(DenseConnectedComponentsFinder* finder) {
-  std::map<int, Indices> all_indices;
-  const std::vector<int> component_ids = finder->GetComponentIds();
-  for (size_t i = 0; i < component_ids.size(); ++i) {
-    all_indices[component_ids[i]].push_back(i);
+// The value of a successor for nodes that have none.
+constexpr const int kNoSuccessor = -1;
+
+// Returns the clusters of the graph where each node i links to successors[i],
+// the next node in reading order, or to kNoSuccessor. The clusters are sorted by
+// smallest node index, like DenseConnectedComponentsFinder::GetComponentIds().
+//
+// The links of a cluster usually form a single chain, and the cluster is read
+// off in order by following the successors from the only node that has no
+// predecessor. When two nodes link to the same one the cluster is a tree
+// instead, its indices are sorted with reading_order_cmp.
+//
+// The links must go forward in reading order, i.e. there can be no cycle.
+template <typename ReadingOrderCmp>
+std::vector<Indices> GetChainClusters(const std::vector<int>& successors,
+                                      ReadingOrderCmp reading_order_cmp) {
+  const size_t size = successors.size();
+  // The number of predecessors of each node, capped at 2.
+  std::vector<uint8_t> num_predecessors(size, 0);
+  for (const int successor : successors) {
+    if (successor != kNoSuccessor && num_predecessors[successor] < 2) {
+      ++num_predecessors[successor];
+    }
   }
-  std::vector<Indices> output;
-  for (auto& id_indices_pair : all_indices) {
-    output.push_back(std::move(id_indices_pair.second));
+  // Each cluster has a single node without successor, its last one. Finds it
+  // for every node, remembering the ones found on the way.
+  constexpr const int kUnknown = -1;
+  constexpr const int kVisiting = -2;
+  std::vector<int> last_nodes(size, kUnknown);
+  std::vector<int> path;
+  for (size_t i = 0; i < size; ++i) {
+    int node = i;
+    while (last_nodes[node] == kUnknown && successors[node] != kNoSuccessor) {
+      last_nodes[node] = kVisiting;
+      path.push_back(node);
+      node = successors[node];
+    }
+    CHECK_NE(last_nodes[node], kVisiting) << "Cycle in the reading order";
+    const int last_node = last_nodes[node] == kUnknown ? node : last_nodes[node];
+    last_nodes[node] = last_node;
+    for (const int visited : path) last_nodes[visited] = last_node;
+    path.clear();
+  }
+  // Numbers the clusters in the order of their smallest node, and finds the
+  // first node of the chains.
+  std::vector<int> cluster_ids(size, kUnknown);
+  std::vector<int> first_nodes;
+  std::vector<bool> is_chain;
+  for (size_t i = 0; i < size; ++i) {
+    int& cluster_id = cluster_ids[last_nodes[i]];
+    if (cluster_id == kUnknown) {
+      cluster_id = first_nodes.size();
+      first_nodes.push_back(kUnknown);
+      is_chain.push_back(true);
+    }
+    if (num_predecessors[i] == 0) first_nodes[cluster_id] = i;
+    if (num_predecessors[i] > 1) is_chain[cluster_id] = false;
+  }
+  std::vector<Indices> output(first_nodes.size());
+  for (size_t id = 0; id < output.size(); ++id) {
+    if (!is_chain[id]) continue;
+    for (int node = first_nodes[id]; node != kNoSuccessor;
+         node = successors[node]) {
+      output[id].push_back(node);
+    }
+  }
+  // Falls back to sorting the clusters that are not chains.
+  for (size_t i = 0; i < size; ++i) {
+    const int cluster_id = cluster_ids[last_nodes[i]];
+    if (!is_chain[cluster_id]) output[cluster_id].push_back(i);
+  }
+  for (size_t id = 0; id < output.size(); ++id) {
+    if (is_chain[id]) continue;
+    std::sort(output[id].begin(), output[id].end(), reading_order_cmp);
   }
   return output;
 }
 
+// The maximal distance between two glyphs of a run, relative to the font size.
+constexpr const float kMaxGlyphRunGap = 0.1f;
+
+// Returns whether b continues the glyph run of a. xpdf emits glyphs in content
+// stream order, and consecutive glyphs that share orientation, font size, color
+// and baseline and touch each other are part of the same piece of text. Then b
+// is the closest character in the forward direction of a, and the spatial
+// search can be skipped for a.
+// This differs from the search when a glyph drawn elsewhere in the stream is
+// closer to a than b, i.e. over a or b or in the gap between them, e.g. for
+// text overprinted with an offset or two interleaved runs on the same baseline.
+// a is then linked to b instead of that glyph, and the glyphs end up in a
+// cluster that is not a chain, which is sorted in reading order by
+// GetChainClusters. The segments may then differ from those of the search.
+// The gap may be slightly negative: glyph boxes come from the advance widths,
+// and with kerning many runs of the SDM overlap by a few percent of the font
+// size.
+bool IsGlyphRunContinuation(const Character& a, const Character& b) {
+  if (a.orientation != b.orientation || a.font_size != b.font_size ||
+      a.fill_color_hash != b.fill_color_hash) {
+    return false;
+  }
+  const Orientation sideways = RotateClockwise90(a.orientation);
+  const Span baseline_a = GetSpan(a.box, sideways);
+  const Span baseline_b = GetSpan(b.box, sideways);
+  if (baseline_a.min != baseline_b.min || baseline_a.max != baseline_b.max) {
+    return false;
+  }
+  const float gap =
+      GetSpan(b.box, b.orientation).min - GetSpan(a.box, a.orientation).max;
+  if (std::abs(gap) > kMaxGlyphRunGap * a.font_size) return false;
+  const float distance = GetVector(a, b).dot_product(GetForwardDirection(a));
+  return distance > 0 && distance < 0.9 * a.font_size;
+}
+
+// The segments of a page, and the character indices and texts they refer to.
+struct SegmentList {
+  std::vector<Segment> segments;
+  std::vector<uint32_t> character_indices;
+  string texts;
+};
+
 // Actually clusters the characters by retaining the closest character in the
-// forward direction and linking them together in PdfTextSegments.
-void ClusterCharacters(const Characters& all, PdfTextSegments* segments) {
+// forward direction and linking them together in segments.
+void ClusterCharacters(const Characters& all, SegmentList* output) {
   // Returns FLT_MAX if characters[b] is not on the same line, backward or too
   // far away from characters[a].
   const auto GetCharacterDistance = [&all](size_t index_a,
                                            size_t index_b) -> float {
     const auto& a = all.Get(index_a);
     const auto& b = all.Get(index_b);
-    const Orientation sideways = RotateClockwise90(a.orientation());
-    const Span v_span_a = GetSpan(a.bounding_box(), sideways);
-    const Span v_span_b = GetSpan(b.bounding_box(), sideways);
+    const Orientation sideways = RotateClockwise90(a.orientation);
+    const Span v_span_a = GetSpan(a.box, sideways);
+    const Span v_span_b = GetSpan(b.box, sideways);
     const bool same_line = v_span_a.Intersects(v_span_b);
-    const bool same_orientation = a.orientation() == b.orientation();
+    const bool same_orientation = a.orientation == b.orientation;
     const Vec2F forward = GetForwardDirection(a);
     const float distance = GetVector(a, b).dot_product(forward);
-    const bool within_distance = distance > 0 && distance < 0.9 * a.font_size();
+    const bool within_distance = distance > 0 && distance < 0.9 * a.font_size;
     if (same_line && same_orientation && within_distance) {
       return distance;
     }
     return FLT_MAX;
   };
 
-  DenseConnectedComponentsFinder components;
-  components.SetNumberOfNodes(all.size());
-
-  // For each character, adds an edge between it and the closest one.
+  // For each character, links it to the closest one. Within a run of glyphs
+  // this is the next character in the stream, only the last character of each
+  // run needs the spatial search. Characters that are off the page are never
+  // found by the search, they do not continue runs either.
+  std::vector<int> successors(all.size(), kNoSuccessor);
   for (size_t i = 0; i < all.size(); ++i) {
-    float min_distance = FLT_MAX;
-    size_t candidate_index = 0;
-    for (size_t j : all.GetCandidates(i)) {
-      const float distance = GetCharacterDistance(i, j);
-      if (distance < min_distance) {
-        candidate_index = j;
-        min_distance = distance;
-      }
-    }
-    if (min_distance < FLT_MAX) {
-      components.AddEdge(i, candidate_index);
+    if (i + 1 < all.size() && all.IsSearchable(i + 1) &&
+        IsGlyphRunContinuation(all.Get(i), all.Get(i + 1))) {
+      successors[i] = i + 1;
+      continue;
     }
+    const int candidate_index = all.FindNextCandidate(
+        i, [&](size_t j) { return GetCharacterDistance(i, j) < FLT_MAX; });
+    if (candidate_index >= 0) successors[i] = candidate_index;
   }
 
+  // Returns whether characters[a] is before characters[b].
+  const auto reading_order_cmp = [&all](size_t index_a, size_t index_b) {
+    const auto& a = all.Get(index_a);
+    const auto& b = all.Get(index_b);
+    const Vec2F forward = GetForwardDirection(a);
+    return GetVector(a, b).dot_product(forward) > 0;
+  };
+
   // Pushes a set of character indices as a new segment.
-  for (auto& indices : GetClusters(&components)) {
-    // Returns whether characters[a] is before characters[b].
-    const auto reading_order_cmp = [&all](size_t index_a, size_t index_b) {
-      const auto& a = all.Get(index_a);
-      const auto& b = all.Get(index_b);
-      const Vec2F forward = GetForwardDirection(a);
-      return GetVector(a, b).dot_product(forward) > 0;
-    };
-    std::sort(indices.begin(), indices.end(), reading_order_cmp);
-    PdfTextSegment segment;
-    BoundingBox* bounding_box = segment.mutable_bounding_box();
+  output->character_indices.reserve(all.size());
+  for (const auto& indices : GetChainClusters(successors, reading_order_cmp)) {
+    Segment segment;
+    segment.text.begin = segment.text.end = output->texts.size();
+    segment.characters_begin = output->character_indices.size();
     bool first = true;
     for (const size_t index : indices) {
       const auto& character = all.Get(index);
       if (first) {
-        segment.set_font_size(character.font_size());
-        segment.set_orientation(RotateClockwise90(character.orientation()));
-        segment.set_fill_color_hash(character.fill_color_hash());
-        *bounding_box = character.bounding_box();
+        segment.font_size = character.font_size;
+        segment.orientation = RotateClockwise90(character.orientation);
+        segment.fill_color_hash = character.fill_color_hash;
+        segment.box = character.box;
         first = false;
       }
-      segment.add_character_indices(index);
-      segment.mutable_text()->append(character.utf8());
-      Union(character.bounding_box(), bounding_box);
+      output->character_indices.push_back(index);
+      AppendText(all.GetUtf8(index), &output->texts, &segment.text);
+      segment.box = Union(character.box, segment.box);
     }
-    if (!segment.text().empty()) {
-      segment.Swap(segments->Add());
+    if (segment.text.begin == segment.text.end) {
+      // Drops the segment, its characters have no text.
+      output->character_indices.resize(segment.characters_begin);
+      continue;
     }
+    segment.characters_end = output->character_indices.size();
+    segment.center = GetCenter(segment.box);
+    output->segments.push_back(segment);
   }
 }
 
 class Segments {
  public:
   Segments(const PdfPagePreventSegmentBindings& prevent_bindings,
-           const PdfTextSegments* segments)
+           const SegmentList* segments)
       : segments_(segments) {
-    for (size_t i = 0; i < segments->size(); ++i) {
+    for (size_t i = 0; i < size(); ++i) {
       InsertOrDie(&first_char_index_to_segment_index_, GetFirstCharIndex(i), i);
-      InsertIfNotPresent(&text_to_index_, segments->Get(i).text(), i);
     }
+    if (prevent_bindings.empty()) return;
+    // Most pages have no prevent_segment_bindings, the texts are only hashed
+    // when there are some.
+    text_hashes_.reserve(size());
+    for (size_t i = 0; i < size(); ++i) {
+      text_hashes_.push_back(GetTextHash(GetText(i)));
+    }
+    prevent_bindings_.reserve(prevent_bindings.size());
     for (const auto& prevent_binding : prevent_bindings) {
-      const string key =
-          CreateKey(prevent_binding.first(), prevent_binding.second());
-      if (!InsertIfNotPresent(&prevent_bindings_, key)) {
-        LOG(FATAL) << "Duplicated prevent_segment_bindings '" << key
+      const uint64_t key_hash =
+          GetKeyHash(GetTextHash(prevent_binding.first()),
+                     GetTextHash(prevent_binding.second()));
+      if (FindPreventBinding(key_hash, prevent_binding.first(),
+                             prevent_binding.second()) != nullptr) {
+        LOG(FATAL) << "Duplicated prevent_segment_bindings '"
+                   << CreateKey(prevent_binding.first(),
+                                prevent_binding.second())
                    << "' in config file";
       }
+      prevent_binding_index_.emplace(key_hash, prevent_bindings_.size());
+      prevent_bindings_.push_back({prevent_binding.first(),
+                                   prevent_binding.second(), false});
     }
   }
 
   ~Segments() {
-    if (!prevent_bindings_.empty()) {
+    std::vector<string> unconsumed_keys;
+    for (const auto& prevent_binding : prevent_bindings_) {
+      if (prevent_binding.consumed) continue;
+      unconsumed_keys.push_back(
+          CreateKey(prevent_binding.first, prevent_binding.second));
+    }
+    if (!unconsumed_keys.empty()) {
       LOG(ERROR) << "The following prevent_segment_bindings were not consumed\n"
-                 << strings::Join(prevent_bindings_, "\n");
+                 << strings::Join(unconsumed_keys, "\n");
     }
   }
 
-  size_t size() const { return segments_->size(); }
+  size_t size() const { return segments_->segments.size(); }
+
+  const Segment& Get(size_t index) const { return segments_->segments[index]; }
 
-  const PdfTextSegment& Get(size_t index) const {
-    return segments_->Get(index);
+  StringPiece GetText(size_t index) const {
+    return GetSubstring(segments_->texts, Get(index).text);
   }
 
   size_t GetFollowingSegment(size_t index) const {
@@ -229,44 +471,88 @@ class Segments {
                            following_char_index, index);
   }
 
-  size_t GetIndexFor(StringPiece text) const {
-    return FindWithDefault(text_to_index_, text, StringPiece::npos);
-  }
-
-  bool ConsumePreventSegmentBinding(const PdfTextSegment& a,
-                                    const PdfTextSegment& b) {
-    const string key = CreateKey(a.text(), b.text());
-    const bool prevent = ContainsKey(prevent_bindings_, key);
-    if (prevent) {
-      LOG(INFO) << "Preventing segment binding between '" << key << "'";
-      prevent_bindings_.erase(key);
-    }
-    return prevent;
+  // Returns whether a prevent_segment_binding forbids joining a and b. Each
+  // prevent_segment_binding is consumed by the first pair it matches.
+  bool ConsumePreventSegmentBinding(size_t a, size_t b) {
+    if (prevent_bindings_.empty()) return false;
+    PreventBinding* const prevent_binding =
+        FindPreventBinding(GetKeyHash(text_hashes_[a], text_hashes_[b]),
+                           GetText(a), GetText(b));
+    if (prevent_binding == nullptr || prevent_binding->consumed) return false;
+    LOG(INFO) << "Preventing segment binding between '"
+              << CreateKey(GetText(a), GetText(b)) << "'";
+    prevent_binding->consumed = true;
+    return true;
   }
 
  private:
-  static string CreateKey(const string& a, const string& b) {
+  // The texts of two segments that must not be joined in a block.
+  struct PreventBinding {
+    string first;
+    string second;
+    bool consumed;
+  };
+
+  static string CreateKey(StringPiece a, StringPiece b) {
     return StrCat(a, " <-> ", b);
   }
 
+  static uint64_t GetTextHash(StringPiece text) {
+    Fingerprint fingerprint;
+    fingerprint.Add(text);
+    return fingerprint.value();
+  }
+
+  static uint64_t GetKeyHash(uint64_t first_hash, uint64_t second_hash) {
+    Fingerprint fingerprint;
+    fingerprint.AddUint64(first_hash);
+    fingerprint.AddUint64(second_hash);
+    return fingerprint.value();
+  }
+
+  // Returns the prevent binding for the texts, or nullptr if there is none.
+  // key_hash is GetKeyHash of the hashes of the texts.
+  PreventBinding* FindPreventBinding(uint64_t key_hash, StringPiece first,
+                                     StringPiece second) {
+    const auto range = prevent_binding_index_.equal_range(key_hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      PreventBinding& prevent_binding = prevent_bindings_[it->second];
+      if (prevent_binding.first == first && prevent_binding.second == second) {
+        return &prevent_binding;
+      }
+    }
+    return nullptr;
+  }
+
   size_t GetFirstCharIndex(size_t index) const {
-    return Get(index).character_indices(0);
+    return segments_->character_indices[Get(index).characters_begin];
   }
 
   size_t GetLastCharIndex(size_t index) const {
     const auto& segment = Get(index);
-    CHECK_GT(segment.character_indices_size(), 0);
-    return segment.character_indices(segment.character_indices_size() - 1);
+    CHECK_GT(segment.characters_end, segment.characters_begin);
+    return segments_->character_indices[segment.characters_end - 1];
   }
 
-  const PdfTextSegments* segments_;
+  const SegmentList* segments_;
   std::unordered_map<size_t, size_t> first_char_index_to_segment_index_;
-  // ok to store StringPieces we own the data.
-  std::map<StringPiece, size_t> text_to_index_;
-  std::unordered_set<string> prevent_bindings_;
+  // The hashes of the texts of the segments, only when there are prevent
+  // bindings.
+  std::vector<uint64_t> text_hashes_;
+  // In the order of the config, consumed ones are kept to report the others.
+  std::vector<PreventBinding> prevent_bindings_;
+  // From the hash of the texts of a prevent binding to its index in
+  // prevent_bindings_.
+  std::unordered_multimap<uint64_t, size_t> prevent_binding_index_;
 };
 
-// Clusters the consecutive segments and link them together into PdfTextBlocks.
+// The blocks of a page and their texts.
+struct BlockList {
+  std::vector<Block> blocks;
+  string texts;
+};
+
+// Clusters the consecutive segments and link them together into blocks.
 // Segments of a paragraph appear next to each other in the document.
 //
 // 1.-------  4.------ 5.------
@@ -279,89 +565,114 @@ class Segments {
 // character of 2.
 // This code clusters segments that form paragraphs - aka 'segments that are
 // below each other' taking in consideration the orientation of the text.
-void ClusterSegments(Segments* segments, PdfTextBlocks* blocks) {
-  const auto is_connected = [segments](const PdfTextSegment& a,
-                                       const PdfTextSegment& b) {
-    const Orientation sideways = RotateClockwise90(a.orientation());
-    const Span h_span_a = GetSpan(a.bounding_box(), sideways);
-    const Span h_span_b = GetSpan(b.bounding_box(), sideways);
+void ClusterSegments(Segments* segments, BlockList* output) {
+  const auto is_connected = [segments](size_t a_index, size_t b_index) {
+    const Segment& a = segments->Get(a_index);
+    const Segment& b = segments->Get(b_index);
+    const Orientation sideways = RotateClockwise90(a.orientation);
+    const Span h_span_a = GetSpan(a.box, sideways);
+    const Span h_span_b = GetSpan(b.box, sideways);
     const bool same_column = h_span_a.Intersects(h_span_b);
-    const bool same_font = a.font_size() == b.font_size();
-    const bool same_orientation = a.orientation() == b.orientation();
-    const bool same_color = a.fill_color_hash() == b.fill_color_hash();
+    const bool same_font = a.font_size == b.font_size;
+    const bool same_orientation = a.orientation == b.orientation;
+    const bool same_color = a.fill_color_hash == b.fill_color_hash;
     const Vec2F forward = GetForwardDirection(a);
     const float distance = GetVector(a, b).dot_product(forward);
-    const bool within_distance = distance > 0 && distance < 1.7 * a.font_size();
-    const bool prevent_binding = segments->ConsumePreventSegmentBinding(a, b);
+    const bool within_distance = distance > 0 && distance < 1.7 * a.font_size;
+    const bool prevent_binding =
+        segments->ConsumePreventSegmentBinding(a_index, b_index);
     return same_column && same_font && same_orientation && within_distance &&
            same_color && !prevent_binding;
   };
 
   const size_t segments_size = segments->size();
-  DenseConnectedComponentsFinder components;
-  components.SetNumberOfNodes(segments_size);
+  std::vector<int> successors(segments_size, kNoSuccessor);
 
   // Linear algorithm. We only try to connect segments with a contiguous
   // character flow.
   for (size_t i = 0; i < segments_size; ++i) {
     const auto next_segment_index = segments->GetFollowingSegment(i);
     if (next_segment_index == i) continue;
-    if (is_connected(segments->Get(i), segments->Get(next_segment_index))) {
-      components.AddEdge(i, next_segment_index);
+    if (is_connected(i, next_segment_index)) {
+      successors[i] = next_segment_index;
     }
   }
 
-  for (auto& indices : GetClusters(&components)) {
-    // Returns whether segments[a] is before segments[b].
-    const auto reading_order_cmp = [segments](size_t a_index, size_t b_index) {
-      const auto& a = segments->Get(a_index);
-      const auto& b = segments->Get(b_index);
-      const Vec2F forward = GetForwardDirection(a);
-      return GetVector(a, b).dot_product(forward) > 0;
-    };
-    std::sort(indices.begin(), indices.end(), reading_order_cmp);
-    PdfTextBlock block;
-    BoundingBox* bounding_box = block.mutable_bounding_box();
-    string* text = block.mutable_text();
+  // Returns whether segments[a] is before segments[b].
+  const auto reading_order_cmp = [segments](size_t a_index, size_t b_index) {
+    const auto& a = segments->Get(a_index);
+    const auto& b = segments->Get(b_index);
+    const Vec2F forward = GetForwardDirection(a);
+    return GetVector(a, b).dot_product(forward) > 0;
+  };
+
+  for (const auto& indices : GetChainClusters(successors, reading_order_cmp)) {
+    Block block;
+    block.text.begin = block.text.end = output->texts.size();
     bool first = true;
     for (const size_t index : indices) {
       const auto& segment = segments->Get(index);
       if (first) {
-        block.set_font_size(segment.font_size());
-        block.set_orientation(segment.orientation());
-        *bounding_box = segment.bounding_box();
+        block.font_size = segment.font_size;
+        block.orientation = segment.orientation;
+        block.box = segment.box;
         first = false;
       }
-      if (!text->empty()) text->push_back('\n');
-      text->append(segment.text());
-      Union(segment.bounding_box(), bounding_box);
+      if (block.text.end != block.text.begin) {
+        AppendText("\n", &output->texts, &block.text);
+      }
+      AppendText(segments->GetText(index), &output->texts, &block.text);
+      block.box = Union(segment.box, block.box);
     }
-    block.Swap(blocks->Add());
+    block.center = GetCenter(block.box);
+    output->blocks.push_back(block);
   }
 }
 
 class Blocks {
  public:
-  explicit Blocks(const PdfTextBlocks* blocks) {
-    blocks_.reserve(blocks->size());
-    for (const auto& block : *blocks) blocks_.push_back(&block);
+  explicit Blocks(const BlockList* blocks) : texts_(&blocks->texts) {
+    blocks_.reserve(blocks->blocks.size());
+    for (const auto& block : blocks->blocks) blocks_.push_back(&block);
   }
 
-  explicit Blocks(std::vector<const PdfTextBlock*> blocks_ptr)
-      : blocks_(std::move(blocks_ptr)) {}
+  Blocks(const string* texts, std::vector<const Block*> blocks_ptr)
+      : texts_(texts), blocks_(std::move(blocks_ptr)) {}
 
   size_t size() const { return blocks_.size(); }
 
-  const PdfTextBlock& Get(size_t index) const { return *blocks_.at(index); }
+  const Block& Get(size_t index) const { return *blocks_.at(index); }
+
+  StringPiece GetText(size_t index) const {
+    return GetSubstring(*texts_, Get(index).text);
+  }
+
+  // Returns the spans of the blocks along orientation.
+  std::vector<Span> GetSpans(Orientation orientation) const {
+    std::vector<Span> spans;
+    spans.reserve(blocks_.size());
+    for (const Block* block : blocks_) {
+      spans.push_back(GetSpan(block->box, orientation));
+    }
+    return spans;
+  }
 
   Blocks Keep(Indices indices) const {
-    std::vector<const PdfTextBlock*> subset;
+    std::vector<const Block*> subset;
     for (const size_t index : indices) subset.push_back(blocks_.at(index));
-    return Blocks(std::move(subset));
+    return Blocks(texts_, std::move(subset));
   }
 
  private:
-  std::vector<const PdfTextBlock*> blocks_;
+  const string* texts_;
+  std::vector<const Block*> blocks_;
+};
+
+// The rows of a page, with the blocks of all rows and their texts.
+struct RowList {
+  std::vector<Row> rows;
+  std::vector<Block> blocks;
+  string texts;
 };
 
 // Clusters blocks on the same column and merge them in reading order.
@@ -372,52 +683,37 @@ class Blocks {
 // +-----+          |        |    | |
 // |  D  |          |        |    +-+
 // +-----+          +--------+
-void ClusterColumns(const Blocks& row_blocks, PdfTextBlocks* output) {
-  const auto is_same_column = [](const PdfTextBlock& a, const PdfTextBlock& b) {
-    const Orientation horizontal = Orientation::EAST;
-    const Span h_span_a = GetSpan(a.bounding_box(), horizontal);
-    const Span h_span_b = GetSpan(b.bounding_box(), horizontal);
-    return h_span_a.Intersects(h_span_b);
-  };
-
-  const size_t blocks_size = row_blocks.size();
-  DenseConnectedComponentsFinder connected_columns;
-  connected_columns.SetNumberOfNodes(blocks_size);
-
-  for (size_t i = 0; i < blocks_size; ++i) {
-    for (size_t j = i + 1; j < blocks_size; ++j) {
-      if (is_same_column(row_blocks.Get(i), row_blocks.Get(j))) {
-        connected_columns.AddEdge(i, j);
-      }
-    }
-  }
-
-  for (auto& col_indices : GetClusters(&connected_columns)) {
+void ClusterColumns(const Blocks& row_blocks, RowList* output) {
+  for (auto& col_indices :
+       GetIntersectingSpanClusters(row_blocks.GetSpans(Orientation::EAST))) {
     const auto top_down_cmp = [&row_blocks](size_t a_index, size_t b_index) {
-      const auto& a = row_blocks.Get(a_index).bounding_box();
-      const auto& b = row_blocks.Get(b_index).bounding_box();
-      return a.top() < b.top();
+      const auto& a = row_blocks.Get(a_index).box;
+      const auto& b = row_blocks.Get(b_index).box;
+      return a.top < b.top;
     };
     std::sort(col_indices.begin(), col_indices.end(), top_down_cmp);
-    PdfTextBlock output_block;
-
-    BoundingBox* bounding_box = output_block.mutable_bounding_box();
-    string* text = output_block.mutable_text();
+    Block output_block;
+    TextRange* const text = &output_block.text;
+    text->begin = text->end = output->texts.size();
     bool first = true;
     for (const size_t index : col_indices) {
-      const PdfTextBlock& block = row_blocks.Get(index);
+      const Block& block = row_blocks.Get(index);
       if (first) {
-        *bounding_box = block.bounding_box();
-        output_block.set_font_size(block.font_size());
+        output_block.box = block.box;
+        output_block.font_size = block.font_size;
         first = false;
       }
-      Union(block.bounding_box(), bounding_box);
-      if (!text->empty()) text->push_back('\n');
-      text->append(block.text());
+      output_block.box = Union(block.box, output_block.box);
+      if (text->end != text->begin) AppendText("\n", &output->texts, text);
+      AppendText(row_blocks.GetText(index), &output->texts, text);
     }
     // Removing trailing whitespace.
-    while (!text->empty() && std::isspace(text->back())) text->pop_back();
-    output_block.Swap(output->Add());
+    while (text->end != text->begin &&
+           std::isspace(output->texts[text->end - 1])) {
+      --text->end;
+    }
+    output->texts.resize(text->end);
+    output->blocks.push_back(output_block);
   }
 }
 
@@ -431,80 +727,117 @@ void ClusterColumns(const Blocks& row_blocks, PdfTextBlocks* output) {
 // +-----+          |        |    | |
 // |  D  |          |        |    +-+
 // +-----+          +--------+
-void ClusterRows(const Blocks& page_blocks, PdfTextTableRows* rows) {
-  const auto SameRow = [](const PdfTextBlock& a, const PdfTextBlock& b) {
-    const Orientation vertical = Orientation::SOUTH;
-    const Span v_span_a = GetSpan(a.bounding_box(), vertical);
-    const Span v_span_b = GetSpan(b.bounding_box(), vertical);
-    return v_span_a.Intersects(v_span_b);
-  };
-
-  const size_t blocks_size = page_blocks.size();
-  DenseConnectedComponentsFinder connected_rows;
-  connected_rows.SetNumberOfNodes(blocks_size);
-
-  // O(N^2) algorithm with low N to find row aligned blocks.
-  for (size_t i = 0; i < blocks_size; ++i) {
-    for (size_t j = i + 1; j < blocks_size; ++j) {
-      if (SameRow(page_blocks.Get(i), page_blocks.Get(j))) {
-        connected_rows.AddEdge(i, j);
-      }
-    }
-  }
-
-  for (auto& row_indices : GetClusters(&connected_rows)) {
+void ClusterRows(const Blocks& page_blocks, RowList* output) {
+  for (auto& row_indices :
+       GetIntersectingSpanClusters(page_blocks.GetSpans(Orientation::SOUTH))) {
     const Blocks row_blocks = page_blocks.Keep(row_indices);
 
-    PdfTextTableRow row;
-    auto* text_blocks = row.mutable_blocks();
-    ClusterColumns(row_blocks, text_blocks);
+    Row row;
+    row.blocks_begin = output->blocks.size();
+    ClusterColumns(row_blocks, output);
+    row.blocks_end = output->blocks.size();
 
-    const auto left_cmp = [](const PdfTextBlock& a, const PdfTextBlock& b) {
-      return a.bounding_box().left() < b.bounding_box().left();
+    const auto left_cmp = [](const Block& a, const Block& b) {
+      return a.box.left < b.box.left;
     };
-    std::sort(text_blocks->begin(), text_blocks->end(), left_cmp);
+    std::sort(output->blocks.begin() + row.blocks_begin,
+              output->blocks.begin() + row.blocks_end, left_cmp);
 
-    BoundingBox* bounding_box = row.mutable_bounding_box();
     bool first = true;
-    for (const PdfTextBlock& block : *text_blocks) {
+    for (uint32_t i = row.blocks_begin; i < row.blocks_end; ++i) {
+      const Block& block = output->blocks[i];
       if (first) {
-        *bounding_box = block.bounding_box();
+        row.box = block.box;
         first = false;
       }
-      Union(block.bounding_box(), bounding_box);
+      row.box = Union(block.box, row.box);
     }
-    row.Swap(rows->Add());
+    output->rows.push_back(row);
   }
 }
+
+void WriteSegments(const SegmentList& segments, PdfTextSegments* output) {
+  output->Clear();
+  output->Reserve(segments.segments.size());
+  for (const Segment& segment : segments.segments) {
+    PdfTextSegment* const pdf_segment = output->Add();
+    ToBoundingBox(segment.box, pdf_segment->mutable_bounding_box());
+    pdf_segment->set_orientation(segment.orientation);
+    pdf_segment->set_font_size(segment.font_size);
+    pdf_segment->set_fill_color_hash(segment.fill_color_hash);
+    const StringPiece text = GetSubstring(segments.texts, segment.text);
+    pdf_segment->set_text(text.data(), text.size());
+    auto* const character_indices = pdf_segment->mutable_character_indices();
+    character_indices->Reserve(segment.characters_end -
+                               segment.characters_begin);
+    for (uint32_t i = segment.characters_begin; i < segment.characters_end;
+         ++i) {
+      character_indices->AddAlreadyReserved(segments.character_indices[i]);
+    }
+  }
+}
+
+void WriteBlocks(const BlockList& blocks, PdfTextBlocks* output) {
+  output->Clear();
+  output->Reserve(blocks.blocks.size());
+  for (const Block& block : blocks.blocks) {
+    PdfTextBlock* const pdf_block = output->Add();
+    ToBoundingBox(block.box, pdf_block->mutable_bounding_box());
+    pdf_block->set_orientation(block.orientation);
+    pdf_block->set_font_size(block.font_size);
+    const StringPiece text = GetSubstring(blocks.texts, block.text);
+    pdf_block->set_text(text.data(), text.size());
+  }
+}
+
+// The blocks of the rows are merged columns, their orientation is not set.
+void WriteRows(const RowList& rows, PdfTextTableRows* output) {
+  output->Clear();
+  output->Reserve(rows.rows.size());
+  for (const Row& row : rows.rows) {
+    PdfTextTableRow* const pdf_row = output->Add();
+    ToBoundingBox(row.box, pdf_row->mutable_bounding_box());
+    auto* const pdf_blocks = pdf_row->mutable_blocks();
+    pdf_blocks->Reserve(row.blocks_end - row.blocks_begin);
+    for (uint32_t i = row.blocks_begin; i < row.blocks_end; ++i) {
+      const Block& block = rows.blocks[i];
+      PdfTextBlock* const pdf_block = pdf_blocks->Add();
+      ToBoundingBox(block.box, pdf_block->mutable_bounding_box());
+      pdf_block->set_font_size(block.font_size);
+      const StringPiece text = GetSubstring(rows.texts, block.text);
+      pdf_block->set_text(text.data(), text.size());
+    }
+  }
+}
+
 }  // namespace
 
 void Cluster(PdfPage* page,
              const PdfPagePreventSegmentBindings& prevent_segment_bindings) {
   // First cluster characters into segments.
-  const PdfCharacters& page_characters = page->characters();
   const BoundingBox page_bbox = CreateBox(0, 0, page->width(), page->height());
-  Characters characters(&page_characters, page_bbox);
-  PdfTextSegments* page_segments = page->mutable_segments();
-  page_segments->Clear();
-  ClusterCharacters(characters, page_segments);
+  const Characters characters(page->characters(), page_bbox);
+  SegmentList page_segments;
+  ClusterCharacters(characters, &page_segments);
 
   // Then cluster segments in blocks.
-  Segments segments(prevent_segment_bindings, page_segments);
-  PdfTextBlocks* page_blocks = page->mutable_blocks();
-  page_blocks->Clear();
-  ClusterSegments(&segments, page_blocks);
+  BlockList page_blocks;
+  {
+    Segments segments(prevent_segment_bindings, &page_segments);
+    ClusterSegments(&segments, &page_blocks);
+  }
 
   // Last cluster blocks in rows.
-  const Blocks blocks(page_blocks);
-  PdfTextTableRows* page_rows = page->mutable_rows();
-  page_rows->Clear();
-  ClusterRows(blocks, page_rows);
+  RowList page_rows;
+  ClusterRows(Blocks(&page_blocks), &page_rows);
 
   // Sort rows from top to bottom.
-  std::sort(page_rows->begin(), page_rows->end(),
-            [](const PdfTextTableRow& a, const PdfTextTableRow& b) {
-              return a.bounding_box().top() < b.bounding_box().top();
-            });
+  std::sort(page_rows.rows.begin(), page_rows.rows.end(),
+            [](const Row& a, const Row& b) { return a.box.top < b.box.top; });
+
+  WriteSegments(page_segments, page->mutable_segments());
+  WriteBlocks(page_blocks, page->mutable_blocks());
+  WriteRows(page_rows, page->mutable_rows());
 }
 
 }  // namespace pdf
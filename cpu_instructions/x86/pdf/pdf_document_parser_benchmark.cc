@@ -0,0 +1,292 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the time and the number of allocations taken by Cluster() on real
+// pages, and on synthetic table pages from 1k to 200k characters. Run it in
+// optimized mode:
+//   bazel run -c opt //cpu_instructions/x86/pdf:pdf_document_parser_benchmark --
+//       --cpu_instructions_pdf_document=/path/to/pdf_document.pbtxt
+//
+// The synthetic pages are dense opcode tables: rows of
+// --cpu_instructions_synthetic_num_columns cells holding
+// --cpu_instructions_synthetic_num_characters_per_cell characters each, in
+// words wrapped on several lines. Each size is measured on a page with
+// horizontal text and on the same page rotated by 90 degrees.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "cpu_instructions/util/proto_util.h"
+#include "cpu_instructions/x86/pdf/pdf_document.pb.h"
+#include "cpu_instructions/x86/pdf/pdf_document_parser.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "strings/str_cat.h"
+#include "strings/string.h"
+
+DEFINE_string(
+    cpu_instructions_pdf_document,
+    "cpu_instructions/x86/pdf/testdata/253666_p170_p171_pdfdoc.pbtxt",
+    "The PdfDocument in text format whose pages are clustered. Empty to only "
+    "run on synthetic pages.");
+DEFINE_int32(cpu_instructions_num_iterations, 100,
+             "The number of times each page of the PdfDocument is clustered.");
+DEFINE_int32(cpu_instructions_max_num_characters, 200000,
+             "The number of characters of the largest synthetic page.");
+DEFINE_int32(cpu_instructions_min_num_characters_per_size, 2000000,
+             "Synthetic pages are clustered until at least this number of "
+             "characters have been clustered for each size.");
+DEFINE_int32(cpu_instructions_synthetic_num_rows, 0,
+             "When positive, only clusters synthetic pages with this number of "
+             "rows instead of increasing sizes.");
+DEFINE_int32(cpu_instructions_synthetic_num_columns, 5,
+             "The number of columns of the synthetic tables.");
+DEFINE_int32(cpu_instructions_synthetic_num_characters_per_cell, 40,
+             "The number of characters of each cell of the synthetic tables.");
+
+namespace {
+
+// The number of calls to operator new. Cluster() runs on a single thread.
+int64_t num_operator_new_calls = 0;
+
+}  // namespace
+
+void* operator new(size_t size) {
+  ++num_operator_new_calls;
+  void* const pointer = std::malloc(size == 0 ? 1 : size);
+  if (pointer == nullptr) throw std::bad_alloc();
+  return pointer;
+}
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+
+void operator delete(void* pointer, size_t) noexcept { std::free(pointer); }
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+namespace {
+
+// The layout of the synthetic tables, in points.
+constexpr const float kFontSize = 8.0f;
+constexpr const float kCharacterWidth = 0.5f * kFontSize;
+// The gap between the words of a line. Characters of a word touch each other.
+constexpr const float kWordGap = 0.25f * kFontSize;
+constexpr const float kLineHeight = 1.25f * kFontSize;
+// The space between the lines of two consecutive rows, and between columns.
+constexpr const float kRowGap = kFontSize;
+constexpr const float kColumnGap = 2.0f * kFontSize;
+constexpr const float kMargin = 36.0f;
+// Cells are wrapped at this number of characters per line.
+constexpr const int kMaxCharactersPerLine = 24;
+
+// The words of the synthetic cells, typical of the opcode tables of the SDM.
+constexpr const char* const kWords[] = {
+    "REX.W", "+",  "0F", "38", "F0",     "/r",   "VEX.128.66.0F38.W0",
+    "ib",    "iw", "C4", "NP", "66",     "imm8", "EVEX.512.F2.0F.W1",
+    "MOVBE", "r32,", "r/m32", "m64,", "xmm1,", "ymm2", "/digit"};
+
+// Returns the texts of the lines of a cell of num_characters non space
+// characters, made of words wrapped at kMaxCharactersPerLine characters.
+std::vector<std::vector<string>> GetCellLines(int num_characters,
+                                              uint32_t* state) {
+  std::vector<std::vector<string>> lines(1);
+  int line_size = 0;
+  while (num_characters > 0) {
+    *state = *state * 1103515245 + 12345;
+    string word = kWords[(*state >> 8) % (sizeof(kWords) / sizeof(*kWords))];
+    const int word_size = std::min<int>(word.size(), num_characters);
+    word.resize(word_size);
+    if (line_size > 0 && line_size + 1 + word_size > kMaxCharactersPerLine) {
+      lines.emplace_back();
+      line_size = 0;
+    }
+    num_characters -= word_size;
+    line_size += (line_size > 0 ? 1 : 0) + word_size;
+    lines.back().push_back(std::move(word));
+  }
+  return lines;
+}
+
+// Returns a synthetic table page. The table is laid out with the text going
+// along u and the lines stacked along v, which are mapped to the page
+// coordinates according to orientation: EAST for horizontal text, NORTH for
+// text going up, i.e. a table rotated by 90 degrees.
+PdfPage GetSyntheticPage(int num_rows, int num_columns,
+                         int num_characters_per_cell, Orientation orientation) {
+  CHECK(orientation == EAST || orientation == NORTH);
+  uint32_t state = 1;
+  std::vector<std::vector<std::vector<string>>> cells;
+  int max_num_lines = 1;
+  for (int i = 0; i < num_rows * num_columns; ++i) {
+    cells.push_back(GetCellLines(num_characters_per_cell, &state));
+    max_num_lines = std::max<int>(max_num_lines, cells.back().size());
+  }
+  const float column_width = kMaxCharactersPerLine * kCharacterWidth;
+  const float row_height = max_num_lines * kLineHeight + kRowGap;
+  const float u_size = 2 * kMargin + num_columns * (column_width + kColumnGap);
+  const float v_size = 2 * kMargin + num_rows * row_height;
+  PdfPage page;
+  page.set_number(1);
+  page.set_width(orientation == EAST ? u_size : v_size);
+  page.set_height(orientation == EAST ? v_size : u_size);
+  page.mutable_characters()->Reserve(num_rows * num_columns *
+                                     num_characters_per_cell);
+  const auto add_character = [&page, orientation, u_size](char c, float u,
+                                                          float v) {
+    PdfCharacter* const character = page.add_characters();
+    character->set_codepoint(c);
+    character->set_utf8(string(1, c));
+    character->set_font_size(kFontSize);
+    character->set_orientation(orientation);
+    character->set_fill_color_hash(1);
+    BoundingBox* const box = character->mutable_bounding_box();
+    if (orientation == EAST) {
+      box->set_left(u);
+      box->set_top(v);
+      box->set_right(u + kCharacterWidth);
+      box->set_bottom(v + kFontSize);
+    } else {
+      box->set_left(v);
+      box->set_top(u_size - u - kCharacterWidth);
+      box->set_right(v + kFontSize);
+      box->set_bottom(u_size - u);
+    }
+  };
+  // The characters are in reading order, like in the content stream of most
+  // pages.
+  for (int row = 0; row < num_rows; ++row) {
+    for (int column = 0; column < num_columns; ++column) {
+      const auto& lines = cells[row * num_columns + column];
+      for (size_t line = 0; line < lines.size(); ++line) {
+        float u = kMargin + column * (column_width + kColumnGap);
+        const float v = kMargin + row * row_height + line * kLineHeight;
+        for (const string& word : lines[line]) {
+          for (const char c : word) {
+            add_character(c, u, v);
+            u += kCharacterWidth;
+          }
+          u += kWordGap;
+        }
+      }
+    }
+  }
+  return page;
+}
+
+struct Measures {
+  int64_t num_pages = 0;
+  int64_t num_characters = 0;
+  int64_t num_allocations = 0;
+  double seconds = 0.0;
+};
+
+// Clusters a copy of each page num_iterations times.
+void ClusterPages(const std::vector<const PdfPage*>& pages, int num_iterations,
+                  Measures* measures) {
+  for (int i = 0; i < num_iterations; ++i) {
+    for (const PdfPage* page : pages) {
+      // Copying the page is not part of the measure.
+      PdfPage clustered_page = *page;
+      const int64_t allocations_before = num_operator_new_calls;
+      const auto start = std::chrono::steady_clock::now();
+      Cluster(&clustered_page);
+      const std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      measures->seconds += elapsed.count();
+      measures->num_allocations += num_operator_new_calls - allocations_before;
+      measures->num_characters += page->characters_size();
+      ++measures->num_pages;
+    }
+  }
+}
+
+void Report(const string& name, const Measures& measures) {
+  CHECK_GT(measures.num_pages, 0);
+  LOG(INFO) << name << ": " << measures.num_pages << " pages of "
+            << measures.num_characters / measures.num_pages
+            << " characters on average: "
+            << 1e6 * measures.seconds / measures.num_pages << " us/page, "
+            << 1e9 * measures.seconds / measures.num_characters
+            << " ns/character, "
+            << measures.num_allocations / measures.num_pages
+            << " allocations/page";
+}
+
+void RunOnDocument() {
+  PdfDocument document =
+      ReadTextProtoOrDie<PdfDocument>(FLAGS_cpu_instructions_pdf_document);
+  std::vector<const PdfPage*> pages;
+  for (PdfPage& page : *document.mutable_pages()) {
+    page.clear_segments();
+    page.clear_blocks();
+    page.clear_rows();
+    pages.push_back(&page);
+  }
+  CHECK(!pages.empty());
+  Measures measures;
+  ClusterPages(pages, FLAGS_cpu_instructions_num_iterations, &measures);
+  Report(FLAGS_cpu_instructions_pdf_document, measures);
+}
+
+void RunOnSyntheticPages(int num_rows) {
+  const int num_columns = FLAGS_cpu_instructions_synthetic_num_columns;
+  const int num_characters_per_cell =
+      FLAGS_cpu_instructions_synthetic_num_characters_per_cell;
+  for (const Orientation orientation : {EAST, NORTH}) {
+    const PdfPage page = GetSyntheticPage(num_rows, num_columns,
+                                          num_characters_per_cell, orientation);
+    const int num_iterations = std::max(
+        1, FLAGS_cpu_instructions_min_num_characters_per_size /
+               std::max(1, page.characters_size()));
+    Measures measures;
+    ClusterPages({&page}, num_iterations, &measures);
+    Report(StrCat("synthetic ", num_rows, "x", num_columns, " table, ",
+                  Orientation_Name(orientation)),
+           measures);
+  }
+}
+
+void Main() {
+  if (!FLAGS_cpu_instructions_pdf_document.empty()) RunOnDocument();
+  CHECK_GT(FLAGS_cpu_instructions_synthetic_num_columns, 0);
+  CHECK_GT(FLAGS_cpu_instructions_synthetic_num_characters_per_cell, 0);
+  if (FLAGS_cpu_instructions_synthetic_num_rows > 0) {
+    RunOnSyntheticPages(FLAGS_cpu_instructions_synthetic_num_rows);
+    return;
+  }
+  const int num_characters_per_row =
+      FLAGS_cpu_instructions_synthetic_num_columns *
+      FLAGS_cpu_instructions_synthetic_num_characters_per_cell;
+  for (const int num_characters :
+       {1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000}) {
+    if (num_characters > FLAGS_cpu_instructions_max_num_characters) break;
+    RunOnSyntheticPages(std::max(1, num_characters / num_characters_per_row));
+  }
+}
+
+}  // namespace
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cpu_instructions::x86::pdf::Main();
+  return 0;
+}
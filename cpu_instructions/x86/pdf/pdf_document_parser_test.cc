@@ -14,12 +14,14 @@
 
 #include "cpu_instructions/x86/pdf/pdf_document_parser.h"
 
+#include <cstdlib>
 #include <iterator>
 
 #include "cpu_instructions/util/proto_util.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "src/google/protobuf/text_format.h"
+#include "strings/str_cat.h"
 
 using ::testing::ElementsAreArray;
 
@@ -34,6 +36,8 @@ bool operator==(const BoundingBox& a, const BoundingBox& b) {
 
 namespace {
 
+const char kTestDataPath[] = "/__main__/cpu_instructions/x86/pdf/testdata/";
+
 TEST(ExtractLine, no_segment) {
   PdfPage page;
   Cluster(&page);
@@ -99,6 +103,58 @@ TEST(ExtractLine, connect_forward) {
   ASSERT_THAT(page.segments(0).character_indices(), ElementsAreArray({0, 1}));
 }
 
+TEST(ExtractLine, connect_out_of_stream_order) {
+  PdfPage page = ParseProtoFromStringOrDie<PdfPage>(R"(
+    number    : 1
+    width     : 612
+    height    : 792
+    characters: {
+      codepoint      : 0x0000006e
+      utf8: "n"
+      font_size      : 24.0
+      orientation    : EAST
+      bounding_box: {
+        left  : 209.3232
+        top   : 165.84
+        right : 223.0992
+        bottom: 189.84
+      }
+      fill_color_hash: 1
+    }
+    characters: {
+      codepoint      : 0x00000049
+      utf8: "I"
+      font_size      : 24.0
+      orientation    : EAST
+      bounding_box: {
+        left  : 202.92
+        top   : 165.84
+        right : 209.328
+        bottom: 189.84
+      }
+      fill_color_hash: 1
+    }
+    characters: {
+      codepoint      : 0x00000074
+      utf8: "t"
+      font_size      : 24.0
+      orientation    : EAST
+      bounding_box: {
+        left  : 223.0992
+        top   : 165.84
+        right : 229.7712
+        bottom: 189.84
+      }
+      fill_color_hash: 1
+    }
+  )");
+  Cluster(&page);
+  ASSERT_EQ(page.segments().size(), 1);
+  ASSERT_THAT(page.segments(0).character_indices(),
+              ElementsAreArray({1, 0, 2}));
+  EXPECT_EQ(page.segments(0).text(), "Int");
+}
+
 TEST(ExtractLine, connect_bottom_top) {
   PdfPage page = ParseProtoFromStringOrDie<PdfPage>(R"(
     number    : 1
@@ -181,6 +237,182 @@ TEST(ExtractLine, do_not_connect) {
   EXPECT_EQ(page.rows(0).blocks(1).text(), "n");
 }
 
+TEST(ExtractLine, connect_overprinted) {
+  // Both "I" link to "n", the characters do not form a chain.
+  PdfPage page = ParseProtoFromStringOrDie<PdfPage>(R"(
+    number    : 1
+    width     : 612
+    height    : 792
+    characters: {
+      codepoint      : 0x00000049
+      utf8: "I"
+      font_size      : 24.0
+      orientation    : EAST
+      bounding_box: {
+        left  : 202.92
+        top   : 165.84
+        right : 209.328
+        bottom: 189.84
+      }
+      fill_color_hash: 1
+    }
+    characters: {
+      codepoint      : 0x00000049
+      utf8: "I"
+      font_size      : 24.0
+      orientation    : EAST
+      bounding_box: {
+        left  : 202.92
+        top   : 165.84
+        right : 209.328
+        bottom: 189.84
+      }
+      fill_color_hash: 1
+    }
+    characters: {
+      codepoint      : 0x0000006e
+      utf8: "n"
+      font_size      : 24.0
+      orientation    : EAST
+      bounding_box: {
+        left  : 209.3232
+        top   : 165.84
+        right : 223.0992
+        bottom: 189.84
+      }
+      fill_color_hash: 1
+    }
+  )");
+  Cluster(&page);
+  ASSERT_EQ(page.segments().size(), 1);
+  ASSERT_THAT(page.segments(0).character_indices(),
+              ElementsAreArray({0, 1, 2}));
+  EXPECT_EQ(page.segments(0).text(), "IIn");
+}
+
+// Adds a 24pt character of the line at the top of the page, between left and
+// right.
+void AddCharacter(const string& utf8, float left, float right, PdfPage* page) {
+  PdfCharacter* const character = page->add_characters();
+  character->set_codepoint(utf8[0]);
+  character->set_utf8(utf8);
+  character->set_font_size(24.0f);
+  character->set_orientation(EAST);
+  character->set_fill_color_hash(1);
+  BoundingBox* const bounding_box = character->mutable_bounding_box();
+  bounding_box->set_left(left);
+  bounding_box->set_top(165.84f);
+  bounding_box->set_right(right);
+  bounding_box->set_bottom(189.84f);
+}
+
+PdfPage CreatePage() {
+  PdfPage page;
+  page.set_number(1);
+  page.set_width(612);
+  page.set_height(792);
+  return page;
+}
+
+TEST(ExtractLine, connect_overprinted_with_offset) {
+  // "In" is drawn twice, the second time shifted by one unit to simulate bold
+  // text. Each copy is a glyph run, but the closest character in the forward
+  // direction of a glyph is its own copy.
+  PdfPage page = CreatePage();
+  AddCharacter("I", 202.92, 209.328, &page);
+  AddCharacter("n", 209.328, 223.0992, &page);
+  AddCharacter("I", 203.92, 210.328, &page);
+  AddCharacter("n", 210.328, 224.0992, &page);
+  Cluster(&page);
+  ASSERT_EQ(page.segments().size(), 1);
+  EXPECT_THAT(page.segments(0).character_indices(),
+              ElementsAreArray({0, 2, 1, 3}));
+  EXPECT_EQ(page.segments(0).text(), "IInn");
+}
+
+TEST(ExtractLine, connect_interleaved_runs) {
+  // Two runs on the same baseline, the second one drawn over the first one
+  // with an offset of half a glyph.
+  PdfPage page = CreatePage();
+  AddCharacter("a", 100, 110, &page);
+  AddCharacter("b", 110, 120, &page);
+  AddCharacter("x", 105, 115, &page);
+  AddCharacter("y", 115, 125, &page);
+  Cluster(&page);
+  ASSERT_EQ(page.segments().size(), 1);
+  EXPECT_THAT(page.segments(0).character_indices(),
+              ElementsAreArray({0, 2, 1, 3}));
+  EXPECT_EQ(page.segments(0).text(), "axby");
+}
+
+TEST(ExtractLine, do_not_connect_off_page) {
+  // The center of "b" is off the page, it is not linked to "a" even though
+  // they form a glyph run.
+  PdfPage page = CreatePage();
+  AddCharacter("a", 600, 610, &page);
+  AddCharacter("b", 610, 620, &page);
+  Cluster(&page);
+  ASSERT_EQ(page.segments().size(), 2);
+  EXPECT_THAT(page.segments(0).character_indices(), ElementsAreArray({0}));
+  EXPECT_THAT(page.segments(1).character_indices(), ElementsAreArray({1}));
+}
+
+// The clustered pages were generated from the characters of the same pages
+// before the clustering was moved to plain structs, Cluster must still give
+// the same segments, blocks and rows.
+TEST(Cluster, SameOutputOnTestPages) {
+  PdfDocument pdf_document = ReadTextProtoOrDie<PdfDocument>(StrCat(
+      getenv("TEST_SRCDIR"), kTestDataPath, "253666_p170_p171_pdfdoc.pbtxt"));
+  const PdfDocument expected = ReadTextProtoOrDie<PdfDocument>(
+      StrCat(getenv("TEST_SRCDIR"), kTestDataPath,
+             "253666_p170_p171_clustered_pdfdoc.pbtxt"));
+  ASSERT_EQ(pdf_document.pages_size(), expected.pages_size());
+  for (int i = 0; i < pdf_document.pages_size(); ++i) {
+    PdfPage* const page = pdf_document.mutable_pages(i);
+    Cluster(page);
+    page->clear_characters();
+    EXPECT_EQ(page->SerializeAsString(), expected.pages(i).SerializeAsString())
+        << "page " << page->number();
+  }
+}
+
+TEST(Cluster, PreventSegmentBindings) {
+  PdfDocument pdf_document = ReadTextProtoOrDie<PdfDocument>(StrCat(
+      getenv("TEST_SRCDIR"), kTestDataPath, "253666_p170_p171_pdfdoc.pbtxt"));
+  PdfPage page = pdf_document.pages(0);
+  Cluster(&page);
+  // Finds a block made of several segments.
+  const PdfTextBlock* joined_block = nullptr;
+  for (const auto& block : page.blocks()) {
+    if (block.text().find('\n') != string::npos) {
+      joined_block = &block;
+      break;
+    }
+  }
+  ASSERT_NE(joined_block, nullptr);
+  const string& text = joined_block->text();
+  const size_t first_end = text.find('\n');
+  const size_t second_end = text.find('\n', first_end + 1);
+  PdfPagePreventSegmentBindings prevent_bindings;
+  auto* const prevent_binding = prevent_bindings.Add();
+  prevent_binding->set_first(text.substr(0, first_end));
+  prevent_binding->set_second(text.substr(
+      first_end + 1, second_end == string::npos ? string::npos
+                                                : second_end - first_end - 1));
+  // A binding that matches no pair of segments is reported, and ignored.
+  auto* const unused_binding = prevent_bindings.Add();
+  unused_binding->set_first("not a segment");
+  unused_binding->set_second("neither");
+
+  PdfPage prevented_page = pdf_document.pages(0);
+  Cluster(&prevented_page, prevent_bindings);
+  EXPECT_EQ(prevented_page.segments_size(), page.segments_size());
+  EXPECT_EQ(prevented_page.blocks_size(), page.blocks_size() + 1);
+  for (const auto& block : prevented_page.blocks()) {
+    EXPECT_NE(block.text(), text);
+  }
+}
+
 }  // namespace
 
 }  // namespace pdf
@@ -0,0 +1,197 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Writes a PDF file that draws the characters of a PdfDocument text proto. The
+// SDM pages in testdata are only checked in once parsed; this gives the tests
+// that run the tools end to end a PDF file to start from. Each character is
+// drawn with Helvetica at the position, size and width of its bounding box,
+// left to right whatever its orientation, so the result is close to, but not
+// the same as, the original pages. The document id is written to the document
+// information dictionary, so that the parser finds the patches of the document.
+
+#include <cstdio>
+#include <vector>
+#include "strings/string.h"
+
+#include "gflags/gflags.h"
+
+#include "cpu_instructions/util/proto_util.h"
+#include "cpu_instructions/x86/pdf/pdf_document.pb.h"
+#include "glog/logging.h"
+#include "libutf/utf.h"
+#include "strings/str_cat.h"
+
+DEFINE_string(cpu_instructions_input_file, "",
+              "The PdfDocument to draw, as a text proto.");
+DEFINE_string(cpu_instructions_document_id_file, "",
+              "A PdfDocumentId text proto that replaces the document id of "
+              "the input.");
+DEFINE_string(cpu_instructions_output_file, "", "Where to write the PDF file.");
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+namespace {
+
+// All the glyphs of the font have this width, in thousandths of the font size.
+// Each character is then scaled horizontally to the width of its bounding box.
+constexpr const int kGlyphWidth = 1000;
+
+string FormatNumber(float value) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.3f", value);
+  return buffer;
+}
+
+// Returns the character as a PDF string in WinAnsiEncoding.
+string GetCharacterString(const PdfCharacter& character) {
+  unsigned char code = '?';
+  if (character.codepoint() < 256) {
+    code = character.codepoint();
+  } else if (character.utf8().size() == 1) {
+    code = character.utf8()[0];
+  }
+  if (code == '(' || code == ')' || code == '\\') {
+    return StrCat("(\\", string(1, code), ")");
+  }
+  if (code < 0x20 || code >= 0x7f) {
+    char buffer[8];
+    snprintf(buffer, sizeof(buffer), "(\\%03o)", code);
+    return buffer;
+  }
+  return StrCat("(", string(1, code), ")");
+}
+
+// Returns utf8 as a PDF text string, in UTF-16BE with a byte order mark.
+string GetTextString(const string& utf8) {
+  string text = utf8;
+  string hex = "<FEFF";
+  for (char* c = &text[0]; *c != '\0';) {
+    Rune rune = 0;
+    c += chartorune(&rune, c);
+    CHECK_LT(rune, 0x10000) << "Not in the basic multilingual plane: " << utf8;
+    char buffer[8];
+    snprintf(buffer, sizeof(buffer), "%04X", rune);
+    hex += buffer;
+  }
+  return hex + ">";
+}
+
+string GetPageContent(const PdfPage& page) {
+  string content = "BT\n";
+  float font_size = -1.0f;
+  for (const PdfCharacter& character : page.characters()) {
+    if (character.font_size() != font_size) {
+      font_size = character.font_size();
+      StrAppend(&content, "/F1 ", FormatNumber(font_size), " Tf\n");
+    }
+    // The bounding boxes are in display coordinates, where y grows downwards,
+    // and their bottom is on the baseline.
+    const BoundingBox& box = character.bounding_box();
+    StrAppend(&content, "1 0 0 1 ", FormatNumber(box.left()), " ",
+              FormatNumber(page.height() - box.bottom()));
+    // The horizontal scaling, in percent.
+    const float glyph_width = font_size * kGlyphWidth / 1000.0f;
+    const float scaling =
+        glyph_width > 0.0f ? 100.0f * (box.right() - box.left()) / glyph_width
+                           : 100.0f;
+    StrAppend(&content, " Tm ", FormatNumber(scaling));
+    StrAppend(&content, " Tz ", GetCharacterString(character), " Tj\n");
+  }
+  content += "ET\n";
+  return content;
+}
+
+string GetPdf(const PdfDocument& pdf_document) {
+  // The object numbers are: 1 for the catalog, 2 for the page tree, 3 for the
+  // font, then the page and its content stream for each page, and last the
+  // document information dictionary.
+  string widths;
+  for (int code = 0; code < 256; ++code) StrAppend(&widths, kGlyphWidth, " ");
+  std::vector<string> objects = {
+      "<< /Type /Catalog /Pages 2 0 R >>", "",
+      StrCat("<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica "
+             "/Encoding /WinAnsiEncoding /FirstChar 0 /LastChar 255 /Widths [",
+             widths, "] >>")};
+  string kids;
+  for (const PdfPage& page : pdf_document.pages()) {
+    const int page_object = objects.size() + 1;
+    StrAppend(&kids, page_object, " 0 R ");
+    objects.push_back(StrCat("<< /Type /Page /Parent 2 0 R /MediaBox [0 0 ",
+                             FormatNumber(page.width()), " ",
+                             FormatNumber(page.height()),
+                             "] /Resources << /Font << /F1 3 0 R >> >> "
+                             "/Contents ",
+                             page_object + 1, " 0 R >>"));
+    const string content = GetPageContent(page);
+    objects.push_back(StrCat("<< /Length ", content.size(), " >>\nstream\n",
+                             content, "endstream"));
+  }
+  objects[1] = StrCat("<< /Type /Pages /Kids [", kids, "] /Count ",
+                      pdf_document.pages_size(), " >>");
+  const PdfDocumentId& document_id = pdf_document.document_id();
+  objects.push_back(StrCat(
+      "<< /Title ", GetTextString(document_id.title()), " /CreationDate ",
+      GetTextString(document_id.creation_date()), " /ModDate ",
+      GetTextString(document_id.modification_date()), " >>"));
+  const size_t info_object = objects.size();
+  string pdf = "%PDF-1.4\n";
+  std::vector<size_t> offsets;
+  for (size_t i = 0; i < objects.size(); ++i) {
+    offsets.push_back(pdf.size());
+    StrAppend(&pdf, i + 1, " 0 obj\n", objects[i], "\nendobj\n");
+  }
+  const size_t xref_offset = pdf.size();
+  StrAppend(&pdf, "xref\n0 ", objects.size() + 1, "\n0000000000 65535 f \n");
+  for (const size_t offset : offsets) {
+    char entry[21];
+    snprintf(entry, sizeof(entry), "%010zu 00000 n \n", offset);
+    pdf += entry;
+  }
+  pdf += StrCat("trailer\n<< /Size ", objects.size() + 1,
+                " /Root 1 0 R /Info ", info_object, " 0 R >>\nstartxref\n",
+                xref_offset, "\n%%EOF\n");
+  return pdf;
+}
+
+void Main() {
+  CHECK(!FLAGS_cpu_instructions_input_file.empty())
+      << "missing --cpu_instructions_input_file";
+  CHECK(!FLAGS_cpu_instructions_output_file.empty())
+      << "missing --cpu_instructions_output_file";
+  PdfDocument pdf_document =
+      ReadTextProtoOrDie<PdfDocument>(FLAGS_cpu_instructions_input_file);
+  if (!FLAGS_cpu_instructions_document_id_file.empty()) {
+    *pdf_document.mutable_document_id() = ReadTextProtoOrDie<PdfDocumentId>(
+        FLAGS_cpu_instructions_document_id_file);
+  }
+  const string pdf = GetPdf(pdf_document);
+  FILE* const output_file =
+      fopen(FLAGS_cpu_instructions_output_file.c_str(), "wb");
+  CHECK(output_file != nullptr) << "Cannot open "
+                                << FLAGS_cpu_instructions_output_file;
+  CHECK_EQ(fwrite(pdf.data(), 1, pdf.size(), output_file), pdf.size());
+  CHECK_EQ(fclose(output_file), 0);
+}
+
+}  // namespace
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cpu_instructions::x86::pdf::Main();
+  return 0;
+}
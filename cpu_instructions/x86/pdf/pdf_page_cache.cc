@@ -0,0 +1,105 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/x86/pdf/pdf_page_cache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <cinttypes>
+
+#include "cpu_instructions/util/fingerprint.h"
+#include "glog/logging.h"
+#include "strings/str_cat.h"
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+
+namespace {
+
+// Changed whenever the parser produces different pages from the same content,
+// so that the pages cached by older versions are not used.
+constexpr const uint64_t kParserVersion = 1;
+
+}  // namespace
+
+PdfPageCache::PdfPageCache(const string& directory)
+    : directory_(directory), num_hits_(0), num_misses_(0), num_inserts_(0) {
+  CHECK(!directory_.empty());
+  if (mkdir(directory_.c_str(), 0755) != 0) {
+    CHECK_EQ(errno, EEXIST) << "Could not create page cache directory '"
+                            << directory_ << "'";
+  }
+}
+
+string PdfPageCache::GetKey(const PdfDocumentId& document_id,
+                            const int page_number, const string& page_content,
+                            const PdfPageChanges& page_changes) {
+  Fingerprint fingerprint;
+  fingerprint.AddUint64(kParserVersion);
+  fingerprint.Add(document_id.SerializeAsString());
+  fingerprint.AddUint64(page_number);
+  fingerprint.Add(page_content);
+  fingerprint.Add(page_changes.SerializeAsString());
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%016" PRIx64, fingerprint.value());
+  return StrCat("page_", page_number, "_", buffer);
+}
+
+string PdfPageCache::GetFilename(const string& key) const {
+  return StrCat(directory_, "/", key, ".pb");
+}
+
+bool PdfPageCache::Lookup(const string& key, PdfPage* page) {
+  FILE* const file = fopen(GetFilename(key).c_str(), "rb");
+  bool found = false;
+  if (file != nullptr) {
+    found = page->ParseFromFileDescriptor(fileno(file));
+    fclose(file);
+  }
+  if (found) {
+    ++num_hits_;
+  } else {
+    ++num_misses_;
+  }
+  return found;
+}
+
+void PdfPageCache::Insert(const string& key, const PdfPage& page) {
+  // Writes to a temporary file first and renames it so that concurrent or
+  // interrupted runs never see a partial entry.
+  const string filename = GetFilename(key);
+  const string temp_filename =
+      StrCat(filename, ".tmp.", getpid(), ".", num_inserts_++);
+  FILE* const file = fopen(temp_filename.c_str(), "wb");
+  if (file == nullptr) {
+    LOG(WARNING) << "Could not write page cache entry '" << temp_filename
+                 << "'";
+    return;
+  }
+  const bool written = page.SerializeToFileDescriptor(fileno(file));
+  const bool closed = fclose(file) == 0;
+  if (!written || !closed ||
+      rename(temp_filename.c_str(), filename.c_str()) != 0) {
+    LOG(WARNING) << "Could not write page cache entry '" << filename << "'";
+    remove(temp_filename.c_str());
+  }
+}
+
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
@@ -0,0 +1,72 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// An on-disk cache of parsed PdfPages, to avoid rendering and clustering pages
+// that did not change between two runs.
+
+#ifndef CPU_INSTRUCTIONS_X86_PDF_PDF_PAGE_CACHE_H_
+#define CPU_INSTRUCTIONS_X86_PDF_PDF_PAGE_CACHE_H_
+
+#include <atomic>
+#include <cstdint>
+#include "strings/string.h"
+
+#include "cpu_instructions/x86/pdf/pdf_document.pb.h"
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+
+// Stores clustered and patched PdfPages as files in a directory. Entries are
+// content-addressed: the key depends on everything that determines the parsed
+// page, so stale entries are never returned and no invalidation is needed.
+// This class is thread-safe.
+class PdfPageCache {
+ public:
+  // The directory is created if it does not exist.
+  explicit PdfPageCache(const string& directory);
+
+  PdfPageCache(const PdfPageCache&) = delete;
+  PdfPageCache& operator=(const PdfPageCache&) = delete;
+
+  // Returns the key for a page given the document it belongs to, its number,
+  // its raw content (i.e. the decoded content stream) and the changes that are
+  // applied to it when parsing.
+  static string GetKey(const PdfDocumentId& document_id, int page_number,
+                       const string& page_content,
+                       const PdfPageChanges& page_changes);
+
+  // Fills 'page' and returns true if there is an entry for 'key'.
+  bool Lookup(const string& key, PdfPage* page);
+
+  // Adds an entry for 'key'. Failures are logged and otherwise ignored.
+  void Insert(const string& key, const PdfPage& page);
+
+  int64_t num_hits() const { return num_hits_; }
+  int64_t num_misses() const { return num_misses_; }
+
+ private:
+  string GetFilename(const string& key) const;
+
+  const string directory_;
+  std::atomic<int64_t> num_hits_;
+  std::atomic<int64_t> num_misses_;
+  std::atomic<int64_t> num_inserts_;
+};
+
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_X86_PDF_PDF_PAGE_CACHE_H_
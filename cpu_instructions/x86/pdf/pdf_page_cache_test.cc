@@ -0,0 +1,81 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/x86/pdf/pdf_page_cache.h"
+
+#include <stdlib.h>
+
+#include "cpu_instructions/testing/test_util.h"
+#include "cpu_instructions/util/proto_util.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "strings/str_cat.h"
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+namespace {
+
+using ::cpu_instructions::testing::EqualsProto;
+
+string GetCacheDirectory(const string& name) {
+  return StrCat(getenv("TEST_TMPDIR"), "/", name);
+}
+
+TEST(PdfPageCacheTest, GetKey) {
+  const PdfDocumentId document_id =
+      ParseProtoFromStringOrDie<PdfDocumentId>("title: 'SDM'");
+  const PdfPageChanges changes = ParseProtoFromStringOrDie<PdfPageChanges>(
+      "patches { row: 1 col: 2 expected: 'a' replacement: 'b' }");
+  const string key =
+      PdfPageCache::GetKey(document_id, 12, "BT (abc) Tj ET", changes);
+  // Keys are stable.
+  EXPECT_EQ(key,
+            PdfPageCache::GetKey(document_id, 12, "BT (abc) Tj ET", changes));
+  EXPECT_THAT(key, ::testing::StartsWith("page_12_"));
+  // And change with each of the inputs.
+  EXPECT_NE(key, PdfPageCache::GetKey(PdfDocumentId(), 12, "BT (abc) Tj ET",
+                                      changes));
+  EXPECT_NE(key,
+            PdfPageCache::GetKey(document_id, 13, "BT (abc) Tj ET", changes));
+  EXPECT_NE(key,
+            PdfPageCache::GetKey(document_id, 12, "BT (abd) Tj ET", changes));
+  EXPECT_NE(key, PdfPageCache::GetKey(document_id, 12, "BT (abc) Tj ET",
+                                      PdfPageChanges()));
+}
+
+TEST(PdfPageCacheTest, LookupAndInsert) {
+  PdfPageCache cache(GetCacheDirectory("lookup_and_insert"));
+  const PdfPage page = ParseProtoFromStringOrDie<PdfPage>(R"(
+      number: 3
+      rows { blocks { text: 'ADD' } })");
+  PdfPage cached_page;
+  EXPECT_FALSE(cache.Lookup("key", &cached_page));
+  cache.Insert("key", page);
+  EXPECT_TRUE(cache.Lookup("key", &cached_page));
+  EXPECT_THAT(cached_page, EqualsProto(page));
+  EXPECT_EQ(cache.num_hits(), 1);
+  EXPECT_EQ(cache.num_misses(), 1);
+
+  // Entries persist across instances.
+  PdfPageCache other_cache(GetCacheDirectory("lookup_and_insert"));
+  PdfPage other_cached_page;
+  EXPECT_TRUE(other_cache.Lookup("key", &other_cached_page));
+  EXPECT_THAT(other_cached_page, EqualsProto(page));
+}
+
+}  // namespace
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
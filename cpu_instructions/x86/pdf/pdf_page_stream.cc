@@ -0,0 +1,78 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "cpu_instructions/x86/pdf/pdf_page_stream.h"
+
+#include <cstdint>
+
+#include "glog/logging.h"
+#include "src/google/protobuf/io/coded_stream.h"
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+
+using ::google::protobuf::io::CodedInputStream;
+using ::google::protobuf::io::CodedOutputStream;
+using ::google::protobuf::io::FileInputStream;
+using ::google::protobuf::io::FileOutputStream;
+
+PdfPageStreamWriter::PdfPageStreamWriter(const string& filename)
+    : filename_(filename), file_(fopen(filename.c_str(), "wb")) {
+  CHECK(file_) << "Could not open '" << filename << "'";
+  output_stream_.reset(new FileOutputStream(fileno(file_)));
+}
+
+PdfPageStreamWriter::~PdfPageStreamWriter() {
+  CHECK(output_stream_->Flush()) << "Could not write '" << filename_ << "'";
+  output_stream_.reset();
+  fclose(file_);
+}
+
+void PdfPageStreamWriter::WriteOrDie(const PdfPage& page) {
+  CodedOutputStream coded_stream(output_stream_.get());
+  coded_stream.WriteVarint32(page.ByteSize());
+  page.SerializeWithCachedSizes(&coded_stream);
+  CHECK(!coded_stream.HadError()) << "Could not write '" << filename_ << "'";
+}
+
+void ReadPdfPageStreamOrDie(
+    const string& filename,
+    const std::function<void(const PdfPage&)>& callback) {
+  FILE* const input_file = fopen(filename.c_str(), "rb");
+  CHECK(input_file) << "Could not open '" << filename << "'";
+  {
+    FileInputStream input_stream(fileno(input_file));
+    PdfPage page;
+    while (true) {
+      // A CodedInputStream per page, its byte limit applies to the whole
+      // stream it reads.
+      CodedInputStream coded_stream(&input_stream);
+      uint32_t size = 0;
+      if (!coded_stream.ReadVarint32(&size)) break;  // End of the stream.
+      const CodedInputStream::Limit limit = coded_stream.PushLimit(size);
+      CHECK(page.ParseFromCodedStream(&coded_stream) &&
+            coded_stream.ConsumedEntireMessage())
+          << "Corrupted page stream '" << filename << "'";
+      coded_stream.PopLimit(limit);
+      callback(page);
+    }
+  }
+  fclose(input_file);
+}
+
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
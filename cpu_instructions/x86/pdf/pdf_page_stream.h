@@ -0,0 +1,64 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Reads and writes PdfPages as a stream of length-delimited protos, so that
+// large documents can be written and read one page at a time.
+
+#ifndef CPU_INSTRUCTIONS_X86_PDF_PDF_PAGE_STREAM_H_
+#define CPU_INSTRUCTIONS_X86_PDF_PDF_PAGE_STREAM_H_
+
+#include <stdio.h>
+#include <functional>
+#include <memory>
+#include "strings/string.h"
+
+#include "cpu_instructions/x86/pdf/pdf_document.pb.h"
+#include "src/google/protobuf/io/zero_copy_stream_impl.h"
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+
+// Appends pages to a file. Each page is written as its size (a varint)
+// followed by its binary encoding.
+class PdfPageStreamWriter {
+ public:
+  // Creates or truncates the file.
+  explicit PdfPageStreamWriter(const string& filename);
+
+  PdfPageStreamWriter(const PdfPageStreamWriter&) = delete;
+  PdfPageStreamWriter& operator=(const PdfPageStreamWriter&) = delete;
+
+  // Flushes and closes the file.
+  ~PdfPageStreamWriter();
+
+  void WriteOrDie(const PdfPage& page);
+
+ private:
+  const string filename_;
+  FILE* const file_;
+  std::unique_ptr<google::protobuf::io::FileOutputStream> output_stream_;
+};
+
+// Calls 'callback' on each page of a file written by PdfPageStreamWriter, in
+// order.
+void ReadPdfPageStreamOrDie(const string& filename,
+                            const std::function<void(const PdfPage&)>& callback);
+
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_X86_PDF_PDF_PAGE_STREAM_H_
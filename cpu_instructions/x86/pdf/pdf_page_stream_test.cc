@@ -0,0 +1,69 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "cpu_instructions/x86/pdf/pdf_page_stream.h"
+
+#include <stdlib.h>
+#include <vector>
+
+#include "cpu_instructions/testing/test_util.h"
+#include "cpu_instructions/util/proto_util.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "strings/str_cat.h"
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+namespace {
+
+using ::cpu_instructions::testing::EqualsProto;
+using ::testing::ElementsAre;
+
+constexpr char kFirstPage[] = R"(
+  number: 1
+  characters { utf8: "a" font_size: 10 })";
+constexpr char kSecondPage[] = R"(
+  number: 2
+  rows { blocks { text: "b" } })";
+
+TEST(PdfPageStreamTest, WriteAndRead) {
+  const string filename = StrCat(getenv("TEST_TMPDIR"), "/pages");
+  {
+    PdfPageStreamWriter writer(filename);
+    writer.WriteOrDie(ParseProtoFromStringOrDie<PdfPage>(kFirstPage));
+    writer.WriteOrDie(PdfPage());
+    writer.WriteOrDie(ParseProtoFromStringOrDie<PdfPage>(kSecondPage));
+  }
+  std::vector<PdfPage> pages;
+  ReadPdfPageStreamOrDie(
+      filename, [&pages](const PdfPage& page) { pages.push_back(page); });
+  EXPECT_THAT(pages, ElementsAre(EqualsProto(kFirstPage), EqualsProto(""),
+                                 EqualsProto(kSecondPage)));
+}
+
+TEST(PdfPageStreamTest, EmptyStream) {
+  const string filename = StrCat(getenv("TEST_TMPDIR"), "/empty_pages");
+  { PdfPageStreamWriter writer(filename); }
+  int num_pages = 0;
+  ReadPdfPageStreamOrDie(filename,
+                         [&num_pages](const PdfPage& page) { ++num_pages; });
+  EXPECT_EQ(num_pages, 0);
+}
+
+}  // namespace
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
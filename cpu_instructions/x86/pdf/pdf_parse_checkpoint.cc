@@ -0,0 +1,186 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "cpu_instructions/x86/pdf/pdf_parse_checkpoint.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "glog/logging.h"
+#include "src/google/protobuf/util/message_differencer.h"
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+
+namespace {
+
+using ::google::protobuf::util::MessageDifferencer;
+
+constexpr const int kRecordHeaderSize = 8;
+constexpr const int kHeaderPageNumber = 0;
+
+void EncodeUint32(uint32_t value, char* buffer) {
+  for (int i = 0; i < 4; ++i) buffer[i] = static_cast<char>(value >> (8 * i));
+}
+
+uint32_t DecodeUint32(const char* buffer) {
+  uint32_t value = 0;
+  for (int i = 0; i < 4; ++i) {
+    value |= static_cast<uint32_t>(static_cast<unsigned char>(buffer[i]))
+             << (8 * i);
+  }
+  return value;
+}
+
+// Reads exactly 'size' bytes at 'offset'. Returns false if the file ends
+// before.
+bool ReadAt(int fd, off_t offset, size_t size, char* buffer,
+            const string& filename) {
+  size_t num_read = 0;
+  while (num_read < size) {
+    const ssize_t result =
+        pread(fd, buffer + num_read, size - num_read, offset + num_read);
+    PCHECK(result >= 0) << "Could not read '" << filename << "'";
+    if (result == 0) return false;
+    num_read += result;
+  }
+  return true;
+}
+
+}  // namespace
+
+std::unique_ptr<PdfParseCheckpoint> PdfParseCheckpoint::OpenOrDie(
+    const string& filename, const PdfDocumentId& document_id,
+    const PdfDocumentChanges& document_changes) {
+  const int fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+  PCHECK(fd >= 0) << "Could not open '" << filename << "'";
+  std::unique_ptr<PdfParseCheckpoint> checkpoint(
+      new PdfParseCheckpoint(filename, fd));
+
+  PdfDocumentChanges expected_header = document_changes;
+  *expected_header.mutable_document_id() = document_id;
+
+  // Reads the records, and stops at the first that is incomplete.
+  bool valid_header = false;
+  char record_header[kRecordHeaderSize];
+  while (ReadAt(fd, checkpoint->end_offset_, kRecordHeaderSize, record_header,
+                filename)) {
+    Record record;
+    record.offset = checkpoint->end_offset_ + kRecordHeaderSize;
+    record.size = DecodeUint32(record_header);
+    const int page_number =
+        static_cast<int32_t>(DecodeUint32(record_header + 4));
+    if (!valid_header) {
+      string payload(record.size, '\0');
+      PdfDocumentChanges header;
+      if (page_number != kHeaderPageNumber ||
+          !ReadAt(fd, record.offset, record.size, &payload[0], filename) ||
+          !header.ParseFromString(payload)) {
+        break;
+      }
+      if (!MessageDifferencer::Equals(header, expected_header)) {
+        LOG(WARNING) << "'" << filename << "' was written for another document "
+                     << "or other patches, starting over";
+        break;
+      }
+      valid_header = true;
+    } else {
+      // Checking the last byte is enough to know that the record is complete.
+      char last_byte;
+      if (page_number <= kHeaderPageNumber ||
+          (record.size > 0 && !ReadAt(fd, record.offset + record.size - 1, 1,
+                                      &last_byte, filename))) {
+        break;
+      }
+      checkpoint->pages_[page_number] = record;
+    }
+    checkpoint->end_offset_ = record.offset + record.size;
+  }
+
+  if (!valid_header) {
+    checkpoint->pages_.clear();
+    checkpoint->end_offset_ = 0;
+  }
+  // Drops what follows the last complete record.
+  PCHECK(ftruncate(fd, checkpoint->end_offset_) == 0)
+      << "Could not truncate '" << filename << "'";
+  if (!valid_header) {
+    checkpoint->AppendRecordOrDie(kHeaderPageNumber,
+                                  expected_header.SerializeAsString());
+  }
+  checkpoint->num_resumed_pages_ = checkpoint->pages_.size();
+  LOG(INFO) << "Resuming " << checkpoint->num_resumed_pages_
+            << " pages from '" << filename << "'";
+  return checkpoint;
+}
+
+PdfParseCheckpoint::PdfParseCheckpoint(const string& filename, int fd)
+    : filename_(filename), fd_(fd) {}
+
+PdfParseCheckpoint::~PdfParseCheckpoint() { close(fd_); }
+
+bool PdfParseCheckpoint::HasPage(int page_number) const {
+  return pages_.count(page_number) > 0;
+}
+
+PdfPage PdfParseCheckpoint::ReadPageOrDie(int page_number) const {
+  const auto it = pages_.find(page_number);
+  CHECK(it != pages_.end()) << "Page " << page_number << " is not in '"
+                            << filename_ << "'";
+  string payload(it->second.size, '\0');
+  CHECK(ReadAt(fd_, it->second.offset, it->second.size, &payload[0],
+               filename_))
+      << "'" << filename_ << "' was truncated";
+  PdfPage page;
+  CHECK(page.ParseFromString(payload))
+      << "Corrupted page " << page_number << " in '" << filename_ << "'";
+  return page;
+}
+
+void PdfParseCheckpoint::CommitPageOrDie(const PdfPage& page) {
+  CHECK_GT(page.number(), kHeaderPageNumber);
+  CHECK(!HasPage(page.number())) << "Page " << page.number()
+                                 << " was already committed";
+  const off_t offset = end_offset_;
+  const string payload = page.SerializeAsString();
+  AppendRecordOrDie(page.number(), payload);
+  Record& record = pages_[page.number()];
+  record.offset = offset + kRecordHeaderSize;
+  record.size = payload.size();
+}
+
+void PdfParseCheckpoint::AppendRecordOrDie(int page_number,
+                                           const string& payload) {
+  string record(kRecordHeaderSize, '\0');
+  EncodeUint32(payload.size(), &record[0]);
+  EncodeUint32(page_number, &record[4]);
+  record.append(payload);
+  size_t written = 0;
+  while (written < record.size()) {
+    const ssize_t result =
+        pwrite(fd_, record.data() + written, record.size() - written,
+               end_offset_ + written);
+    PCHECK(result > 0) << "Could not write '" << filename_ << "'";
+    written += result;
+  }
+  PCHECK(fdatasync(fd_) == 0) << "Could not sync '" << filename_ << "'";
+  end_offset_ += record.size();
+}
+
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
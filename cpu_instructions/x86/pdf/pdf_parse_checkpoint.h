@@ -0,0 +1,91 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// A checkpoint log of the pages parsed so far, so that a long parse that was
+// interrupted can be resumed instead of started over.
+
+#ifndef CPU_INSTRUCTIONS_X86_PDF_PDF_PARSE_CHECKPOINT_H_
+#define CPU_INSTRUCTIONS_X86_PDF_PDF_PARSE_CHECKPOINT_H_
+
+#include <sys/types.h>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include "strings/string.h"
+
+#include "cpu_instructions/x86/pdf/pdf_document.pb.h"
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+
+// The log is a file of records, each made of a little-endian 32-bit payload
+// size, a little-endian 32-bit page number and the payload. The first record
+// (page number 0) holds the document id and the changes the pages are parsed
+// with; the other records hold the pages in the order they were committed.
+// Each commit is synced to disk, and a record that was cut short by a crash is
+// dropped when the log is opened again.
+// This class is thread-compatible.
+class PdfParseCheckpoint {
+ public:
+  // Opens the log in 'filename', creating it if needed. If the log was written
+  // for the same document and changes, its pages are resumed. Otherwise, it is
+  // cleared.
+  static std::unique_ptr<PdfParseCheckpoint> OpenOrDie(
+      const string& filename, const PdfDocumentId& document_id,
+      const PdfDocumentChanges& document_changes);
+
+  PdfParseCheckpoint(const PdfParseCheckpoint&) = delete;
+  ~PdfParseCheckpoint();
+
+  // The number of pages in the log, including the resumed ones.
+  int num_pages() const { return pages_.size(); }
+
+  // The number of pages that were in the log when it was opened.
+  int num_resumed_pages() const { return num_resumed_pages_; }
+
+  // Returns true if the page with the given number is in the log.
+  bool HasPage(int page_number) const;
+
+  // Reads the page with the given number from the log. Dies if it is not there.
+  PdfPage ReadPageOrDie(int page_number) const;
+
+  // Appends a page to the log, and returns once it is on disk.
+  void CommitPageOrDie(const PdfPage& page);
+
+ private:
+  // The location of a payload in the file.
+  struct Record {
+    off_t offset = 0;
+    uint32_t size = 0;
+  };
+
+  PdfParseCheckpoint(const string& filename, int fd);
+
+  // Appends a record at end_offset_ and syncs the file.
+  void AppendRecordOrDie(int page_number, const string& payload);
+
+  const string filename_;
+  const int fd_;
+  off_t end_offset_ = 0;
+  int num_resumed_pages_ = 0;
+  std::map<int, Record> pages_;
+};
+
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_X86_PDF_PDF_PARSE_CHECKPOINT_H_
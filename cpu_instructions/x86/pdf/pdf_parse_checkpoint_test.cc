@@ -0,0 +1,110 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "cpu_instructions/x86/pdf/pdf_parse_checkpoint.h"
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cpu_instructions/testing/test_util.h"
+#include "cpu_instructions/util/proto_util.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "strings/str_cat.h"
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+namespace {
+
+using ::cpu_instructions::testing::EqualsProto;
+
+constexpr char kDocumentId[] = R"(title: "SDM" creation_date: "2016")";
+constexpr char kChanges[] = R"(pages { page_number: 2 patches { row: 1 } })";
+constexpr char kFirstPage[] = R"(
+  number: 2
+  characters { utf8: "a" font_size: 10 })";
+constexpr char kSecondPage[] = R"(
+  number: 3
+  rows { blocks { text: "b" } })";
+
+std::unique_ptr<PdfParseCheckpoint> OpenCheckpoint(const string& filename,
+                                                   const char* document_id) {
+  return PdfParseCheckpoint::OpenOrDie(
+      filename, ParseProtoFromStringOrDie<PdfDocumentId>(document_id),
+      ParseProtoFromStringOrDie<PdfDocumentChanges>(kChanges));
+}
+
+// Commits kFirstPage and kSecondPage to a new checkpoint.
+void WriteCheckpoint(const string& filename) {
+  unlink(filename.c_str());
+  const auto checkpoint = OpenCheckpoint(filename, kDocumentId);
+  EXPECT_EQ(checkpoint->num_resumed_pages(), 0);
+  checkpoint->CommitPageOrDie(ParseProtoFromStringOrDie<PdfPage>(kFirstPage));
+  checkpoint->CommitPageOrDie(ParseProtoFromStringOrDie<PdfPage>(kSecondPage));
+  EXPECT_EQ(checkpoint->num_pages(), 2);
+}
+
+TEST(PdfParseCheckpointTest, Resume) {
+  const string filename = StrCat(getenv("TEST_TMPDIR"), "/resume");
+  WriteCheckpoint(filename);
+  const auto checkpoint = OpenCheckpoint(filename, kDocumentId);
+  EXPECT_EQ(checkpoint->num_resumed_pages(), 2);
+  EXPECT_FALSE(checkpoint->HasPage(1));
+  EXPECT_TRUE(checkpoint->HasPage(2));
+  EXPECT_THAT(checkpoint->ReadPageOrDie(3), EqualsProto(kSecondPage));
+  EXPECT_THAT(checkpoint->ReadPageOrDie(2), EqualsProto(kFirstPage));
+
+  // New pages are appended after the resumed ones.
+  checkpoint->CommitPageOrDie(ParseProtoFromStringOrDie<PdfPage>("number: 4"));
+  EXPECT_EQ(checkpoint->num_pages(), 3);
+  EXPECT_THAT(checkpoint->ReadPageOrDie(4), EqualsProto("number: 4"));
+  EXPECT_EQ(OpenCheckpoint(filename, kDocumentId)->num_resumed_pages(), 3);
+}
+
+TEST(PdfParseCheckpointTest, OtherDocumentStartsOver) {
+  const string filename = StrCat(getenv("TEST_TMPDIR"), "/other_document");
+  WriteCheckpoint(filename);
+  const auto checkpoint =
+      OpenCheckpoint(filename, R"(title: "SDM" creation_date: "2017")");
+  EXPECT_EQ(checkpoint->num_resumed_pages(), 0);
+  EXPECT_FALSE(checkpoint->HasPage(2));
+}
+
+TEST(PdfParseCheckpointTest, IncompleteRecordIsDropped) {
+  const string filename = StrCat(getenv("TEST_TMPDIR"), "/incomplete");
+  WriteCheckpoint(filename);
+  struct stat file_stat;
+  ASSERT_EQ(stat(filename.c_str(), &file_stat), 0);
+  // Simulates a crash while the second page was being written.
+  ASSERT_EQ(truncate(filename.c_str(), file_stat.st_size - 3), 0);
+  {
+    const auto checkpoint = OpenCheckpoint(filename, kDocumentId);
+    EXPECT_EQ(checkpoint->num_resumed_pages(), 1);
+    EXPECT_TRUE(checkpoint->HasPage(2));
+    EXPECT_FALSE(checkpoint->HasPage(3));
+    checkpoint->CommitPageOrDie(
+        ParseProtoFromStringOrDie<PdfPage>(kSecondPage));
+  }
+  const auto checkpoint = OpenCheckpoint(filename, kDocumentId);
+  EXPECT_EQ(checkpoint->num_resumed_pages(), 2);
+  EXPECT_THAT(checkpoint->ReadPageOrDie(3), EqualsProto(kSecondPage));
+}
+
+}  // namespace
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
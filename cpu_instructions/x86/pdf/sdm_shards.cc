@@ -0,0 +1,68 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/x86/pdf/sdm_shards.h"
+
+#include <cstdint>
+#include <map>
+#include "strings/string.h"
+
+#include "cpu_instructions/x86/pdf/intel_sdm_extractor.h"
+#include "glog/logging.h"
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+
+std::vector<int> GetShardPageNumbers(const PdfDocument& pages, int shard_index,
+                                     int shard_count) {
+  CHECK_GT(shard_count, 0);
+  CHECK_GE(shard_index, 0);
+  CHECK_LT(shard_index, shard_count);
+  const int64_t num_pages = pages.pages_size();
+  std::vector<int> page_numbers;
+  // A run of pages is assigned to the shard that owns its first page.
+  int run_shard = -1;
+  string previous_group_name;
+  for (int i = 0; i < num_pages; ++i) {
+    const PdfPage& page = pages.pages(i);
+    string group_name = GetPageInstructionGroupName(page);
+    if (i == 0 || group_name != previous_group_name) {
+      run_shard = static_cast<int>(i * shard_count / num_pages);
+      previous_group_name = std::move(group_name);
+    }
+    if (run_shard == shard_index) page_numbers.push_back(page.number());
+  }
+  return page_numbers;
+}
+
+SdmDocument MergeSdmDocumentShards(const std::vector<SdmDocument>& shards) {
+  // Same as the map from group id to pages in
+  // ConvertPdfDocumentToSdmDocument: the last section with a given id wins.
+  std::map<string, const InstructionSection*> sections_by_id;
+  for (const SdmDocument& shard : shards) {
+    for (const InstructionSection& section : shard.instruction_sections()) {
+      sections_by_id[section.id()] = &section;
+    }
+  }
+  SdmDocument merged;
+  for (const auto& id_section_pair : sections_by_id) {
+    *merged.add_instruction_sections() = *id_section_pair.second;
+  }
+  return merged;
+}
+
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
@@ -0,0 +1,53 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Utilities to split the parsing of the SDM across several processes, see
+// --cpu_instructions_shard_count in parse_sdm.cc. Each shard parses a subset of
+// the pages of an input spec and extracts the instruction groups it contains;
+// the partial SDM documents are then merged into the document a single process
+// would have produced.
+
+#ifndef CPU_INSTRUCTIONS_X86_PDF_SDM_SHARDS_H_
+#define CPU_INSTRUCTIONS_X86_PDF_SDM_SHARDS_H_
+
+#include <vector>
+
+#include "cpu_instructions/x86/pdf/intel_sdm.pb.h"
+#include "cpu_instructions/x86/pdf/pdf_document.pb.h"
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+
+// Returns the numbers of the pages of 'pages' that belong to the shard
+// 'shard_index' out of 'shard_count'. The pages are split in contiguous ranges
+// of roughly equal size, and only between pages with different instruction
+// group names (see GetPageInstructionGroupName), so that each instruction group
+// is entirely contained in one shard. 'pages' only needs to have the margins
+// parsed, see XPDFDoc::ParseMargins. The result is deterministic, the union of
+// the pages of all shards is 'pages', in order.
+std::vector<int> GetShardPageNumbers(const PdfDocument& pages, int shard_index,
+                                     int shard_count);
+
+// Merges the SDM documents extracted from the shards of one input spec, given
+// in shard order. The result is the same as the SDM document extracted from
+// all the pages at once: sections are sorted by id, and when several shards
+// contain a section with the same id, the one of the last shard is kept.
+SdmDocument MergeSdmDocumentShards(const std::vector<SdmDocument>& shards);
+
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_X86_PDF_SDM_SHARDS_H_
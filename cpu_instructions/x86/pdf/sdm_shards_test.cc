@@ -0,0 +1,117 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/x86/pdf/sdm_shards.h"
+
+#include <vector>
+#include "strings/string.h"
+
+#include "cpu_instructions/testing/test_util.h"
+#include "cpu_instructions/util/proto_util.h"
+#include "cpu_instructions/x86/pdf/intel_sdm_extractor.h"
+#include "cpu_instructions/x86/pdf/pdf_document_parser.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "strings/str_cat.h"
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+namespace {
+
+using ::cpu_instructions::testing::EqualsProto;
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+// Returns a document whose pages only have a footer with the given group names.
+PdfDocument GetDocumentWithFooters(const std::vector<string>& group_names) {
+  PdfDocument document;
+  for (size_t i = 0; i < group_names.size(); ++i) {
+    PdfPage* const page = document.add_pages();
+    page->set_number(i + 1);
+    page->add_rows()->add_blocks()->set_text(group_names[i]);
+  }
+  return document;
+}
+
+TEST(SdmShardsTest, GetShardPageNumbers) {
+  const PdfDocument document =
+      GetDocumentWithFooters({"ADD", "ADD", "AND", "BT", "BT", "BT", "CALL"});
+  EXPECT_THAT(GetShardPageNumbers(document, 0, 1),
+              ElementsAre(1, 2, 3, 4, 5, 6, 7));
+  // "BT" starts in the first half of the pages.
+  EXPECT_THAT(GetShardPageNumbers(document, 0, 2),
+              ElementsAre(1, 2, 3, 4, 5, 6));
+  EXPECT_THAT(GetShardPageNumbers(document, 1, 2), ElementsAre(7));
+  EXPECT_THAT(GetShardPageNumbers(document, 0, 3), ElementsAre(1, 2, 3));
+  EXPECT_THAT(GetShardPageNumbers(document, 1, 3), ElementsAre(4, 5, 6));
+  EXPECT_THAT(GetShardPageNumbers(document, 2, 3), ElementsAre(7));
+}
+
+TEST(SdmShardsTest, GetShardPageNumbersMoreShardsThanGroups) {
+  const PdfDocument document = GetDocumentWithFooters({"ADD", "ADD", "ADD"});
+  EXPECT_THAT(GetShardPageNumbers(document, 0, 4), ElementsAre(1, 2, 3));
+  for (int shard_index = 1; shard_index < 4; ++shard_index) {
+    EXPECT_THAT(GetShardPageNumbers(document, shard_index, 4), IsEmpty());
+  }
+  EXPECT_THAT(GetShardPageNumbers(PdfDocument(), 0, 2), IsEmpty());
+}
+
+TEST(SdmShardsTest, MergeSdmDocumentShards) {
+  const SdmDocument first = ParseProtoFromStringOrDie<SdmDocument>(R"(
+      instruction_sections { id: "BT" fingerprint: 1 }
+      instruction_sections { id: "CALL" fingerprint: 2 })");
+  const SdmDocument second = ParseProtoFromStringOrDie<SdmDocument>(R"(
+      instruction_sections { id: "ADD" fingerprint: 3 }
+      instruction_sections { id: "BT" fingerprint: 4 })");
+  EXPECT_THAT(MergeSdmDocumentShards({first, SdmDocument(), second}),
+              EqualsProto(R"(
+                  instruction_sections { id: "ADD" fingerprint: 3 }
+                  instruction_sections { id: "BT" fingerprint: 4 }
+                  instruction_sections { id: "CALL" fingerprint: 2 })"));
+}
+
+TEST(SdmShardsTest, ShardedExtractionMatchesSingleExtraction) {
+  PdfDocument pdf_document = ReadTextProtoOrDie<PdfDocument>(
+      StrCat(getenv("TEST_SRCDIR"),
+             "/__main__/cpu_instructions/x86/pdf/testdata/"
+             "253666_p170_p171_pdfdoc.pbtxt"));
+  for (auto& page : *pdf_document.mutable_pages()) {
+    Cluster(&page);
+  }
+  const SdmDocument expected = ConvertPdfDocumentToSdmDocument(pdf_document);
+  for (const int shard_count : {1, 2, 3}) {
+    std::vector<SdmDocument> shards;
+    for (int shard_index = 0; shard_index < shard_count; ++shard_index) {
+      PdfDocument shard_document;
+      for (const int page_number :
+           GetShardPageNumbers(pdf_document, shard_index, shard_count)) {
+        for (const PdfPage& page : pdf_document.pages()) {
+          if (page.number() == page_number) {
+            *shard_document.add_pages() = page;
+          }
+        }
+      }
+      shards.push_back(ConvertPdfDocumentToSdmDocument(shard_document));
+    }
+    EXPECT_EQ(MergeSdmDocumentShards(shards).SerializeAsString(),
+              expected.SerializeAsString())
+        << "shard_count=" << shard_count;
+  }
+}
+
+}  // namespace
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
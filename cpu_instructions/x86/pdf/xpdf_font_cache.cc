@@ -0,0 +1,142 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/x86/pdf/xpdf_font_cache.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <unordered_set>
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+
+namespace {
+
+// Cached fonts are never deleted, this bounds the memory they use. A document
+// uses a few dozen fonts.
+constexpr const size_t kMaxCachedFonts = 4096;
+
+// The generation numbers of actual objects have at most five digits. xpdf
+// invents larger ones for the fonts that are not indirect objects, which are
+// only unique within their font dictionary.
+constexpr const int kMaxGenerationNumber = 65535;
+
+// The key of the document whose fonts are created on this thread, 0 if the
+// cache is disabled.
+thread_local uint64_t current_document_key = 0;
+
+// The cached fonts, shared by all threads. Fonts are only read once they are
+// created, so rendering threads can use them concurrently.
+class GfxFontCache {
+ public:
+  // The document key, the object reference of the font and the tag of the font
+  // in the font dictionary. The tag is part of the key because GfxFontDict
+  // looks the fonts up by tag.
+  typedef std::tuple<uint64_t, int, int, std::string> Key;
+
+  static GfxFontCache* Get() {
+    static GfxFontCache* const cache = new GfxFontCache();
+    return cache;
+  }
+
+  // Returns the font cached for key, or nullptr.
+  GfxFont* Lookup(const Key& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = fonts_.find(key);
+    if (it == fonts_.end()) return nullptr;
+    ++num_hits_;
+    return it->second;
+  }
+
+  // Caches font for key, unless the cache is full. Returns the font to use for
+  // key: when another thread cached a font for key in the meantime, font is
+  // deleted and that font is returned.
+  GfxFont* Add(const Key& key, GfxFont* font) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = fonts_.find(key);
+    if (it != fonts_.end()) {
+      delete font;
+      ++num_hits_;
+      return it->second;
+    }
+    if (fonts_.size() >= kMaxCachedFonts) return font;
+    fonts_[key] = font;
+    cached_fonts_.insert(font);
+    return font;
+  }
+
+  bool IsCached(const GfxFont* font) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cached_fonts_.count(font) > 0;
+  }
+
+  GfxFontCacheStats GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    GfxFontCacheStats stats;
+    stats.num_fonts = fonts_.size();
+    stats.num_hits = num_hits_;
+    return stats;
+  }
+
+ private:
+  GfxFontCache() {}
+
+  mutable std::mutex mutex_;
+  std::map<Key, GfxFont*> fonts_;                    // Guarded by mutex_.
+  std::unordered_set<const GfxFont*> cached_fonts_;  // Guarded by mutex_.
+  int64_t num_hits_ = 0;                             // Guarded by mutex_.
+};
+
+}  // namespace
+
+ScopedGfxFontCacheDocument::ScopedGfxFontCacheDocument(uint64_t document_key)
+    : previous_document_key_(current_document_key) {
+  current_document_key = document_key;
+}
+
+ScopedGfxFontCacheDocument::~ScopedGfxFontCacheDocument() {
+  current_document_key = previous_document_key_;
+}
+
+GfxFont* MakeCachedGfxFont(XRef* xref, char* tag, Ref id, Dict* font_dict) {
+  if (current_document_key == 0 || id.gen > kMaxGenerationNumber) {
+    return GfxFont::makeFont(xref, tag, id, font_dict);
+  }
+  GfxFontCache* const cache = GfxFontCache::Get();
+  const GfxFontCache::Key key(current_document_key, id.num, id.gen, tag);
+  GfxFont* const cached_font = cache->Lookup(key);
+  if (cached_font != nullptr) return cached_font;
+  // Fonts are created without holding the lock: this is the slow part.
+  GfxFont* const font = GfxFont::makeFont(xref, tag, id, font_dict);
+  if (font == nullptr || !font->isOk() || font->getType() == fontType3) {
+    return font;
+  }
+  return cache->Add(key, font);
+}
+
+void ReleaseGfxFont(GfxFont* font) {
+  if (font == nullptr || GfxFontCache::Get()->IsCached(font)) return;
+  delete font;
+}
+
+GfxFontCacheStats GetGfxFontCacheStats() {
+  return GfxFontCache::Get()->GetStats();
+}
+
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
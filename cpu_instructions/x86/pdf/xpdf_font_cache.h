@@ -0,0 +1,77 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A process-wide cache of the fonts xpdf creates for the pages it renders.
+//
+// xpdf builds a GfxFontDict for the resources of every page, and with it a
+// GfxFont and a ToUnicode map for each font of the page, although all the
+// pages of the SDM share a handful of fonts. xpdf.BUILD patches GfxFontDict to
+// create its fonts with MakeCachedGfxFont and to release them with
+// ReleaseGfxFont, so that each font of a document is created once per process
+// and shared by all the pages, the XPDFDocs and the threads rendering it.
+//
+// This file is compiled into the xpdf library, and only depends on xpdf.
+
+#ifndef CPU_INSTRUCTIONS_X86_PDF_XPDF_FONT_CACHE_H_
+#define CPU_INSTRUCTIONS_X86_PDF_XPDF_FONT_CACHE_H_
+
+#include <cstdint>
+
+#include "xpdf-3.04/xpdf/GfxFont.h"
+#include "xpdf-3.04/xpdf/Object.h"
+
+class Dict;
+class XRef;
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+
+// Enables the cache on the current thread for the lifetime of the object, for
+// the fonts of the document identified by document_key. The key must identify
+// the contents of the document: fonts are looked up by the key and their
+// object reference. A key of 0 disables the cache.
+class ScopedGfxFontCacheDocument {
+ public:
+  explicit ScopedGfxFontCacheDocument(uint64_t document_key);
+  ScopedGfxFontCacheDocument(const ScopedGfxFontCacheDocument&) = delete;
+  ~ScopedGfxFontCacheDocument();
+
+ private:
+  const uint64_t previous_document_key_;
+};
+
+// Replaces GfxFont::makeFont in GfxFontDict. Returns the cached font of the
+// current document for id and tag, creating and caching it on the first call.
+// Type 3 fonts, whose glyphs are content streams of the document, fonts that
+// are not ok, and fonts without an object reference are not cached, and are
+// created by GfxFont::makeFont every time.
+GfxFont* MakeCachedGfxFont(XRef* xref, char* tag, Ref id, Dict* font_dict);
+
+// Replaces the deletion of the fonts in GfxFontDict. Deletes font unless it is
+// owned by the cache. Cached fonts are never deleted.
+void ReleaseGfxFont(GfxFont* font);
+
+struct GfxFontCacheStats {
+  int num_fonts = 0;     // The number of fonts in the cache.
+  int64_t num_hits = 0;  // The number of fonts that were not created again.
+};
+
+GfxFontCacheStats GetGfxFontCacheStats();
+
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_X86_PDF_XPDF_FONT_CACHE_H_
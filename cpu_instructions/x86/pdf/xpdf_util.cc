@@ -14,28 +14,54 @@
 
 #include "cpu_instructions/x86/pdf/xpdf_util.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <limits>
 #include <memory>
 #include <set>
-#include <tuple>
 #include <unordered_map>
 #include <vector>
 
+#include "cpu_instructions/util/fingerprint.h"
+#include "cpu_instructions/util/ordered_work_queue.h"
+#include "cpu_instructions/util/parallel_for.h"
+#include "cpu_instructions/util/telemetry.h"
+#include "cpu_instructions/util/thread_pool.h"
+#include "cpu_instructions/x86/pdf/clustered_page_cache.h"
 #include "cpu_instructions/x86/pdf/geometry.h"
 #include "cpu_instructions/x86/pdf/pdf_document.pb.h"
 #include "cpu_instructions/x86/pdf/pdf_document_parser.h"
 #include "cpu_instructions/x86/pdf/pdf_document_utils.h"
+#include "cpu_instructions/x86/pdf/pdf_page_cache.h"
+#include "cpu_instructions/x86/pdf/pdf_parse_checkpoint.h"
+#include "cpu_instructions/x86/pdf/xpdf_font_cache.h"
 #include "glog/logging.h"
 #include "libutf/utf.h"
 #include "strings/string_view_utils.h"
 #include "util/gtl/map_util.h"
 #include "util/gtl/ptr_util.h"
+#include "xpdf-3.04/goo/GList.h"
+#include "xpdf-3.04/xpdf/Catalog.h"
 #include "xpdf-3.04/xpdf/GfxState.h"
 #include "xpdf-3.04/xpdf/GlobalParams.h"
+#include "xpdf-3.04/xpdf/Link.h"
+#include "xpdf-3.04/xpdf/Object.h"
+#include "xpdf-3.04/xpdf/Outline.h"
 #include "xpdf-3.04/xpdf/OutputDev.h"
 #include "xpdf-3.04/xpdf/PDFDoc.h"
 #include "xpdf-3.04/xpdf/PDFDocEncoding.h"
+#include "xpdf-3.04/xpdf/Page.h"
+#include "xpdf-3.04/xpdf/Stream.h"
 #include "xpdf-3.04/xpdf/UnicodeMap.h"
+#include "xpdf-3.04/xpdf/XRef.h"
 
 namespace cpu_instructions {
 namespace x86 {
@@ -47,6 +73,17 @@ namespace {
 constexpr const int kHorizontalDPI = 72;
 constexpr const int kVerticalDPI = 72;
 
+// The number of consecutive pages handed out to a worker at once when parsing
+// in parallel. Small enough to balance the load, large enough to amortize the
+// per-shard setup.
+constexpr const int kPagesPerShard = 8;
+
+// The maximal number of shards that are rendered or waiting to be merged, per
+// thread, when parsing in parallel. A worker does not start a shard that is
+// further than that from the first shard that is not merged, so that a slow
+// shard does not make the rendered pages pile up.
+constexpr const int kMaxPendingShardsPerThread = 2;
+
 constexpr const char kMetadataAuthor[] = "Author";
 constexpr const char kMetadataCreationDate[] = "CreationDate";
 constexpr const char kMetadataKeywords[] = "Keywords";
@@ -58,6 +95,8 @@ constexpr const char* kMetadataEntries[] = {
     kMetadataModificationDate};
 
 // Returns the singleton xpdf global parameters.
+// Initialization is thread-safe. xpdf is compiled with MULTITHREADED so that
+// the caches held by GlobalParams can be shared by concurrent PDFDocs.
 GlobalParams* GetXpdfGlobalParams() {
   // Initialize once.
   static GlobalParams* const result = []() {
@@ -124,41 +163,210 @@ PdfDocumentId CreateDocumentId(const XPDFDoc::Metadata& map) {
   return document_id;
 }
 
-}  // namespace
+// Returns the key of the document in the font cache, or 0 if the document has
+// no file identifier and could be mistaken for another one. The file
+// identifier in the trailer changes whenever the file is modified.
+uint64_t GetFontCacheKey(PDFDoc* doc, const PdfDocumentId& document_id) {
+  Object file_id;
+  doc->getXRef()->getTrailerDict()->dictLookup("ID", &file_id);
+  Fingerprint fingerprint;
+  fingerprint.Add(document_id.SerializeAsString());
+  bool has_file_id = false;
+  if (file_id.isArray()) {
+    for (int i = 0; i < file_id.arrayGetLength(); ++i) {
+      Object part;
+      if (file_id.arrayGet(i, &part)->isString()) {
+        GString* const part_string = part.getString();
+        fingerprint.Add(
+            StringPiece(part_string->getCString(), part_string->getLength()));
+        has_file_id = true;
+      }
+      part.free();
+    }
+  }
+  file_id.free();
+  if (!has_file_id) return 0;
+  return std::max<uint64_t>(fingerprint.value(), 1);
+}
 
-std::unique_ptr<const XPDFDoc> XPDFDoc::OpenOrDie(const string& filename) {
+// Opens an xpdf document. PDFDoc takes ownership of the name.
+std::unique_ptr<PDFDoc> OpenPdfFileOrDie(const string& filename) {
   GetXpdfGlobalParams();  // Maybe initialize xpdf globals.
   auto doc =
       gtl::MakeUnique<PDFDoc>(new GString(filename.c_str()), nullptr, nullptr);
   CHECK(doc->isOk()) << "Could not open PDF file: '" << filename << "'";
   CHECK_GT(doc->getNumPages(), 0);
-  return std::unique_ptr<const XPDFDoc>(new XPDFDoc(std::move(doc)));
+  return doc;
+}
+
+// Opens an xpdf document on data, which is not copied. PDFDoc takes ownership
+// of the stream.
+std::unique_ptr<PDFDoc> OpenPdfDataOrDie(StringPiece data) {
+  GetXpdfGlobalParams();  // Maybe initialize xpdf globals.
+  CHECK_LE(data.size(), std::numeric_limits<Guint>::max());
+  Object dictionary;
+  dictionary.initNull();
+  // MemStream does not modify nor free the buffer.
+  auto* const stream = new MemStream(const_cast<char*>(data.data()), 0,
+                                     static_cast<Guint>(data.size()),
+                                     &dictionary);
+  auto doc = gtl::MakeUnique<PDFDoc>(stream, nullptr, nullptr);
+  CHECK(doc->isOk()) << "Could not open in-memory PDF file";
+  CHECK_GT(doc->getNumPages(), 0);
+  return doc;
+}
+
+}  // namespace
+
+// A read-only memory mapping of a whole file.
+class XPDFDoc::MappedFile {
+ public:
+  explicit MappedFile(const string& filename) {
+    const int fd = open(filename.c_str(), O_RDONLY);
+    PCHECK(fd >= 0) << "Could not open PDF file: '" << filename << "'";
+    struct stat file_stat;
+    PCHECK(fstat(fd, &file_stat) == 0) << filename;
+    size_ = file_stat.st_size;
+    CHECK_GT(size_, 0) << "Empty PDF file: '" << filename << "'";
+    data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    PCHECK(data_ != MAP_FAILED) << "Could not map PDF file: '" << filename
+                                << "'";
+    close(fd);  // The mapping stays valid.
+  }
+
+  MappedFile(const MappedFile&) = delete;
+
+  ~MappedFile() { munmap(data_, size_); }
+
+  StringPiece data() const {
+    return StringPiece(static_cast<const char*>(data_), size_);
+  }
+
+ private:
+  void* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+std::unique_ptr<const XPDFDoc> XPDFDoc::OpenOrDie(const string& filename) {
+  return std::unique_ptr<const XPDFDoc>(
+      new XPDFDoc(filename, StringPiece(), nullptr));
+}
+
+std::unique_ptr<const XPDFDoc> XPDFDoc::OpenFromMemoryOrDie(
+    const StringPiece data) {
+  return std::unique_ptr<const XPDFDoc>(new XPDFDoc("", data, nullptr));
+}
+
+std::unique_ptr<const XPDFDoc> XPDFDoc::OpenMappedOrDie(
+    const string& filename) {
+  auto mapped_file = gtl::MakeUnique<MappedFile>(filename);
+  const StringPiece data = mapped_file->data();
+  return std::unique_ptr<const XPDFDoc>(
+      new XPDFDoc("", data, std::move(mapped_file)));
 }
 
-XPDFDoc::XPDFDoc(std::unique_ptr<PDFDoc> doc)
-    : doc_(std::move(doc)),
+// The number of pages kept in memory by XPDFDoc::ParsePage.
+constexpr const size_t kNumClusteredPagesInCache = 32;
+
+XPDFDoc::XPDFDoc(const string& filename, const StringPiece data,
+                 std::unique_ptr<MappedFile> mapped_file)
+    : filename_(filename),
+      data_(data),
+      mapped_file_(std::move(mapped_file)),
+      doc_(OpenPdfDocOrDie()),
       metadata_(ReadMetadata(doc_.get())),
-      doc_id_(CreateDocumentId(metadata_)) {}
+      doc_id_(CreateDocumentId(metadata_)),
+      font_cache_key_(GetFontCacheKey(doc_.get(), doc_id_)),
+      clustered_pages_(new ClusteredPageCache(kNumClusteredPagesInCache)) {}
+
+std::unique_ptr<PDFDoc> XPDFDoc::OpenPdfDocOrDie() const {
+  if (!filename_.empty()) return OpenPdfFileOrDie(filename_);
+  return OpenPdfDataOrDie(data_);
+}
 
 XPDFDoc::~XPDFDoc() {}
 
 namespace {
 
+// Called on each parsed page, in page order.
+typedef std::function<void(PdfPage*)> PageFinisher;
+
+// The maximal number of rendered pages waiting for a thread of the clustering
+// pool, per thread. This bounds the memory used when xpdf renders faster than
+// the pages are clustered.
+constexpr const int kMaxQueuedPagesPerClusteringThread = 4;
+
+// The fields of a PdfCharacter, as recorded by drawChar. The characters of a
+// page are kept in a plain array, with their UTF-8 texts in a single string,
+// and the protos are only created once the page is rendered. This keeps
+// drawChar free of allocations once the arrays have grown to the size of a
+// page.
+struct RenderedCharacter {
+  CharCode codepoint = 0;
+  float font_size = 0.0f;
+  Orientation orientation = Orientation::NORTH;
+  uint32_t fill_color_hash = 0;
+  float left = 0.0f;
+  float top = 0.0f;
+  float right = 0.0f;
+  float bottom = 0.0f;
+  // The text of the character is [utf8_begin, utf8_end) in the UTF-8 string of
+  // the page.
+  uint32_t utf8_begin = 0;
+  uint32_t utf8_end = 0;
+};
+
 // An XPDF device which outputs the stream of characters as a PdfDocument
 // protobuf.
 class ProtobufOutputDevice : public OutputDev {
  public:
   // PdfDocumentChanges is used to change the way the document is parsed, it is
   // also responsible for patching the document afterwards.
-  // ProtobufOutputDevice does not acquire ownership of pdf_document.
-  // pdf_document should outlive this instance.
+  // ProtobufOutputDevice does not acquire ownership of document_changes and
+  // pdf_document, they should outlive this instance.
+  // If margin is positive, only the characters overlapping the top and bottom
+  // 'margin' of the page are retained and patches are not applied.
   ProtobufOutputDevice(const PdfDocumentChanges& document_changes,
-                       PdfDocument* pdf_document)
-      : document_changes_(document_changes), pdf_document_(pdf_document) {}
+                       PdfDocument* pdf_document, float margin = 0.0f)
+      : document_changes_(document_changes),
+        pdf_document_(pdf_document),
+        margin_(margin) {}
 
   ProtobufOutputDevice(const ProtobufOutputDevice&) = delete;
 
-  ~ProtobufOutputDevice() override { LOG(INFO) << "Processing done"; }
+  // Waits for the pages that are being clustered and adds them to
+  // pdf_document.
+  ~ProtobufOutputDevice() override { FlushPages(/* wait= */ true); }
+
+  // Makes the device look pages up in page_cache before rendering them, and
+  // add them to it after. Pages are keyed within document_id. Does not acquire
+  // ownership of the arguments.
+  void SetPageCache(const PdfDocumentId* document_id,
+                    PdfPageCache* page_cache) {
+    document_id_ = document_id;
+    page_cache_ = page_cache;
+  }
+
+  // If false, the pages only contain the rendered characters: they are neither
+  // clustered nor patched, and the page cache is not used.
+  void SetClusterPages(bool cluster_pages) { cluster_pages_ = cluster_pages; }
+
+  // Makes the device cluster and patch pages on clustering_pool, while xpdf
+  // renders the next pages on the calling thread. The pages are then only added
+  // to pdf_document by FlushPages. Does not acquire ownership of
+  // clustering_pool.
+  void SetClusteringPool(ThreadPool* clustering_pool) {
+    pending_pages_.reset();
+    if (clustering_pool == nullptr) return;
+    pending_pages_ = gtl::MakeUnique<OrderedWorkQueue<PdfPage>>(
+        clustering_pool,
+        kMaxQueuedPagesPerClusteringThread * clustering_pool->num_threads());
+  }
+
+  // Adds the pages that are done to pdf_document, in page order. If wait is
+  // true, waits until all the pages are done. Without a clustering pool, pages
+  // are always added as soon as they are rendered.
+  void FlushPages(bool wait);
 
  private:
   GBool upsideDown() override { return gTrue; }
@@ -166,15 +374,58 @@ class ProtobufOutputDevice : public OutputDev {
   GBool interpretType3Chars() override { return gFalse; }
   GBool needNonText() override { return gFalse; }
 
+  // Called by xpdf before rendering a page, returning false skips the page.
+  GBool checkPageSlice(Page* page, double hDPI, double vDPI, int rotate,
+                       GBool useMediaBox, GBool crop, int sliceX, int sliceY,
+                       int sliceW, int sliceH, GBool printing,
+                       GBool (*abortCheckCbk)(void* data),
+                       void* abortCheckCbkData) override;
   void startPage(int pageNum, GfxState* state) override;
   void endPage() override;
   void drawChar(GfxState* state, double x, double y, double dx, double dy,
                 double originX, double originY, CharCode c, int nBytes,
                 Unicode* u, int uLen) override;
 
-  const PdfDocumentChanges document_changes_;
+  // Returns whether the character should be dropped because it is in the body
+  // of the page and only margins are retained.
+  bool IsOutsideMargins(const BoundingBox& bounding_box) const;
+
+  // Returns the hash of the current fill color. Pages use only a handful of
+  // colors, so they are interned in a small table and each distinct color is
+  // hashed only once.
+  uint32_t GetFillColorHash(GfxState* state);
+
+  // Adds the characters recorded by drawChar to current_page_, and clears
+  // them.
+  void AddRenderedCharacters();
+
+  // Calls process on the page, if it is set, and adds the page to
+  // pdf_document. With a clustering pool, process runs on the pool and the page
+  // is queued until FlushPages. Swaps the contents of page out.
+  void AddPage(PdfPage* page, PageFinisher process);
+
+  struct InternedColor {
+    GfxColor color;
+    int num_bytes;
+    uint32_t hash;
+  };
+
+  const PdfDocumentChanges& document_changes_;
   PdfDocument* const pdf_document_ = nullptr;
+  const float margin_ = 0.0f;
+  const PdfDocumentId* document_id_ = nullptr;
+  PdfPageCache* page_cache_ = nullptr;
+  string current_page_cache_key_;  // Empty if the page is not to be cached.
+  std::vector<InternedColor> interned_colors_;
+  bool cluster_pages_ = true;
+  std::chrono::steady_clock::time_point page_start_time_;
   PdfPage current_page_;
+  // The characters of current_page_ and their UTF-8 texts, see
+  // RenderedCharacter. They keep their capacity from one page to the next.
+  std::vector<RenderedCharacter> rendered_characters_;
+  string rendered_utf8_;
+  // The rendered pages, in page order. Null without a clustering pool.
+  std::unique_ptr<OrderedWorkQueue<PdfPage>> pending_pages_;
 };
 
 constexpr const int kMinFontSize = 4;
@@ -208,16 +459,71 @@ BoundingBox GetBoundingBox(const float x, const float y, const float dx,
   }
 }
 
-// Converts the unicode data from xpdf into a string.
-string GetUtf8String(Unicode* u, int uLen) {
+// Overprinting, e.g. to simulate bold text, draws a copy of a character shortly
+// after it in stream order, typically by showing the same string twice at a
+// small offset. Only the last kOverprintLookback characters of the page are
+// compared to the new character.
+constexpr const int kOverprintLookback = 64;
+
+// The minimal area of the intersection of the bounding boxes of two identical
+// characters, relative to the area of the smallest box, for the second
+// character to be considered an overprint of the first.
+constexpr const float kMinOverprintOverlap = 0.7f;
+
+float GetArea(const RenderedCharacter& character) {
+  return (character.right - character.left) *
+         (character.bottom - character.top);
+}
+
+// Same as GetIntersectionArea, on the boxes of two rendered characters.
+float GetIntersectionArea(const RenderedCharacter& a,
+                          const RenderedCharacter& b) {
+  const float width = std::min(a.right, b.right) - std::max(a.left, b.left);
+  const float height = std::min(a.bottom, b.bottom) - std::max(a.top, b.top);
+  return width > 0.0f && height > 0.0f ? width * height : 0.0f;
+}
+
+// Returns whether character would be drawn over an identical character among
+// the last characters of the page.
+bool IsOverprinted(const std::vector<RenderedCharacter>& page_characters,
+                   const RenderedCharacter& character) {
+  const float area = GetArea(character);
+  const int num_characters = page_characters.size();
+  for (int i = num_characters - 1;
+       i >= std::max(num_characters - kOverprintLookback, 0); --i) {
+    const RenderedCharacter& other = page_characters[i];
+    if (other.codepoint != character.codepoint ||
+        other.font_size != character.font_size ||
+        other.orientation != character.orientation) {
+      continue;
+    }
+    const float min_area = std::min(area, GetArea(other));
+    if (min_area > 0.0f && GetIntersectionArea(character, other) >=
+                               kMinOverprintOverlap * min_area) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Converts the unicode data from xpdf to UTF-8. Writes the result to buffer,
+// which must have room for UTFmax bytes, and returns its size in bytes.
+int GetUtf8String(Unicode* u, int uLen, char* buffer) {
   CHECK_EQ(uLen, 1);
-  char buffer[UTFmax];
   const int length = runetochar(buffer, reinterpret_cast<Rune*>(u));
-  const string output(buffer, length);
   // TODO(gchatelet): Moves this in the parser configuration.
-  if (output == "—") return "-";
-  if (output == "–") return "-";
-  return output;
+  static constexpr char kEmDash[] = "—";
+  static constexpr char kEnDash[] = "–";
+  static_assert(sizeof(kEmDash) - 1 <= UTFmax, "kEmDash is too long");
+  static_assert(sizeof(kEnDash) - 1 <= UTFmax, "kEnDash is too long");
+  if ((length == sizeof(kEmDash) - 1 &&
+       memcmp(buffer, kEmDash, length) == 0) ||
+      (length == sizeof(kEnDash) - 1 &&
+       memcmp(buffer, kEnDash, length) == 0)) {
+    buffer[0] = '-';
+    return 1;
+  }
+  return length;
 }
 
 PdfPageChanges GetPageChanges(const PdfDocumentChanges& document_changes,
@@ -231,7 +537,57 @@ PdfPageChanges GetPageChanges(const PdfDocumentChanges& document_changes,
   return result;
 }
 
+// Appends the decoded data of a stream object to content.
+void AppendStreamData(Object* stream, string* content) {
+  stream->streamReset();
+  for (int c = stream->streamGetChar(); c != EOF; c = stream->streamGetChar()) {
+    content->push_back(static_cast<char>(c));
+  }
+  stream->streamClose();
+}
+
+// Returns the decoded content streams of the page, i.e. its drawing commands.
+string GetPageContent(Page* page) {
+  string content;
+  Object contents;
+  page->getContents(&contents);
+  if (contents.isStream()) {
+    AppendStreamData(&contents, &content);
+  } else if (contents.isArray()) {
+    for (int i = 0; i < contents.arrayGetLength(); ++i) {
+      Object stream;
+      if (contents.arrayGet(i, &stream)->isStream()) {
+        AppendStreamData(&stream, &content);
+      }
+      stream.free();
+    }
+  }
+  contents.free();
+  return content;
+}
+
+GBool ProtobufOutputDevice::checkPageSlice(
+    Page* page, double hDPI, double vDPI, int rotate, GBool useMediaBox,
+    GBool crop, int sliceX, int sliceY, int sliceW, int sliceH, GBool printing,
+    GBool (*abortCheckCbk)(void* data), void* abortCheckCbkData) {
+  current_page_cache_key_.clear();
+  // The cache only holds clustered pages.
+  if (page_cache_ == nullptr || !cluster_pages_) return gTrue;
+  const int page_number = page->getNum();
+  const string key = PdfPageCache::GetKey(
+      *CHECK_NOTNULL(document_id_), page_number, GetPageContent(page),
+      GetPageChanges(document_changes_, page_number));
+  PdfPage cached_page;
+  if (page_cache_->Lookup(key, &cached_page)) {
+    AddPage(&cached_page, PageFinisher());
+    return gFalse;
+  }
+  current_page_cache_key_ = key;
+  return gTrue;
+}
+
 void ProtobufOutputDevice::startPage(int pageNum, GfxState* state) {
+  page_start_time_ = std::chrono::steady_clock::now();
   current_page_.set_number(pageNum);
   if (state) {
     current_page_.set_width(state->getPageWidth());
@@ -240,17 +596,93 @@ void ProtobufOutputDevice::startPage(int pageNum, GfxState* state) {
   LOG_EVERY_N(INFO, 100) << "Processing page " << pageNum;
 }
 
+bool ProtobufOutputDevice::IsOutsideMargins(
+    const BoundingBox& bounding_box) const {
+  return margin_ > 0.0f && bounding_box.top() > margin_ &&
+         bounding_box.bottom() < current_page_.height() - margin_;
+}
+
 void ProtobufOutputDevice::endPage() {
-  const auto page_number = current_page_.number();
-  const auto& page_changes = GetPageChanges(document_changes_, page_number);
-  Cluster(&current_page_, page_changes.prevent_segment_bindings());
-  if (!page_changes.patches().empty()) {
-    LOG(INFO) << "Patching page " << page_number;
-    for (const auto& patch : page_changes.patches()) {
-      ApplyPatchOrDie(patch, &current_page_);
+  AddRenderedCharacters();
+  Telemetry* const telemetry = Telemetry::Get();
+  if (!cluster_pages_) {
+    AddPage(&current_page_, PageFinisher());
+    telemetry->RecordStage("render_page", GetSecondsSince(page_start_time_));
+    return;
+  }
+  const auto page_start_time = page_start_time_;
+  if (margin_ > 0.0f) {
+    AddPage(&current_page_, [telemetry, page_start_time](PdfPage* page) {
+      Cluster(page);
+      telemetry->RecordStage("parse_page_margins",
+                             GetSecondsSince(page_start_time));
+    });
+    return;
+  }
+  telemetry->AddToCounter("parsed_characters",
+                          current_page_.characters_size(), page_start_time_);
+  telemetry->AddToCounter("overprinted_characters",
+                          current_page_.num_overprinted_characters(),
+                          page_start_time_);
+  const PdfPageChanges page_changes =
+      GetPageChanges(document_changes_, current_page_.number());
+  PdfPageCache* const page_cache =
+      current_page_cache_key_.empty() ? nullptr : page_cache_;
+  const string page_cache_key = current_page_cache_key_;
+  AddPage(&current_page_, [telemetry, page_start_time, page_changes,
+                           page_cache, page_cache_key](PdfPage* page) {
+    {
+      ScopedStageTimer timer("cluster_page");
+      Cluster(page, page_changes.prevent_segment_bindings());
+    }
+    if (!page_changes.patches().empty()) {
+      LOG(INFO) << "Patching page " << page->number();
+      for (const auto& patch : page_changes.patches()) {
+        ApplyPatchOrDie(patch, page);
+      }
     }
+    if (page_cache != nullptr) page_cache->Insert(page_cache_key, *page);
+    telemetry->RecordStage("parse_page", GetSecondsSince(page_start_time));
+  });
+}
+
+void ProtobufOutputDevice::AddRenderedCharacters() {
+  auto* const characters = current_page_.mutable_characters();
+  characters->Reserve(characters->size() + rendered_characters_.size());
+  for (const RenderedCharacter& rendered : rendered_characters_) {
+    PdfCharacter* const character = characters->Add();
+    character->set_codepoint(rendered.codepoint);
+    character->set_utf8(rendered_utf8_.data() + rendered.utf8_begin,
+                        rendered.utf8_end - rendered.utf8_begin);
+    character->set_font_size(rendered.font_size);
+    character->set_orientation(rendered.orientation);
+    character->set_fill_color_hash(rendered.fill_color_hash);
+    BoundingBox* const bounding_box = character->mutable_bounding_box();
+    bounding_box->set_left(rendered.left);
+    bounding_box->set_top(rendered.top);
+    bounding_box->set_right(rendered.right);
+    bounding_box->set_bottom(rendered.bottom);
+  }
+  rendered_characters_.clear();
+  rendered_utf8_.clear();
+}
+
+void ProtobufOutputDevice::AddPage(PdfPage* page, PageFinisher process) {
+  if (pending_pages_ == nullptr) {
+    if (process) process(page);
+    page->Swap(pdf_document_->add_pages());
+    return;
   }
-  current_page_.Swap(pdf_document_->add_pages());
+  auto pending_page = gtl::MakeUnique<PdfPage>();
+  pending_page->Swap(page);
+  pending_pages_->Add(std::move(pending_page), std::move(process));
+}
+
+void ProtobufOutputDevice::FlushPages(bool wait) {
+  if (pending_pages_ == nullptr) return;
+  pending_pages_->Flush(wait, [this](PdfPage* page) {
+    page->Swap(pdf_document_->add_pages());
+  });
 }
 
 void ProtobufOutputDevice::drawChar(GfxState* state, double x, double y,
@@ -273,36 +705,318 @@ void ProtobufOutputDevice::drawChar(GfxState* state, double x, double y,
   // Dropping characters smaller than kMinFontSize.
   if (font_size < kMinFontSize) return;
 
-  auto* pdf_char = current_page_.add_characters();
-  pdf_char->set_codepoint(c);
-  pdf_char->set_utf8(GetUtf8String(u, uLen));
-  pdf_char->set_font_size(font_size);
-  pdf_char->set_orientation(orientation);
-  const char* color_buffer =
-      reinterpret_cast<const char*>(CHECK_NOTNULL(state->getFillColor()->c));
-  const int color_buffer_size =
+  const BoundingBox bounding_box =
+      GetBoundingBox(x1, y1, width, height, font_size, orientation);
+  if (IsOutsideMargins(bounding_box)) return;
+
+  RenderedCharacter character;
+  character.codepoint = c;
+  character.font_size = font_size;
+  character.orientation = orientation;
+  character.left = bounding_box.left();
+  character.top = bounding_box.top();
+  character.right = bounding_box.right();
+  character.bottom = bounding_box.bottom();
+
+  // Dropping duplicate characters before they reach the clustering.
+  if (IsOverprinted(rendered_characters_, character)) {
+    current_page_.set_num_overprinted_characters(
+        current_page_.num_overprinted_characters() + 1);
+    return;
+  }
+
+  char utf8[UTFmax];
+  const int utf8_length = GetUtf8String(u, uLen, utf8);
+  character.fill_color_hash = GetFillColorHash(state);
+  character.utf8_begin = rendered_utf8_.size();
+  rendered_utf8_.append(utf8, utf8_length);
+  character.utf8_end = rendered_utf8_.size();
+  rendered_characters_.push_back(character);
+}
+
+uint32_t ProtobufOutputDevice::GetFillColorHash(GfxState* state) {
+  const GfxColor& color = *CHECK_NOTNULL(state->getFillColor());
+  const int num_bytes =
       CHECK_NOTNULL(state->getFillColorSpace())->getNComps() *
       sizeof(GfxColorComp);
-  pdf_char->set_fill_color_hash(
-      std::hash<string>()(string(color_buffer, color_buffer_size)));
-  *pdf_char->mutable_bounding_box() =
-      GetBoundingBox(x1, y1, width, height, font_size, orientation);
+  for (const InternedColor& interned_color : interned_colors_) {
+    if (interned_color.num_bytes == num_bytes &&
+        memcmp(interned_color.color.c, color.c, num_bytes) == 0) {
+      return interned_color.hash;
+    }
+  }
+  InternedColor interned_color;
+  interned_color.color = color;
+  interned_color.num_bytes = num_bytes;
+  // The hash is kept identical to that of previous versions, so that parsed
+  // documents can still be compared with older ones.
+  interned_color.hash = std::hash<string>()(
+      string(reinterpret_cast<const char*>(color.c), num_bytes));
+  interned_colors_.push_back(interned_color);
+  return interned_color.hash;
+}
+
+// Creates the device that renders pages into the given PdfDocument.
+typedef std::function<std::unique_ptr<ProtobufOutputDevice>(PdfDocument*)>
+    OutputDeviceFactory;
+
+// Renders a single page of doc into output_device. The fonts of the page are
+// taken from the font cache, unless font_cache_key is 0.
+void DisplayPage(PDFDoc* doc, uint64_t font_cache_key, OutputDev* output_device,
+                 int page_number) {
+  const ScopedGfxFontCacheDocument font_cache_document(font_cache_key);
+  doc->displayPage(output_device, page_number, kHorizontalDPI, kVerticalDPI,
+                   /* rotate= */ 0, /* useMediaBox= */ gTrue,
+                   /* crop= */ gTrue, /* printing= */ gTrue);
+}
+
+// Creates a new xpdf document.
+typedef std::function<std::unique_ptr<PDFDoc>()> PdfDocFactory;
+
+// Moves the pages of source to the end of destination, calling finish_page on
+// each of them first if it is set.
+void MovePages(const PageFinisher& finish_page, PdfDocument* source,
+               PdfDocument* destination) {
+  for (PdfPage& page : *source->mutable_pages()) {
+    if (finish_page) finish_page(&page);
+    page.Swap(destination->add_pages());
+  }
+  source->clear_pages();
+}
+
+// Renders page_numbers in order. When num_threads > 1, the pages are split into
+// shards of consecutive pages that are processed concurrently. xpdf documents
+// are not thread safe: each worker opens its own PDFDoc with open_doc and
+// renders whole shards into a dedicated PdfDocument. The shards are then merged
+// in order as soon as they and all the shards before them are done, so the
+// result does not depend on num_threads, and at most
+// kMaxPendingShardsPerThread shards per thread are rendered or waiting to be
+// merged at any time. finish_page is called on the pages as they are
+// merged. When the output devices cluster pages on a pool, the pages are merged
+// as they come out of the pool, which overlaps rendering and clustering. The
+// fonts are taken from the font cache, unless font_cache_key is 0.
+PdfDocument RenderPages(PDFDoc* doc, const PdfDocFactory& open_doc,
+                        const uint64_t font_cache_key,
+                        const std::vector<int>& page_numbers,
+                        const int num_threads,
+                        const OutputDeviceFactory& create_output_device,
+                        const PageFinisher& finish_page) {
+  PdfDocument pdf_document;
+  if (num_threads <= 1) {
+    PdfDocument rendered_page;
+    const auto output_device = create_output_device(&rendered_page);
+    for (const int page_number : page_numbers) {
+      DisplayPage(doc, font_cache_key, output_device.get(), page_number);
+      output_device->FlushPages(/* wait= */ false);
+      MovePages(finish_page, &rendered_page, &pdf_document);
+    }
+    output_device->FlushPages(/* wait= */ true);
+    MovePages(finish_page, &rendered_page, &pdf_document);
+    LOG(INFO) << "Processing done";
+    return pdf_document;
+  }
+
+  const size_t num_shards =
+      (page_numbers.size() + kPagesPerShard - 1) / kPagesPerShard;
+  std::vector<PdfDocument> shards(num_shards);
+  std::vector<std::unique_ptr<PDFDoc>> worker_docs(
+      GetNumParallelForWorkers(num_shards, num_threads));
+  const auto render_shard = [&](int worker, size_t shard) {
+    std::unique_ptr<PDFDoc>& worker_doc = worker_docs[worker];
+    if (!worker_doc) worker_doc = open_doc();
+    const auto output_device = create_output_device(&shards[shard]);
+    const size_t begin = shard * kPagesPerShard;
+    const size_t end = std::min(begin + kPagesPerShard, page_numbers.size());
+    for (size_t i = begin; i < end; ++i) {
+      DisplayPage(worker_doc.get(), font_cache_key, output_device.get(),
+                  page_numbers[i]);
+    }
+    output_device->FlushPages(/* wait= */ true);
+  };
+  const auto merge_shard = [&](size_t shard) {
+    MovePages(finish_page, &shards[shard], &pdf_document);
+  };
+  OrderedParallelFor(num_shards, num_threads,
+                     kMaxPendingShardsPerThread * num_threads, render_shard,
+                     merge_shard);
+  LOG(INFO) << "Processing done";
+  return pdf_document;
+}
+
+// Converts an xpdf unicode string (e.g. an outline title) to UTF-8.
+string UnicodeStringToUtf8(const Unicode* unicode, int length) {
+  UnicodeMap* const unicode_map = GetXpdfGlobalParams()->getTextEncoding();
+  string output;
+  char utf8_buffer[8];
+  for (int i = 0; i < length; ++i) {
+    const int num_utf8_bytes =
+        unicode_map->mapUnicode(unicode[i], utf8_buffer, sizeof(utf8_buffer));
+    output.append(utf8_buffer, num_utf8_bytes);
+  }
+  return output;
+}
+
+// Returns the page an outline item points to, or 0 if the item is not a link to
+// a page of this document.
+int GetOutlineItemPageNumber(PDFDoc* doc, OutlineItem* item) {
+  LinkAction* const action = item->getAction();
+  if (action == nullptr || action->getKind() != actionGoTo) return 0;
+  LinkGoTo* const goto_action = static_cast<LinkGoTo*>(action);
+  std::unique_ptr<LinkDest> named_destination;
+  LinkDest* destination = goto_action->getDest();
+  if (destination == nullptr && goto_action->getNamedDest() != nullptr) {
+    named_destination.reset(doc->findDest(goto_action->getNamedDest()));
+    destination = named_destination.get();
+  }
+  if (destination == nullptr || !destination->isOk()) return 0;
+  if (!destination->isPageRef()) return destination->getPageNum();
+  const Ref page_ref = destination->getPageRef();
+  return doc->getCatalog()->findPage(page_ref.num, page_ref.gen);
+}
+
+// Appends the outline items and their descendants to entries.
+void ReadOutlineItems(PDFDoc* doc, GList* items, int depth,
+                      std::vector<PdfOutlineEntry>* entries) {
+  if (items == nullptr) return;
+  for (int i = 0; i < items->getLength(); ++i) {
+    OutlineItem* const item = static_cast<OutlineItem*>(items->get(i));
+    PdfOutlineEntry entry;
+    entry.title =
+        UnicodeStringToUtf8(item->getTitle(), item->getTitleLength());
+    entry.depth = depth;
+    entry.page_number = GetOutlineItemPageNumber(doc, item);
+    entries->push_back(entry);
+    if (item->hasKids()) {
+      item->open();
+      ReadOutlineItems(doc, item->getKids(), depth + 1, entries);
+      item->close();
+    }
+  }
 }
 
 }  // namespace
 
+int XPDFDoc::GetNumPages() const { return doc_->getNumPages(); }
+
+std::vector<PdfOutlineEntry> XPDFDoc::GetOutline() const {
+  std::vector<PdfOutlineEntry> entries;
+  Outline* const outline = doc_->getOutline();
+  if (outline != nullptr) {
+    ReadOutlineItems(doc_.get(), outline->getItems(), 0, &entries);
+  }
+  return entries;
+}
+
 PdfDocument XPDFDoc::Parse(const int first_page, const int last_page,
-                           const PdfDocumentChanges& patches) const {
+                           const PdfDocumentChanges& patches,
+                           const PdfParseOptions& options) const {
+  const int end_page = last_page <= 0 ? doc_->getNumPages() : last_page;
+  std::vector<int> page_numbers;
+  for (int page_number = first_page; page_number <= end_page; ++page_number) {
+    page_numbers.push_back(page_number);
+  }
+  return Parse(page_numbers, patches, options);
+}
+
+PdfDocument XPDFDoc::Parse(const std::vector<int>& page_numbers,
+                           const PdfDocumentChanges& patches,
+                           const PdfParseOptions& options) const {
+  CHECK(options.cluster_pages || options.checkpoint == nullptr)
+      << "Unclustered pages can not be checkpointed";
+  // Shared by the output devices of all the rendering threads.
+  std::unique_ptr<ThreadPool> clustering_pool;
+  if (options.num_clustering_threads > 0) {
+    clustering_pool =
+        gtl::MakeUnique<ThreadPool>(options.num_clustering_threads);
+  }
+  const auto create_output_device = [this, &patches, &options,
+                                     &clustering_pool](
+                                        PdfDocument* pdf_document) {
+    auto output_device =
+        gtl::MakeUnique<ProtobufOutputDevice>(patches, pdf_document);
+    output_device->SetPageCache(&doc_id_, options.page_cache);
+    output_device->SetClusterPages(options.cluster_pages);
+    output_device->SetClusteringPool(clustering_pool.get());
+    return output_device;
+  };
+  const auto finish_page = [&options](PdfPage* page) {
+    if (options.page_callback) options.page_callback(*page);
+    if (options.rows_only) {
+      page->clear_characters();
+      page->clear_segments();
+      page->clear_blocks();
+    }
+  };
+
+  // Pages are committed in page order, so the pages of an interrupted run are
+  // a prefix of page_numbers.
   PdfDocument pdf_document;
-  ProtobufOutputDevice output_device(patches, &pdf_document);
-  doc_->displayPages(&output_device, first_page,
-                     last_page <= 0 ? doc_->getNumPages() : last_page,
-                     kHorizontalDPI, kVerticalDPI, /* rotate= */ 0,
-                     /* useMediaBox= */ gTrue, /* crop= */ gTrue,
-                     /* printing= */ gTrue);
+  auto first_page_to_render = page_numbers.begin();
+  if (options.checkpoint != nullptr) {
+    for (; first_page_to_render != page_numbers.end() &&
+           options.checkpoint->HasPage(*first_page_to_render);
+         ++first_page_to_render) {
+      PdfPage* const page = pdf_document.add_pages();
+      *page = options.checkpoint->ReadPageOrDie(*first_page_to_render);
+      finish_page(page);
+    }
+    if (pdf_document.pages_size() > 0) {
+      LOG(INFO) << "Resumed " << pdf_document.pages_size()
+                << " pages from the checkpoint";
+    }
+  }
+  PdfDocument rendered_pages = RenderPages(
+      doc_.get(), [this]() { return OpenPdfDocOrDie(); },
+      options.use_font_cache ? font_cache_key_ : 0,
+      std::vector<int>(first_page_to_render, page_numbers.end()),
+      options.num_threads, create_output_device,
+      [&options, &finish_page](PdfPage* page) {
+        if (options.checkpoint != nullptr) {
+          options.checkpoint->CommitPageOrDie(*page);
+        }
+        finish_page(page);
+      });
+  if (pdf_document.pages_size() == 0) return rendered_pages;
+  MovePages(PageFinisher(), &rendered_pages, &pdf_document);
   return pdf_document;
 }
 
+PdfPage XPDFDoc::ParsePage(const int page_number,
+                            const PdfDocumentChanges& patches) const {
+  CHECK_GE(page_number, 1);
+  CHECK_LE(page_number, GetNumPages());
+  const auto render_page = [this](int page_number) {
+    const PdfDocumentChanges no_changes;
+    PdfDocument pdf_document;
+    ProtobufOutputDevice output_device(no_changes, &pdf_document);
+    output_device.SetClusterPages(false);
+    DisplayPage(doc_.get(), /* font_cache_key= */ 0, &output_device,
+                page_number);
+    CHECK_EQ(pdf_document.pages_size(), 1);
+    PdfPage page;
+    page.Swap(pdf_document.mutable_pages(0));
+    return page;
+  };
+  return clustered_pages_->GetPage(
+      page_number, GetPageChanges(patches, page_number), render_page);
+}
+
+PdfDocument XPDFDoc::ParseMargins(const std::vector<int>& page_numbers,
+                                  const float margin,
+                                  const int num_threads) const {
+  CHECK_GT(margin, 0.0f);
+  const PdfDocumentChanges no_changes;
+  return RenderPages(doc_.get(), [this]() { return OpenPdfDocOrDie(); },
+                     /* font_cache_key= */ 0, page_numbers, num_threads,
+                     [this, &no_changes, margin](PdfDocument* pdf_document) {
+                       auto output_device =
+                           gtl::MakeUnique<ProtobufOutputDevice>(
+                               no_changes, pdf_document, margin);
+                       return output_device;
+                     },
+                     PageFinisher());
+}
+
 }  // namespace pdf
 }  // namespace x86
 }  // namespace cpu_instructions
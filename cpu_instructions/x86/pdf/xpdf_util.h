@@ -17,11 +17,15 @@
 #ifndef CPU_INSTRUCTIONS_X86_PDF_XPDF_UTIL_H_
 #define CPU_INSTRUCTIONS_X86_PDF_XPDF_UTIL_H_
 
+#include <cstdint>
+#include <functional>
 #include <map>
 #include <memory>
+#include <vector>
 #include "strings/string.h"
 
 #include "cpu_instructions/x86/pdf/pdf_document.pb.h"
+#include "strings/string_view.h"
 
 // xpdf classes.
 class PDFDoc;
@@ -30,6 +34,64 @@ namespace cpu_instructions {
 namespace x86 {
 namespace pdf {
 
+class ClusteredPageCache;
+class PdfPageCache;
+class PdfParseCheckpoint;
+
+// Options for XPDFDoc::Parse.
+struct PdfParseOptions {
+  // When num_threads > 1, the pages are split into shards of consecutive pages
+  // that are processed concurrently, each worker thread using its own xpdf
+  // document. Pages are merged back in page order so the result does not
+  // depend on num_threads.
+  int num_threads = 1;
+
+  // When positive, pages are clustered and patched on a pool of that many
+  // threads, shared by all the rendering threads, while xpdf renders the next
+  // pages. This uses more cores even when num_threads is 1. Pages are still
+  // returned in page order, and the result does not depend on it.
+  int num_clustering_threads = 0;
+
+  // If not null, pages are looked up in this cache and are neither rendered
+  // nor clustered when found. Pages that are not found are added to the cache.
+  // Not owned.
+  PdfPageCache* page_cache = nullptr;
+
+  // If not null, the leading pages that are already in the checkpoint are read
+  // from it instead of being parsed, and the other pages are committed to it
+  // once they are parsed. The checkpoint must have been opened for this
+  // document and these patches. Not owned.
+  PdfParseCheckpoint* checkpoint = nullptr;
+
+  // If set, called with each page once it is parsed, in page order and never
+  // concurrently. Pages are complete, even when rows_only is set.
+  std::function<void(const PdfPage&)> page_callback;
+
+  // If true, xpdf takes the fonts of the pages from a process-wide cache,
+  // shared by all XPDFDocs, instead of creating them and their ToUnicode maps
+  // again for every page. Only documents with a file identifier are cached.
+  // The result does not depend on it.
+  bool use_font_cache = false;
+
+  // If false, the pages only contain the characters rendered by xpdf: they are
+  // neither clustered nor patched, and the page cache is not used. This is
+  // meant to measure the rendering alone, and can not be combined with a
+  // checkpoint.
+  bool cluster_pages = true;
+
+  // If true, only the rows of the pages are returned: characters, segments and
+  // blocks are released as soon as a page is parsed. The rows are all the SDM
+  // extraction needs, and are a fraction of the size of the characters.
+  bool rows_only = false;
+};
+
+// An entry of the document outline (aka bookmarks).
+struct PdfOutlineEntry {
+  string title;         // UTF-8 encoded.
+  int depth = 0;        // 0 for top level entries.
+  int page_number = 0;  // 1-based, 0 if the entry does not point to a page.
+};
+
 // Represents an XPDF document.
 class XPDFDoc {
  public:
@@ -37,20 +99,70 @@ class XPDFDoc {
 
   static std::unique_ptr<const XPDFDoc> OpenOrDie(const string& filename);
 
+  // Opens a document held in memory. data is not copied and must outlive the
+  // returned object.
+  static std::unique_ptr<const XPDFDoc> OpenFromMemoryOrDie(StringPiece data);
+
+  // Opens a document by mapping the file in memory. Unlike OpenOrDie, repeated
+  // runs and the worker threads of a parallel Parse read the data from the
+  // kernel page cache instead of each doing their own buffered reads.
+  static std::unique_ptr<const XPDFDoc> OpenMappedOrDie(const string& filename);
+
   ~XPDFDoc();
 
   const Metadata& GetMetadata() const { return metadata_; }
   const PdfDocumentId& GetDocumentId() const { return doc_id_; }
+  int GetNumPages() const;
+
+  // Returns the document outline, flattened in document order: each entry is
+  // followed by its descendants.
+  std::vector<PdfOutlineEntry> GetOutline() const;
 
+  // Parses pages [first_page, last_page] (1-based, inclusive), last_page <= 0
+  // means 'up to the last page'.
   PdfDocument Parse(int first_page, int last_page,
-                    const PdfDocumentChanges& patches) const;
+                    const PdfDocumentChanges& patches,
+                    const PdfParseOptions& options = PdfParseOptions()) const;
+
+  // Same as above for an explicit list of pages, in increasing order.
+  PdfDocument Parse(const std::vector<int>& page_numbers,
+                    const PdfDocumentChanges& patches,
+                    const PdfParseOptions& options = PdfParseOptions()) const;
+
+  // Parses a single page, with the changes of 'patches' for this page. This is
+  // meant for tools that work on one page at a time: the most recently parsed
+  // pages are kept in memory, so that parsing one of them again, e.g. after
+  // editing its patches, does not render it again. The page is only clustered
+  // again if its prevent_segment_bindings changed.
+  PdfPage ParsePage(int page_number, const PdfDocumentChanges& patches) const;
+
+  // A cheap variant of Parse that only retains the characters overlapping the
+  // top and bottom 'margin' of the pages, i.e. headers and footers. Patches are
+  // not applied. This is useful to decide which pages are worth parsing.
+  PdfDocument ParseMargins(const std::vector<int>& page_numbers, float margin,
+                           int num_threads = 1) const;
 
  private:
-  explicit XPDFDoc(std::unique_ptr<PDFDoc> doc);
+  class MappedFile;
+
+  // Either filename or data must be empty. mapped_file may be null.
+  XPDFDoc(const string& filename, StringPiece data,
+          std::unique_ptr<MappedFile> mapped_file);
+
+  // Opens a new xpdf document on the same file or data. xpdf documents are not
+  // thread safe, worker threads use their own.
+  std::unique_ptr<PDFDoc> OpenPdfDocOrDie() const;
 
+  const string filename_;  // Empty if the document is read from memory.
+  const StringPiece data_;  // Empty if the document is read from a file.
+  const std::unique_ptr<MappedFile> mapped_file_;
   std::unique_ptr<PDFDoc> doc_;
   const Metadata metadata_;
   const PdfDocumentId doc_id_;
+  // The key of the document in the font cache, 0 if it is not cached.
+  const uint64_t font_cache_key_;
+  // The pages parsed by ParsePage.
+  const std::unique_ptr<ClusteredPageCache> clustered_pages_;
 };
 
 }  // namespace pdf
@@ -0,0 +1,106 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Measures the throughput of XPDFDoc::Parse, in characters per second. By
+// default, pages are only rendered, i.e. the time is that of xpdf and of
+// ProtobufOutputDevice::drawChar; --cpu_instructions_cluster_pages adds the
+// clustering and the patches. The default input is the small test document;
+// for meaningful numbers, run it in optimized mode on the SDM:
+//   bazel run -c opt //cpu_instructions/x86/pdf:xpdf_util_benchmark --
+//       --cpu_instructions_pdf_file=/path/to/sdm.pdf
+//       --cpu_instructions_last_page=100
+// With --cpu_instructions_cluster_pages,
+// --cpu_instructions_num_clustering_threads shows how much of the clustering
+// is hidden behind rendering. Comparing the ms/page with and without
+// --cpu_instructions_use_font_cache gives the share of the per-page time that
+// xpdf spends creating the fonts of the pages.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+#include "cpu_instructions/x86/pdf/pdf_document.pb.h"
+#include "cpu_instructions/x86/pdf/xpdf_font_cache.h"
+#include "cpu_instructions/x86/pdf/xpdf_util.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "strings/string.h"
+
+DEFINE_string(cpu_instructions_pdf_file,
+              "cpu_instructions/x86/pdf/testdata/simple.pdf",
+              "The PDF file to parse.");
+DEFINE_int32(cpu_instructions_first_page, 1, "The first page to parse.");
+DEFINE_int32(cpu_instructions_last_page, -1,
+             "The last page to parse, -1 means the last page of the document.");
+DEFINE_int32(cpu_instructions_num_iterations, 10,
+             "The number of times the pages are parsed.");
+DEFINE_bool(cpu_instructions_cluster_pages, false,
+            "Cluster and patch the pages after rendering them, see "
+            "PdfParseOptions.");
+DEFINE_int32(cpu_instructions_num_clustering_threads, 0,
+             "The number of threads clustering pages while xpdf renders, see "
+             "PdfParseOptions.");
+DEFINE_bool(cpu_instructions_use_font_cache, false,
+            "Take the fonts of the pages from the process-wide font cache, see "
+            "PdfParseOptions.");
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+namespace {
+
+void Main() {
+  const auto doc = XPDFDoc::OpenOrDie(FLAGS_cpu_instructions_pdf_file);
+  PdfParseOptions options;
+  options.cluster_pages = FLAGS_cpu_instructions_cluster_pages;
+  options.num_clustering_threads =
+      FLAGS_cpu_instructions_num_clustering_threads;
+  options.use_font_cache = FLAGS_cpu_instructions_use_font_cache;
+  int64_t num_characters = 0;
+  int num_pages = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < FLAGS_cpu_instructions_num_iterations; ++i) {
+    const PdfDocument pdf_document =
+        doc->Parse(FLAGS_cpu_instructions_first_page,
+                   FLAGS_cpu_instructions_last_page, PdfDocumentChanges(),
+                   options);
+    num_pages += pdf_document.pages_size();
+    for (const PdfPage& page : pdf_document.pages()) {
+      num_characters += page.characters_size();
+    }
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  LOG(INFO) << "Parsed " << num_characters << " characters in "
+            << elapsed.count() << " s: "
+            << num_characters / elapsed.count() << " characters/s, "
+            << 1e3 * elapsed.count() / std::max(num_pages, 1) << " ms/page";
+  if (FLAGS_cpu_instructions_use_font_cache) {
+    const GfxFontCacheStats stats = GetGfxFontCacheStats();
+    LOG(INFO) << "Font cache: " << stats.num_fonts << " fonts, "
+              << stats.num_hits << " hits";
+  }
+}
+
+}  // namespace
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cpu_instructions::x86::pdf::Main();
+  return 0;
+}
@@ -14,7 +14,17 @@
 
 #include "cpu_instructions/x86/pdf/xpdf_util.h"
 
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
 #include "cpu_instructions/testing/test_util.h"
+#include "cpu_instructions/x86/pdf/pdf_document_utils.h"
+#include "cpu_instructions/x86/pdf/pdf_page_cache.h"
+#include "cpu_instructions/x86/pdf/pdf_parse_checkpoint.h"
+#include "cpu_instructions/x86/pdf/xpdf_font_cache.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "src/google/protobuf/text_format.h"
@@ -36,6 +46,58 @@ string GetPdfFilename(const string& name) {
   return StrCat(getenv("TEST_SRCDIR"), kTestDataPath, name);
 }
 
+// The number of pages of GetMultiPagePdf. Larger than two shards of the
+// parallel Parse, and than the pages queued for a few clustering threads.
+constexpr const int kNumMultiPagePdfPages = 40;
+
+// Returns a PDF document of num_pages pages. Each page holds a small opcode
+// table whose text depends on the page number, so that pages swapped in the
+// output are caught.
+string GetMultiPagePdf(int num_pages) {
+  // The object numbers are: 1 for the catalog, 2 for the page tree, 3 for the
+  // font, then the page and its content stream for each page.
+  std::vector<string> objects = {
+      "<< /Type /Catalog /Pages 2 0 R >>", "",
+      "<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>"};
+  string kids;
+  for (int page = 1; page <= num_pages; ++page) {
+    const int page_object = objects.size() + 1;
+    StrAppend(&kids, page_object, " 0 R ");
+    objects.push_back(StrCat(
+        "<< /Type /Page /Parent 2 0 R /MediaBox [0 0 612 792] "
+        "/Resources << /Font << /F1 3 0 R >> >> /Contents ",
+        page_object + 1, " 0 R >>"));
+    string content = StrCat("BT /F1 14 Tf 72 720 Td (Page ", page, ") Tj ET\n",
+                            "BT /F1 10 Tf 72 690 Td (Opcode) Tj 200 0 Td "
+                            "(Instruction) Tj ET\n");
+    for (int row = 0; row < 3; ++row) {
+      content += StrCat("BT /F1 10 Tf 72 ", 670 - 20 * row, " Td (0F 38 F",
+                        row, " /r) Tj 200 0 Td (MOVBE", page, " r", 16 << row,
+                        ", m16) Tj ET\n");
+    }
+    objects.push_back(StrCat("<< /Length ", content.size(), " >>\nstream\n",
+                             content, "endstream"));
+  }
+  objects[1] =
+      StrCat("<< /Type /Pages /Kids [", kids, "] /Count ", num_pages, " >>");
+  string pdf = "%PDF-1.4\n";
+  std::vector<size_t> offsets;
+  for (size_t i = 0; i < objects.size(); ++i) {
+    offsets.push_back(pdf.size());
+    StrAppend(&pdf, i + 1, " 0 obj\n", objects[i], "\nendobj\n");
+  }
+  const size_t xref_offset = pdf.size();
+  StrAppend(&pdf, "xref\n0 ", objects.size() + 1, "\n0000000000 65535 f \n");
+  for (const size_t offset : offsets) {
+    char entry[21];
+    snprintf(entry, sizeof(entry), "%010zu 00000 n \n", offset);
+    pdf += entry;
+  }
+  pdf += StrCat("trailer\n<< /Size ", objects.size() + 1,
+                " /Root 1 0 R >>\nstartxref\n", xref_offset, "\n%%EOF\n");
+  return pdf;
+}
+
 TEST(ProtobufOutputDeviceTest, TestSimplePdfOutput) {
   const auto doc = XPDFDoc::OpenOrDie(GetPdfFilename("simple.pdf"));
 
@@ -491,6 +553,368 @@ TEST(ProtobufOutputDeviceTest, TestSimplePdfOutput) {
   EXPECT_THAT(pdf_document, EqualsProto(kExpected));
 }
 
+TEST(ProtobufOutputDeviceTest, ParsePageList) {
+  const auto doc = XPDFDoc::OpenOrDie(GetPdfFilename("simple.pdf"));
+  EXPECT_EQ(doc->GetNumPages(), 1);
+  const PdfDocument range =
+      doc->Parse(1 /*first_page*/, -1 /*last_page*/, PdfDocumentChanges());
+  const PdfDocument list = doc->Parse({1}, PdfDocumentChanges());
+  EXPECT_EQ(list.SerializeAsString(), range.SerializeAsString());
+  EXPECT_EQ(doc->Parse(std::vector<int>(), PdfDocumentChanges()).pages_size(),
+            0);
+}
+
+TEST(ProtobufOutputDeviceTest, ParseMargins) {
+  const auto doc = XPDFDoc::OpenOrDie(GetPdfFilename("simple.pdf"));
+  const PdfDocument pdf_document = doc->ParseMargins({1}, 100.0f);
+  ASSERT_EQ(pdf_document.pages_size(), 1);
+  const PdfPage& page = pdf_document.pages(0);
+  // Only the characters starting above y=100 are kept, the page has no bottom
+  // text.
+  ASSERT_EQ(page.characters_size(), 7);
+  for (const PdfCharacter& character : page.characters()) {
+    EXPECT_LE(character.bounding_box().top(), 100.0f);
+  }
+  ASSERT_EQ(page.rows_size(), 2);
+  EXPECT_EQ(page.rows(1).blocks(0).text(), "ab");
+  EXPECT_EQ(page.rows(1).blocks(1).text(), "cd");
+}
+
+TEST(ProtobufOutputDeviceTest, RemovesOverprintedCharacters) {
+  // The page shows "Bold" twice with an offset of 0.3 to simulate bold text,
+  // then "Hello".
+  const auto doc = XPDFDoc::OpenOrDie(GetPdfFilename("overprinted.pdf"));
+  const PdfDocument pdf_document =
+      doc->Parse(1 /*first_page*/, -1 /*last_page*/, PdfDocumentChanges());
+  ASSERT_EQ(pdf_document.pages_size(), 1);
+  const PdfPage& page = pdf_document.pages(0);
+  EXPECT_EQ(page.num_overprinted_characters(), 4);
+  string text;
+  for (const PdfCharacter& character : page.characters()) {
+    text += character.utf8();
+  }
+  // The adjacent "l" are not overprinted.
+  EXPECT_EQ(text, "BoldHello");
+}
+
+TEST(ProtobufOutputDeviceTest, EmptyOutline) {
+  const auto doc = XPDFDoc::OpenOrDie(GetPdfFilename("simple.pdf"));
+  EXPECT_TRUE(doc->GetOutline().empty());
+}
+
+TEST(ProtobufOutputDeviceTest, ParallelParseMatchesSerialParse) {
+  const string data = GetMultiPagePdf(kNumMultiPagePdfPages);
+  const auto doc = XPDFDoc::OpenFromMemoryOrDie(data);
+  ASSERT_EQ(doc->GetNumPages(), kNumMultiPagePdfPages);
+  const PdfDocument serial =
+      doc->Parse(1 /*first_page*/, -1 /*last_page*/, PdfDocumentChanges());
+  ASSERT_EQ(serial.pages_size(), kNumMultiPagePdfPages);
+  for (int i = 0; i < serial.pages_size(); ++i) {
+    const PdfPage& page = serial.pages(i);
+    EXPECT_EQ(page.number(), i + 1);
+    string text;
+    for (const PdfCharacter& character : page.characters()) {
+      if (character.utf8() != " ") text += character.utf8();
+    }
+    EXPECT_THAT(text, ::testing::HasSubstr(StrCat("MOVBE", i + 1, "r16")));
+  }
+  for (const int num_threads : {1, 2, 8}) {
+    PdfParseOptions options;
+    options.num_threads = num_threads;
+    const PdfDocument parallel = doc->Parse(
+        1 /*first_page*/, -1 /*last_page*/, PdfDocumentChanges(), options);
+    EXPECT_EQ(parallel.SerializeAsString(), serial.SerializeAsString())
+        << "num_threads=" << num_threads;
+  }
+  // A range that does not start on a shard boundary.
+  PdfParseOptions options;
+  options.num_threads = 8;
+  const PdfDocument range = doc->Parse(5 /*first_page*/, 27 /*last_page*/,
+                                       PdfDocumentChanges(), options);
+  ASSERT_EQ(range.pages_size(), 23);
+  for (int i = 0; i < range.pages_size(); ++i) {
+    EXPECT_EQ(range.pages(i).SerializeAsString(),
+              serial.pages(i + 4).SerializeAsString());
+  }
+}
+
+TEST(ProtobufOutputDeviceTest, FontCacheDoesNotChangeOutput) {
+  const auto doc = XPDFDoc::OpenOrDie(GetPdfFilename("simple.pdf"));
+  const PdfDocument expected =
+      doc->Parse(1 /*first_page*/, -1 /*last_page*/, PdfDocumentChanges());
+  const GfxFontCacheStats stats_before = GetGfxFontCacheStats();
+  for (const int num_threads : {1, 2}) {
+    PdfParseOptions options;
+    options.num_threads = num_threads;
+    options.use_font_cache = true;
+    // The second iteration takes all its fonts from the cache.
+    EXPECT_EQ(doc->Parse(1 /*first_page*/, -1 /*last_page*/,
+                         PdfDocumentChanges(), options)
+                  .SerializeAsString(),
+              expected.SerializeAsString())
+        << "num_threads=" << num_threads;
+  }
+  const GfxFontCacheStats stats_after = GetGfxFontCacheStats();
+  EXPECT_GT(stats_after.num_fonts, stats_before.num_fonts);
+  EXPECT_GT(stats_after.num_hits, stats_before.num_hits);
+}
+
+TEST(ProtobufOutputDeviceTest, FontCacheSkipsDocumentsWithoutFileId) {
+  // GetMultiPagePdf has no /ID in its trailer.
+  const string data = GetMultiPagePdf(2);
+  const auto doc = XPDFDoc::OpenFromMemoryOrDie(data);
+  PdfParseOptions options;
+  options.use_font_cache = true;
+  const GfxFontCacheStats stats_before = GetGfxFontCacheStats();
+  EXPECT_EQ(doc->Parse(1 /*first_page*/, -1 /*last_page*/,
+                       PdfDocumentChanges(), options)
+                .SerializeAsString(),
+            doc->Parse(1 /*first_page*/, -1 /*last_page*/,
+                       PdfDocumentChanges())
+                .SerializeAsString());
+  const GfxFontCacheStats stats_after = GetGfxFontCacheStats();
+  EXPECT_EQ(stats_after.num_fonts, stats_before.num_fonts);
+  EXPECT_EQ(stats_after.num_hits, stats_before.num_hits);
+}
+
+TEST(ProtobufOutputDeviceTest, ClusteringPoolDoesNotChangeOutput) {
+  // With two clustering threads, at most eight rendered pages wait for the
+  // pool, far fewer than the pages of the document.
+  constexpr const int kNumClusteringThreads = 2;
+  const string data = GetMultiPagePdf(kNumMultiPagePdfPages);
+  const auto doc = XPDFDoc::OpenFromMemoryOrDie(data);
+  // One of the pages is patched, using the text it actually has.
+  constexpr const int kPatchedPage = 7;
+  const PdfDocument unpatched = doc->Parse(
+      kPatchedPage /*first_page*/, kPatchedPage /*last_page*/,
+      PdfDocumentChanges());
+  ASSERT_EQ(unpatched.pages_size(), 1);
+  const string cell_text = GetCellTextOrEmpty(unpatched.pages(0), 2, 0);
+  ASSERT_FALSE(cell_text.empty());
+  PdfDocumentChanges patches;
+  PdfPageChanges* const page_changes = patches.add_pages();
+  page_changes->set_page_number(kPatchedPage);
+  PdfPagePatch* const patch = page_changes->add_patches();
+  patch->set_row(2);
+  patch->set_col(0);
+  patch->set_expected(cell_text);
+  patch->set_replacement("patched");
+  const PdfDocument expected = doc->Parse(1 /*first_page*/, -1 /*last_page*/,
+                                          patches, PdfParseOptions());
+  ASSERT_EQ(expected.pages_size(), kNumMultiPagePdfPages);
+  EXPECT_EQ(GetCellTextOrEmpty(expected.pages(kPatchedPage - 1), 2, 0),
+            "patched");
+  std::vector<int> expected_page_numbers;
+  for (const auto& page : expected.pages()) {
+    expected_page_numbers.push_back(page.number());
+  }
+  for (const int num_threads : {1, 2}) {
+    // Every third page is read from the cache and queued behind the pages that
+    // are still being clustered; the other pages are clustered on the pool.
+    PdfPageCache page_cache(StrCat(
+        getenv("TEST_TMPDIR"), "/clustering_pool_page_cache_", num_threads));
+    std::vector<int> cached_page_numbers;
+    for (int page = 1; page <= kNumMultiPagePdfPages; page += 3) {
+      cached_page_numbers.push_back(page);
+    }
+    PdfParseOptions cache_options;
+    cache_options.page_cache = &page_cache;
+    doc->Parse(cached_page_numbers, patches, cache_options);
+    ASSERT_EQ(page_cache.num_hits(), 0);
+
+    PdfParseOptions options;
+    options.num_threads = num_threads;
+    options.num_clustering_threads = kNumClusteringThreads;
+    options.page_cache = &page_cache;
+    std::vector<int> callback_page_numbers;
+    options.page_callback = [&callback_page_numbers](const PdfPage& page) {
+      callback_page_numbers.push_back(page.number());
+    };
+    const PdfDocument pdf_document =
+        doc->Parse(1 /*first_page*/, -1 /*last_page*/, patches, options);
+    EXPECT_EQ(page_cache.num_hits(),
+              static_cast<int64_t>(cached_page_numbers.size()))
+        << "num_threads=" << num_threads;
+    EXPECT_EQ(pdf_document.SerializeAsString(), expected.SerializeAsString())
+        << "num_threads=" << num_threads;
+    EXPECT_EQ(callback_page_numbers, expected_page_numbers)
+        << "num_threads=" << num_threads;
+  }
+}
+
+TEST(ProtobufOutputDeviceTest, ParsePage) {
+  const auto doc = XPDFDoc::OpenOrDie(GetPdfFilename("simple.pdf"));
+  PdfDocumentChanges patches;
+  const PdfPage page = doc->ParsePage(1, patches);
+  EXPECT_EQ(page.SerializeAsString(),
+            doc->Parse(1 /*first_page*/, 1 /*last_page*/, patches)
+                .pages(0)
+                .SerializeAsString());
+
+  // The page is patched again from memory.
+  PdfPageChanges* const page_changes = patches.add_pages();
+  page_changes->set_page_number(1);
+  PdfPagePatch* const patch = page_changes->add_patches();
+  patch->set_row(1);
+  patch->set_col(0);
+  patch->set_expected("ab");
+  patch->set_replacement("patched");
+  const PdfPage patched_page = doc->ParsePage(1, patches);
+  EXPECT_EQ(GetCellTextOrEmpty(patched_page, 1, 0), "patched");
+  EXPECT_EQ(patched_page.SerializeAsString(),
+            doc->Parse(1 /*first_page*/, 1 /*last_page*/, patches)
+                .pages(0)
+                .SerializeAsString());
+}
+
+TEST(ProtobufOutputDeviceTest, ParseWithPageCache) {
+  const auto doc = XPDFDoc::OpenOrDie(GetPdfFilename("simple.pdf"));
+  const PdfDocument expected =
+      doc->Parse(1 /*first_page*/, -1 /*last_page*/, PdfDocumentChanges());
+  PdfPageCache page_cache(StrCat(getenv("TEST_TMPDIR"), "/page_cache"));
+  PdfParseOptions options;
+  options.page_cache = &page_cache;
+  // Cold cache.
+  EXPECT_EQ(doc->Parse(1 /*first_page*/, -1 /*last_page*/,
+                       PdfDocumentChanges(), options)
+                .SerializeAsString(),
+            expected.SerializeAsString());
+  EXPECT_EQ(page_cache.num_hits(), 0);
+  EXPECT_EQ(page_cache.num_misses(), 1);
+  // Warm cache.
+  EXPECT_EQ(doc->Parse(1 /*first_page*/, -1 /*last_page*/,
+                       PdfDocumentChanges(), options)
+                .SerializeAsString(),
+            expected.SerializeAsString());
+  EXPECT_EQ(page_cache.num_hits(), 1);
+  EXPECT_EQ(page_cache.num_misses(), 1);
+}
+
+TEST(ProtobufOutputDeviceTest, ParseRowsOnly) {
+  const auto doc = XPDFDoc::OpenOrDie(GetPdfFilename("simple.pdf"));
+  const PdfDocument expected =
+      doc->Parse(1 /*first_page*/, -1 /*last_page*/, PdfDocumentChanges());
+  for (const int num_threads : {1, 2}) {
+    PdfParseOptions options;
+    options.num_threads = num_threads;
+    options.rows_only = true;
+    PdfDocument callback_pages;
+    options.page_callback = [&callback_pages](const PdfPage& page) {
+      *callback_pages.add_pages() = page;
+    };
+    const PdfDocument rows_only = doc->Parse(
+        1 /*first_page*/, -1 /*last_page*/, PdfDocumentChanges(), options);
+    EXPECT_EQ(callback_pages.SerializeAsString(), expected.SerializeAsString())
+        << "num_threads=" << num_threads;
+    ASSERT_EQ(rows_only.pages_size(), expected.pages_size());
+    for (int i = 0; i < rows_only.pages_size(); ++i) {
+      const PdfPage& page = rows_only.pages(i);
+      EXPECT_EQ(page.number(), expected.pages(i).number());
+      EXPECT_EQ(page.characters_size(), 0);
+      EXPECT_EQ(page.segments_size(), 0);
+      EXPECT_EQ(page.blocks_size(), 0);
+      EXPECT_EQ(page.rows_size(), expected.pages(i).rows_size());
+    }
+  }
+}
+
+TEST(ProtobufOutputDeviceTest, ParseWithoutClustering) {
+  const auto doc = XPDFDoc::OpenOrDie(GetPdfFilename("simple.pdf"));
+  // Warms the cache with the clustered pages, which must not be used when
+  // pages are not clustered.
+  PdfPageCache page_cache(
+      StrCat(getenv("TEST_TMPDIR"), "/unclustered_page_cache"));
+  PdfParseOptions cache_options;
+  cache_options.page_cache = &page_cache;
+  const PdfDocument expected = doc->Parse(
+      1 /*first_page*/, -1 /*last_page*/, PdfDocumentChanges(), cache_options);
+  PdfParseOptions options;
+  options.cluster_pages = false;
+  options.page_cache = &page_cache;
+  const PdfDocument rendered = doc->Parse(
+      1 /*first_page*/, -1 /*last_page*/, PdfDocumentChanges(), options);
+  EXPECT_EQ(page_cache.num_hits(), 0);
+  ASSERT_EQ(rendered.pages_size(), expected.pages_size());
+  for (int i = 0; i < rendered.pages_size(); ++i) {
+    const PdfPage& page = rendered.pages(i);
+    EXPECT_EQ(page.number(), expected.pages(i).number());
+    ASSERT_EQ(page.characters_size(), expected.pages(i).characters_size());
+    for (int j = 0; j < page.characters_size(); ++j) {
+      EXPECT_EQ(page.characters(j).SerializeAsString(),
+                expected.pages(i).characters(j).SerializeAsString());
+    }
+    EXPECT_EQ(page.segments_size(), 0);
+    EXPECT_EQ(page.blocks_size(), 0);
+    EXPECT_EQ(page.rows_size(), 0);
+  }
+}
+
+TEST(ProtobufOutputDeviceTest, ResumeFromCheckpoint) {
+  const auto doc = XPDFDoc::OpenOrDie(GetPdfFilename("simple.pdf"));
+  const PdfDocumentChanges no_changes;
+  const PdfDocument expected =
+      doc->Parse(1 /*first_page*/, -1 /*last_page*/, no_changes);
+  ASSERT_GT(expected.pages_size(), 0);
+  const string filename = StrCat(getenv("TEST_TMPDIR"), "/checkpoint");
+  {
+    const auto checkpoint = PdfParseCheckpoint::OpenOrDie(
+        filename, doc->GetDocumentId(), no_changes);
+    PdfParseOptions options;
+    options.checkpoint = checkpoint.get();
+    EXPECT_EQ(doc->Parse(1 /*first_page*/, -1 /*last_page*/, no_changes,
+                         options)
+                  .SerializeAsString(),
+              expected.SerializeAsString());
+    EXPECT_EQ(checkpoint->num_pages(), expected.pages_size());
+  }
+  // All the pages are read from the checkpoint of the previous run.
+  const auto checkpoint = PdfParseCheckpoint::OpenOrDie(
+      filename, doc->GetDocumentId(), no_changes);
+  EXPECT_EQ(checkpoint->num_resumed_pages(), expected.pages_size());
+  PdfParseOptions options;
+  options.checkpoint = checkpoint.get();
+  EXPECT_EQ(
+      doc->Parse(1 /*first_page*/, -1 /*last_page*/, no_changes, options)
+          .SerializeAsString(),
+      expected.SerializeAsString());
+}
+
+TEST(ProtobufOutputDeviceTest, OpenFromMemory) {
+  const string filename = GetPdfFilename("simple.pdf");
+  std::ifstream file(filename, std::ios::binary);
+  const string data((std::istreambuf_iterator<char>(file)),
+                    std::istreambuf_iterator<char>());
+  ASSERT_FALSE(data.empty());
+  const PdfDocument expected = XPDFDoc::OpenOrDie(filename)->Parse(
+      1 /*first_page*/, -1 /*last_page*/, PdfDocumentChanges());
+  const auto doc = XPDFDoc::OpenFromMemoryOrDie(data);
+  for (const int num_threads : {1, 2}) {
+    PdfParseOptions options;
+    options.num_threads = num_threads;
+    EXPECT_EQ(doc->Parse(1 /*first_page*/, -1 /*last_page*/,
+                         PdfDocumentChanges(), options)
+                  .SerializeAsString(),
+              expected.SerializeAsString())
+        << "num_threads=" << num_threads;
+  }
+}
+
+TEST(ProtobufOutputDeviceTest, OpenMapped) {
+  const string filename = GetPdfFilename("simple.pdf");
+  const PdfDocument expected = XPDFDoc::OpenOrDie(filename)->Parse(
+      1 /*first_page*/, -1 /*last_page*/, PdfDocumentChanges());
+  const auto doc = XPDFDoc::OpenMappedOrDie(filename);
+  for (const int num_threads : {1, 2}) {
+    PdfParseOptions options;
+    options.num_threads = num_threads;
+    EXPECT_EQ(doc->Parse(1 /*first_page*/, -1 /*last_page*/,
+                         PdfDocumentChanges(), options)
+                  .SerializeAsString(),
+              expected.SerializeAsString())
+        << "num_threads=" << num_threads;
+  }
+}
+
 }  // namespace
 }  // namespace pdf
 }  // namespace x86